@@ -10,12 +10,29 @@
 #include <cassert>
 #include <iostream>
 #include <cmath>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 
 #include "models/base_model.hpp"
 #include "models/base_spline_model.hpp"
 #include "models/linear_spline_model.hpp"
+#include "models/rmi_model.hpp"
+#include "models/quadratic_spline_model.hpp"
+#include "models/cubic_spline_model.hpp"
+#include "models/logarithmic_spline_model.hpp"
+#include "models/exponential_spline_model.hpp"
+#include "models/mixed_spline_model.hpp"
+#include "models/compact_spline_model.hpp"
 #include "bit_array.hpp"
+#include "codecs/golomb_codec.hpp"
+#include "codecs/elias_fano_codec.hpp"
 #include "snarf.hpp"
+#include "snarf_builder.hpp"
+#include "thread_pool.hpp"
+#include "radix_sort.hpp"
+#include "updatable_snarf.hpp"
 
 
 // assert_double_equals(x, y)
@@ -35,17 +52,17 @@ struct TestBaseModel {
         using BaseModel<Key>::BaseModel;
 
         // Simple implementation only for mocking purposes.
-        double predict(Key key) override {
+        double predict(Key key) {
             return key * 0.1 / key;
         }
 
         // Simple implementation only for mocking purposes.
-        size_t size_bytes() override {
+        size_t size_bytes() {
             return 16;
         }
 
         // Simple implementation only for mocking purposes.
-        void print_model() override {}
+        void print_model() const {}
     };
 
     // test_constructor_success_valid_inputs()
@@ -80,6 +97,15 @@ struct TestBaseModel {
     //   Checks that the final key is included in the sampled set.
     void test_build_key_array_final_key_inclusion();
 
+    // test_sample_key_array()
+    //   Checks that the key array samples evenly spaced input keys with
+    //   their eCDF.
+    void test_sample_key_array();
+
+    // test_build_error_bounded_key_array()
+    //   Checks that error-bounded fitting keeps only the keys it needs.
+    void test_build_error_bounded_key_array();
+
     // run_base_model_tests()
     //   Helper function to run all tests in this struct.
     int run_base_model_tests();
@@ -97,23 +123,37 @@ struct TestBaseSplineModel {
         using BaseSplineModel<Key>::BaseSplineModel;
 
         // Simple implementation only for mocking purposes.
-        double predict(Key key) override {
+        double predict(Key key) {
             return key * 0.1 / key;
         }
 
         // Simple implementation only for mocking purposes.
-        size_t size_bytes() override {
+        size_t size_bytes() {
             return 16;
         }
 
         // Simple implementation only for mocking purposes.
-        void print_model() override {}
+        void print_model() const {}
     };
 
     // test_binary_search()
     //   Test binary_search functionality.
     void test_binary_search();
 
+    // test_eytzinger_search()
+    //   Tests that the Eytzinger search agrees with the sorted binary search.
+    void test_eytzinger_search();
+
+    // test_radix_search()
+    //   Tests that the radix table search agrees with the sorted binary
+    //   search, for integer and floating-point keys.
+    void test_radix_search();
+
+    // test_binary_search_batch()
+    //   Tests that batched searches agree with binary_search() in every
+    //   layout, for sorted and unsorted keys.
+    void test_binary_search_batch();
+
     // run_base_spline_model_tests()
     //   Helper function to run all tests in this struct.
     int run_base_spline_model_tests();
@@ -144,12 +184,158 @@ struct TestLinearSplineModel {
     //   Recreates example from the original SNARF paper for testing.
     void test_paper_model();
 
+    // test_error_bound()
+    //   Tests that an error-bounded spline predicts every key within the bound,
+    //   with fewer segments than sampling every R-th key needs.
+    void test_error_bound();
+
+    // test_large_keys()
+    //   Tests that keys above 2^53 and signed keys across the keyspace are
+    //   predicted at full resolution.
+    void test_large_keys();
+
+    // test_predict_batch()
+    //   Tests that predict_batch() agrees with predict().
+    void test_predict_batch();
+
+    // test_append()
+    //   Tests that appending keys keeps the predictions of the existing
+    //   segments, predicts the appended keys in order, past a CDF of 1, and
+    //   that split appends sample the same keys as a single one.
+    void test_append();
+
     // run_linear_spline_model_tests()
     //   Helper function to run all tests in this struct.
     int run_linear_spline_model_tests();
 };
 
 
+// TestRMIModel
+//   Container that encapsulates all unit tests for the RMIModel.
+struct TestRMIModel {
+    // test_constructor()
+    //   Tests that the root and leaves are built and the key array released,
+    //   also with a flat root from equal keys.
+    void test_constructor();
+
+    // test_predict()
+    //   Tests that predictions hit the eCDF at the sampled keys and stay
+    //   within [0, 1].
+    void test_predict();
+
+    // test_monotone()
+    //   Tests that predictions never decrease, on clustered keys that leave
+    //   many leaves empty, and that batched predictions agree.
+    void test_monotone();
+
+    // test_size_bytes()
+    //   Tests that the size_bytes() function correctly calculates the model
+    //   size.
+    void test_size_bytes();
+
+    // run_rmi_model_tests()
+    //   Helper function to run all tests in this struct.
+    int run_rmi_model_tests();
+};
+
+
+// TestKernelSplineModel
+//   Container that encapsulates all unit tests for the KernelSplineModel and
+//   its kernels.
+struct TestKernelSplineModel {
+    // test_kernels()
+    //   Tests that every kernel runs from (0, 0) to (1, 1) and never decreases,
+    //   even at the limits of its coefficients.
+    void test_kernels();
+
+    // test_fit()
+    //   Tests that fitting a kernel to points on a known curve recovers it.
+    void test_fit();
+
+    // test_predict()
+    //   Tests that every kernel spline passes through its key array, stays
+    //   monotone between the keys and predicts the same in batches.
+    void test_predict();
+
+    // test_error_bound()
+    //   Tests that error-bounded kernel splines predict every key within the
+    //   bound, with fewer segments than the linear spline on skewed keys,
+    //   and fit keys above 2^53 as well as small ones.
+    void test_error_bound();
+
+    // test_size_bytes()
+    //   Tests that the size_bytes() function correctly calculates the model
+    //   size.
+    void test_size_bytes();
+
+    // run_kernel_spline_model_tests()
+    //   Helper function to run all tests in this struct.
+    int run_kernel_spline_model_tests();
+};
+
+
+// TestMixedSplineModel
+//   Container that encapsulates all unit tests for the MixedSplineModel.
+struct TestMixedSplineModel {
+    // test_constructor()
+    //   Tests that the kernel kinds are packed and indexed consistently, and
+    //   that invalid error bounds are rejected.
+    void test_constructor();
+
+    // test_kernel_selection()
+    //   Tests that segments pick cheap kernels on linear keys and curves on
+    //   skewed keys, making the model smaller than any single kernel's.
+    void test_kernel_selection();
+
+    // test_predict()
+    //   Tests that predictions match the chosen kernel of every segment and
+    //   stay within the error bound and monotone, also in batches.
+    void test_predict();
+
+    // test_size_bytes()
+    //   Tests that the size_bytes() function correctly calculates the model
+    //   size.
+    void test_size_bytes();
+
+    // run_mixed_spline_model_tests()
+    //   Helper function to run all tests in this struct.
+    int run_mixed_spline_model_tests();
+};
+
+
+// TestCompactSplineModel
+//   Container that encapsulates all unit tests for the CompactSplineModel.
+struct TestCompactSplineModel {
+    // test_constructor()
+    //   Tests that the knots are packed into frames at the right widths and
+    //   decode back to the sampled keys and ranks.
+    void test_constructor();
+
+    // test_predict()
+    //   Tests that predictions match the `LinearSplineModel` with the same
+    //   knots, also in batches, and are monotone, including for signed keys.
+    void test_predict();
+
+    // test_error_bound()
+    //   Tests a model whose knots are chosen to meet an error bound.
+    void test_error_bound();
+
+    // test_size_bytes()
+    //   Tests that the size_bytes() function correctly calculates the model
+    //   size.
+    void test_size_bytes();
+
+    // test_single_knot_frame()
+    //   Tests a last frame of one knot, whose zero-width fields sit at the
+    //   end of the packed offsets.
+    void test_single_knot_frame();
+
+    // run_compact_spline_model_tests()
+    //   Helper function to run all tests in this struct.
+    int run_compact_spline_model_tests();
+};
+
+
 // TestBitArray
 //   Container that encapsulates all unit tests for the BitArray struct.
 struct TestBitArray {
@@ -173,6 +359,31 @@ struct TestBitArray {
     //   Tests that the read function correctly returns the right bits.
     void test_read_bit();
 
+    // test_write_and_read_across_words()
+    //   Tests fields that straddle a 64-bit word boundary, including full
+    //   64-bit fields.
+    void test_write_and_read_across_words();
+
+    // test_write_bits_overwrites()
+    //   Tests that writing a field replaces its previous contents.
+    void test_write_bits_overwrites();
+
+    // test_copy_bits()
+    //   Tests copying ranges of bits between unaligned offsets.
+    void test_copy_bits();
+
+    // test_next_one()
+    //   Tests finding the next set bit, including across empty words.
+    void test_next_one();
+
+    // test_select_zero()
+    //   Tests selecting the n-th zero bit against a bit-by-bit scan.
+    void test_select_zero();
+
+    // test_select_one()
+    //   Tests selecting the n-th set bit against a bit-by-bit scan.
+    void test_select_one();
+
     // test_size_bytes()
     //   Tests that the correct size in bytes are returned.
     void test_size_bytes();
@@ -183,6 +394,29 @@ struct TestBitArray {
 };
 
 
+// TestCodec
+//   Container that encapsulates all unit tests for the block codecs.
+struct TestCodec {
+    // test_golomb_codec()
+    //   Encodes random blocks with the Golomb codec and checks the size, key
+    //   count, random access and range queries against the input.
+    void test_golomb_codec();
+
+    // test_elias_fano_codec()
+    //   Encodes random blocks of very different densities with the
+    //   Elias-Fano codec and checks them the same way.
+    void test_elias_fano_codec();
+
+    // test_elias_fano_width()
+    //   Checks that the Elias-Fano low width adapts to the number of keys.
+    void test_elias_fano_width();
+
+    // run_codec_tests()
+    //   Helper function to run all tests in this struct.
+    int run_codec_tests();
+};
+
+
 // TestSNARF
 //   Container that encapsulates all unit tests for the SNARF struct.
 struct TestSNARF {
@@ -210,12 +444,190 @@ struct TestSNARF {
     //   within a specified range is present.
     void test_size_bytes();
 
+    // test_predict_location()
+    //   Tests that a key's predicted location is its scaled CDF, and that the
+    //   models are called without virtual dispatch.
+    void test_predict_location();
+
+    // test_range_query_no_false_negatives()
+    //   Compares range queries over random keys and wide blocks against the
+    //   exact answer, checking that every non-empty range is reported.
+    void test_range_query_no_false_negatives();
+
+    // test_block_directory()
+    //   Checks that the block directory covers every key across many
+    //   superblocks and that every key is found through it.
+    void test_block_directory();
+
+    // test_line_layouts()
+    //   Checks both cache-line layouts, including blocks that overflow their
+    //   line, against every input key and a set of empty ranges.
+    void test_line_layouts();
+
+    // test_save_and_map()
+    //   Saves filters in both kinds of layout, maps them back and checks that
+    //   they answer identically, and that bad files are rejected.
+    void test_save_and_map();
+
+    // test_elias_fano_codec()
+    //   Checks filters using the Elias-Fano codec in every layout against the
+    //   input keys, and that a saved file only maps with the same codec.
+    void test_elias_fano_codec();
+
+    // test_error_bound()
+    //   Tests a filter whose model is fit to an error bound.
+    void test_error_bound();
+
+    // test_kernel_models()
+    //   Tests filters built on every kernel spline model and on the compact
+    //   spline model.
+    void test_kernel_models();
+
+    // test_rmi_model()
+    //   Checks filters using the RMI model against the input keys and across
+    //   a save and map.
+    void test_rmi_model();
+
+    // test_range_query_batch()
+    //   Checks that batched range queries agree with range_query() in every
+    //   layout and codec, for point, wide and empty ranges.
+    void test_range_query_batch();
+
+    // test_range_query_interleaved()
+    //   Checks that interleaved range queries agree with range_query() in
+    //   every layout and codec, including lines that overflow.
+    void test_range_query_interleaved();
+
+    // test_range_query_parallel()
+    //   Checks parallel range queries, and range queries from several threads
+    //   sharing one const filter, against range_query().
+    void test_range_query_parallel();
+
+    // test_parallel_build()
+    //   Checks that filters built on a thread pool are identical to those
+    //   built on one thread, in every layout and codec.
+    void test_parallel_build();
+
+    // test_fused_build()
+    //   Checks that the blocks built one at a time hold exactly the predicted
+    //   locations of their keys, for several models and layouts.
+    void test_fused_build();
+
+    // test_unsorted_input()
+    //   Checks that a filter built from unsorted keys, with and without
+    //   deduplication, matches one built from the sorted keys.
+    void test_unsorted_input();
+
+    // test_merged()
+    //   Checks that merging keys into a filter adds their locations to the
+    //   blocks they fall in and leaves the other blocks as they were, in
+    //   every layout.
+    void test_merged();
+
+    // test_append()
+    //   Checks that keys appended in batches of any size fill the blocks and
+    //   are found, with the false positive rate and size of a rebuilt filter,
+    //   that the earlier blocks and predictions are left as they were, and
+    //   that invalid appends and appends after merged() are rejected.
+    void test_append();
+
     // run_snarf_tests()
     //   Helper function to run all tests in this struct.
     int run_snarf_tests();
 };
 
 
+// TestThreadPool
+//   Container that encapsulates all unit tests for the ThreadPool struct.
+struct TestThreadPool {
+    // test_run()
+    //   Checks that every task of a batch runs exactly once, over several
+    //   batches and pool sizes, including empty batches.
+    void test_run();
+
+    // test_work_stealing()
+    //   Checks that the tasks of a thread stuck in a long task are stolen by
+    //   the others.
+    void test_work_stealing();
+
+    // test_nested_run()
+    //   Checks that a task starting a batch on its own pool runs it instead
+    //   of deadlocking.
+    void test_nested_run();
+
+    // run_thread_pool_tests()
+    //   Helper function to run all tests in this struct.
+    int run_thread_pool_tests();
+};
+
+
+// TestRadixSort
+//   Container that encapsulates all unit tests for sorting input keys.
+struct TestRadixSort {
+    // test_sort()
+    //   Checks the radix sort against std::sort for key types of several
+    //   widths and signedness, narrow and wide key ranges, and small inputs.
+    void test_sort();
+
+    // test_sort_parallel()
+    //   Checks that sorting on thread pools of several sizes gives the same
+    //   result as sorting on one thread.
+    void test_sort_parallel();
+
+    // test_sort_keys()
+    //   Checks sort_keys() with and without deduplication, for integer and
+    //   floating-point keys.
+    void test_sort_keys();
+
+    // run_radix_sort_tests()
+    //   Helper function to run all tests in this struct.
+    int run_radix_sort_tests();
+};
+
+
+// TestUpdatableSNARF
+//   Container that encapsulates all unit tests for the updatable wrapper.
+struct TestUpdatableSNARF {
+    // test_insert()
+    //   Checks that inserted keys are found right away, and after they are
+    //   merged into the filter in the background.
+    void test_insert();
+
+    // test_concurrent_queries()
+    //   Checks that queries running alongside inserts and merges find every
+    //   key inserted before they started.
+    void test_concurrent_queries();
+
+    // run_updatable_snarf_tests()
+    //   Helper function to run all tests in this struct.
+    int run_updatable_snarf_tests();
+};
+
+
+// TestSNARFBuilder
+//   Container that encapsulates all unit tests for the streaming builder.
+struct TestSNARFBuilder {
+    // test_build_from_range()
+    //   Builds a filter from an in-memory key range with a small write buffer
+    //   and checks it matches the filter built by the SNARF constructor.
+    void test_build_from_range();
+
+    // test_build_from_file()
+    //   Builds a filter from a binary key file and checks every key is found
+    //   through the mapped result.
+    void test_build_from_file();
+
+    // test_build_failure()
+    //   Checks that unsorted key streams, streams that change between passes,
+    //   partial key files and a too large `R` are rejected.
+    void test_build_failure();
+
+    // run_snarf_builder_tests()
+    //   Helper function to run all tests in this struct.
+    int run_snarf_builder_tests();
+};
+
+
 inline void assert_double_equals(double x, double y) {
     assert(fabs(x - y) < EPS);
 }
@@ -5,70 +5,225 @@
 
 #pragma once
 
-#include <boost/dynamic_bitset.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "bit_utils.hpp"
+#include "storage.hpp"
 
 
 // BitArray
-//   A `BitArray` interface for the bit array used in SNARF. Relies on the boost
-//   library's dynamic_bitset as a base.
+//   A `BitArray` interface for the bit array used in SNARF. Bits are packed
+//   LSB-first into 64-bit words, so that a field of up to 64 bits is read or
+//   written with at most two word accesses instead of one call per bit.
 struct BitArray {
-    // The underlying bit array storage.
-    boost::dynamic_bitset<> _bit_array;
+    // The underlying word storage. One extra zero word is always kept past the
+    // last used word so that two-word accesses never need a bounds check.
+    Storage<uint64_t, CacheAlignedAllocator<uint64_t> > _words;
+    // The number of addressable bits.
+    size_t _size;
 
     // BitArray()
     //   Default constructor with zero arguments.
-    BitArray() {}
+    BitArray() : _size(0) {
+        _initialize_bit_array(0);
+    }
 
     // BitArray(size)
     //   Constructs the underlying bit array with a size of `size`. It
     //   initializes all bits to 0 to begin with.
-    BitArray(size_t size) {
+    BitArray(size_t size) : _size(0) {
         _initialize_bit_array(size);
     }
 
     // _initialize_bit_array(size)
     //   Helper method that resizes the bit array for the default constructor.
+    //   Newly added bits are set to 0.
     void _initialize_bit_array(size_t size) {
-        this->_bit_array.resize(size, 0);
+        this->_words.resize((size + 63) / 64 + 1, 0);
+        this->_size = size;
+
+        // Clear any stale bits past the end when shrinking.
+        size_t last = size / 64;
+        this->_words[last] = low_bits(this->_words[last], size % 64);
+        for (size_t i = last + 1; i < this->_words.size(); ++i) {
+            this->_words[i] = 0;
+        }
+    }
+
+    // _drop_words(num_words)
+    //   Discards the first `num_words` words, moving the rest to the front and
+    //   zeroing the words freed at the end. Used to stream a long bit array out
+    //   through a bounded buffer.
+    void _drop_words(size_t num_words) {
+        size_t total = this->_words.size();
+        for (size_t i = num_words; i < total; ++i) {
+            this->_words[i - num_words] = this->_words[i];
+        }
+        for (size_t i = total - num_words; i < total; ++i) {
+            this->_words[i] = 0;
+        }
+    }
+
+    // size()
+    //   Returns the number of addressable bits.
+    size_t size() const {
+        return this->_size;
     }
 
     // write_bits(offset, value, num_bits)
-    //   Writes a certain number of bits from a value at an offset that is
-    //   specified by the input parameters.
-    void write_bits(size_t offset, size_t value, size_t num_bits) {
-        for (size_t i = 0; i < num_bits; ++i) {
-            // Set the value in the bit array to value[i].
-            if (value >> i & 1) {
-                this->_bit_array.set(offset + i);
-            }
+    //   Writes the lowest `num_bits` (at most 64) bits of `value` at `offset`,
+    //   overwriting whatever was stored there.
+    void write_bits(size_t offset, uint64_t value, size_t num_bits) {
+        if (num_bits == 0) {
+            return;
+        }
+
+        size_t word = offset >> 6;
+        size_t shift = offset & 63;
+        uint64_t mask = low_bits(~0ULL, num_bits);
+        value &= mask;
+
+        this->_words[word] = (this->_words[word] & ~(mask << shift))
+            | (value << shift);
+
+        // Spill the high part of the field into the next word.
+        if (shift + num_bits > 64) {
+            size_t spill = 64 - shift;
+            this->_words[word + 1] = (this->_words[word + 1] & ~(mask >> spill))
+                | (value >> spill);
         }
     }
 
-    // read_bits(offset, num_bits)
-    //   Returns a certain number of bits at an offset that is specified by the
-    //   input parameters.
-    size_t read_bits(size_t offset, size_t num_bits) {
-        size_t read = 0;
-        for (size_t i = 0; i < num_bits; ++i) {
-            // Set read[i] to the (offset + i)-th position in the bit array.
-            if (this->_bit_array.test(offset + i)) {
-                read |= (1ULL << i);
-            }
+    // copy_bits(source, source_offset, offset, num_bits)
+    //   Copies `num_bits` bits of `source` from `source_offset` on to
+    //   `offset`, overwriting whatever was stored there.
+    void copy_bits(
+        const BitArray& source, size_t source_offset, size_t offset,
+        size_t num_bits
+    ) {
+        for (size_t copied = 0; copied < num_bits; copied += 64) {
+            size_t count = std::min(num_bits - copied, size_t(64));
+            uint64_t value = source.read_bits(source_offset + copied, count);
+            write_bits(offset + copied, value, count);
         }
+    }
 
-        return read;
+    // read_bits(offset, num_bits)
+    //   Returns `num_bits` (at most 64) bits at `offset`. Always loads two
+    //   adjacent words and combines them with shifts, so there is no branch on
+    //   whether the field straddles a word boundary.
+    uint64_t read_bits(size_t offset, size_t num_bits) const {
+        size_t word = offset >> 6;
+        size_t shift = offset & 63;
+
+        uint64_t lo = this->_words[word] >> shift;
+        // Shifting in two steps keeps the shift count below 64 when shift == 0.
+        uint64_t hi = (this->_words[word + 1] << 1) << (63 - shift);
+
+        return low_bits(lo | hi, num_bits);
     }
 
     // read_bit(offset)
     //   Reads a single bit at a specified offset.
-    bool read_bit(size_t offset) {
-        return this->_bit_array.test(offset);
+    bool read_bit(size_t offset) const {
+        return (this->_words[offset >> 6] >> (offset & 63)) & 1;
+    }
+
+    // next_one(offset)
+    //   Returns the position of the first set bit at or after `offset`, or
+    //   size() if there is none. Runs of zeros are skipped a word at a time.
+    size_t next_one(size_t offset) const {
+        size_t word = offset >> 6;
+        size_t last = this->_words.size() - 1;   // index of the padding word
+        if (word >= last) {
+            return this->_size;
+        }
+
+        uint64_t bits = this->_words[word] & (~0ULL << (offset & 63));
+        while (bits == 0) {
+            if (++word >= last) {
+                return this->_size;
+            }
+            bits = this->_words[word];
+        }
+
+        // Bits past size() are always 0, so the result is in range.
+        return (word << 6) + __builtin_ctzll(bits);
+    }
+
+    // select_zero(offset, rank)
+    //   Returns the position of the `rank`-th (0-indexed) zero bit at or after
+    //   `offset`, or size() if there is none. Whole words are skipped by
+    //   counting their zeros, then the target bit is selected within a word.
+    size_t select_zero(size_t offset, size_t rank) const {
+        return _select<false>(offset, rank);
+    }
+
+    // select_one(offset, rank)
+    //   Returns the position of the `rank`-th (0-indexed) set bit at or after
+    //   `offset`, or size() if there is none.
+    size_t select_one(size_t offset, size_t rank) const {
+        return _select<true>(offset, rank);
+    }
+
+    // _select<Ones>(offset, rank)
+    //   Dispatches select_one() or select_zero() to the fastest kernel the
+    //   running CPU supports.
+    template <bool Ones>
+    size_t _select(size_t offset, size_t rank) const {
+#if defined(SNARF_HAS_BMI2_KERNELS)
+        if (cpu_has_bmi2()) {
+            return _select_bmi2<Ones>(offset, rank);
+        }
+#endif
+        return _select_with<GenericBitOps, Ones>(offset, rank);
+    }
+
+    // _select_with<Ops, Ones>(offset, rank)
+    //   Implementation of select_one() (or select_zero(), by selecting in the
+    //   complemented words) over the word primitives in `Ops`.
+    template <typename Ops, bool Ones>
+    __attribute__((always_inline))
+    size_t _select_with(size_t offset, size_t rank) const {
+        size_t word = offset >> 6;
+        size_t last = this->_words.size() - 1;   // index of the padding word
+        if (word >= last) {
+            return this->_size;
+        }
+
+        uint64_t bits = (Ones ? this->_words[word] : ~this->_words[word])
+            & (~0ULL << (offset & 63));
+        for (;;) {
+            size_t count = Ops::popcount(bits);
+            if (rank < count) {
+                size_t position = (word << 6) + Ops::select(bits, rank);
+                // Zeros past size() are padding, not part of the array.
+                return position < this->_size ? position : this->_size;
+            }
+            rank -= count;
+
+            if (++word >= last) {
+                return this->_size;
+            }
+            bits = Ones ? this->_words[word] : ~this->_words[word];
+        }
+    }
+
+#if defined(SNARF_HAS_BMI2_KERNELS)
+    // _select_bmi2<Ones>(offset, rank)
+    //   _select() compiled for BMI2, chosen at runtime when supported.
+    template <bool Ones>
+    __attribute__((target("bmi2,popcnt")))
+    size_t _select_bmi2(size_t offset, size_t rank) const {
+        return _select_with<BMI2BitOps, Ones>(offset, rank);
     }
+#endif
 
     // size_bytes()
     //   Returns the space used by the structure in bytes.
     size_t size_bytes() const {
         // Rounds up the number of bytes.
-        return (this->_bit_array.size() + 7) / 8;
+        return (this->_size + 7) / 8;
     }
 };
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SNARF_X86 1
+#endif
+
+
+// low_bits(value, num_bits)
+//   Returns the lowest `num_bits` bits of `value`, for 0 <= num_bits <= 64.
+//   Compiles to a single `bzhi` when the translation unit targets BMI2.
+inline uint64_t low_bits(uint64_t value, size_t num_bits) {
+#if defined(__BMI2__)
+    return _bzhi_u64(value, static_cast<unsigned>(num_bits));
+#else
+    return num_bits >= 64 ? value : value & ((1ULL << num_bits) - 1);
+#endif
+}
+
+
+
+// cpu_has_bmi2()
+//   Returns whether the running CPU supports BMI2 (and therefore `popcnt`).
+//   The check is performed once and cached, so it is cheap enough to dispatch
+//   between word-scanning kernels on every call.
+inline bool cpu_has_bmi2() {
+#if defined(SNARF_X86) && defined(__GNUC__)
+    static const bool has_bmi2 = __builtin_cpu_supports("bmi2")
+        && __builtin_cpu_supports("popcnt");
+    return has_bmi2;
+#else
+    return false;
+#endif
+}
+
+
+// GenericBitOps
+//   Portable word-level primitives used by the bit scanning kernels.
+struct GenericBitOps {
+    // popcount(word)
+    //   Returns the number of set bits in `word`.
+    static inline size_t popcount(uint64_t word) {
+        return __builtin_popcountll(word);
+    }
+
+    // select(word, rank)
+    //   Returns the position of the `rank`-th (0-indexed) set bit in `word`.
+    //   Requires rank < popcount(word). Narrows down to the right byte first
+    //   so that at most 8 bits are cleared one at a time.
+    static inline size_t select(uint64_t word, size_t rank) {
+        size_t shift = 0;
+        for (;;) {
+            size_t count = __builtin_popcountll(word & 0xFF);
+            if (rank < count) {
+                break;
+            }
+            rank -= count;
+            word >>= 8;
+            shift += 8;
+        }
+        for (; rank > 0; --rank) {
+            word &= word - 1;   // clear the lowest set bit
+        }
+        return shift + __builtin_ctzll(word);
+    }
+};
+
+
+#if defined(SNARF_X86) && defined(__GNUC__)
+#define SNARF_HAS_BMI2_KERNELS 1
+
+// BMI2BitOps
+//   The same primitives as `GenericBitOps`, using `popcnt` and `pdep`. Only
+//   called from kernels compiled for the BMI2 target.
+struct BMI2BitOps {
+    __attribute__((target("bmi2,popcnt")))
+    static inline size_t popcount(uint64_t word) {
+        return __builtin_popcountll(word);
+    }
+
+    // Deposits a single bit at the `rank`-th set bit of `word` and counts the
+    // trailing zeros to find its position.
+    __attribute__((target("bmi2,popcnt")))
+    static inline size_t select(uint64_t word, size_t rank) {
+        return __builtin_ctzll(_pdep_u64(1ULL << rank, word));
+    }
+};
+#endif
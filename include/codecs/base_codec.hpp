@@ -0,0 +1,156 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include "../bit_array.hpp"
+
+
+// BaseCodec
+//   A `BaseCodec` interface for the codecs that encode the sorted key locations
+//   of one SNARF block. Every codec splits a location relative to its block
+//   into `low_width` low bits, stored in a fixed-width array, and the remaining
+//   high bits, stored in unary: one '1' per key, with a '0' between each high
+//   value and the next. A codec provides
+//     block_bits(num_keys)                    encoded size of a block
+//     block_num_keys(bits, offset, end)       key count of the block in
+//                                             [offset, end)
+//     block_extent(bits, offset, num_keys)    bits a query of the block
+//                                             at `offset` reads
+//     encode(first, last, lower_bound, bits, offset)
+//     range_query(bits, offset, num_keys, lower, upper)
+//     location(bits, offset, num_keys, index)
+//     decode(bits, offset, num_keys, locations)
+//   and a `FILE_CODEC_ID` that identifies it in a SNARF file.
+struct BaseCodec {
+    // The number of low bits per key in a block holding its nominal number of
+    // keys, i.e. log2 of the SNARF scaling factor.
+    size_t _bitset_size;
+    // The number of key locations covered by one block.
+    size_t _block_range;
+
+    // BaseCodec()
+    //   Default constructor with zero arguments.
+    BaseCodec() : _bitset_size(0), _block_range(0) {}
+
+    // BaseCodec(bitset_size, block_range)
+    //   Constructs a codec for blocks covering `block_range` locations.
+    BaseCodec(size_t bitset_size, size_t block_range) :
+        _bitset_size(bitset_size), _block_range(block_range) {}
+
+    // _high_bits(num_keys, low_width)
+    //   Returns the size of the unary section: a '1' per key and a '0' for
+    //   every high value a location in the block can take.
+    size_t _high_bits(size_t num_keys, size_t low_width) const {
+        return num_keys + ((this->_block_range - 1) >> low_width) + 1;
+    }
+
+    // _encode_split(first, last, lower_bound, bits, offset, low_width)
+    //   Writes the low parts of the sorted locations in [first, last) at
+    //   `offset`, followed by their high parts in unary. Locations are made
+    //   relative to the block's `lower_bound`.
+    void _encode_split(
+        const size_t* first, const size_t* last, size_t lower_bound,
+        BitArray& bits, size_t offset, size_t low_width
+    ) const {
+        size_t num_keys = last - first;
+        size_t offset_high = offset + num_keys * low_width;
+
+        for (size_t i = 0; i < num_keys; ++i) {
+            size_t location = first[i] - lower_bound;
+
+            // Write the low bits of the key.
+            bits.write_bits(offset + i * low_width, location, low_width);
+
+            // The bits start zeroed, so the unary code only needs its
+            // terminating '1', preceded by one '0' per high value so far.
+            bits.write_bits(offset_high + (location >> low_width) + i, 1, 1);
+        }
+    }
+
+    // _range_query_split(bits, offset, num_keys, low_width, lower, upper)
+    //   Checks if the block of `num_keys` split locations at `offset` holds
+    //   any location within [lower, upper]. Instead of walking the unary
+    //   section bit by bit, it selects the first key whose high part can reach
+    //   `lower` and then jumps from one terminating '1' to the next. The
+    //   select scans the unary section a word at a time, so the cost is
+    //   O(block bits / 64) plus the number of candidate keys visited.
+    bool _range_query_split(
+        const BitArray& bits, size_t offset, size_t num_keys,
+        size_t low_width, size_t lower, size_t upper
+    ) const {
+        size_t offset_high = offset + num_keys * low_width;
+        size_t end = offset_high + _high_bits(num_keys, low_width);
+
+        // Keys with a smaller high part than this are all below the range.
+        size_t high = lower >> low_width;
+
+        // Skip their unary codes: the `high`-th '0' terminates the run.
+        size_t position = offset_high;
+        if (high > 0) {
+            position = bits.select_zero(offset_high, high - 1) + 1;
+            if (position > end) {
+                return false;   // every key has a smaller high part
+            }
+        }
+
+        // Every bit skipped so far is either a '0' or the '1' of a key.
+        size_t key_index = position - offset_high - high;
+
+        // Visit the remaining keys in sorted order.
+        for (; key_index < num_keys; ++key_index) {
+            size_t one = bits.next_one(position);
+            high += one - position;     // '0's skipped before this key
+
+            // Reconstruct the original location value.
+            size_t value = (high << low_width) | bits.read_bits(
+                offset + key_index * low_width, low_width
+            );
+
+            if (value > upper) {
+                return false;   // sorted, so no later key can match
+            }
+            if (value >= lower) {
+                return true;
+            }
+
+            position = one + 1;
+        }
+
+        return false;   // no key locations found within this range
+    }
+
+    // _decode_split(bits, offset, num_keys, low_width, locations)
+    //   Decodes every location of the block at `offset` into `locations`, in
+    //   sorted order, with one pass over the unary section.
+    void _decode_split(
+        const BitArray& bits, size_t offset, size_t num_keys,
+        size_t low_width, size_t* locations
+    ) const {
+        size_t offset_high = offset + num_keys * low_width;
+        size_t position = offset_high;
+        for (size_t i = 0; i < num_keys; ++i) {
+            size_t one = bits.next_one(position);
+            size_t high = one - offset_high - i;    // '0's before this key
+            locations[i] = (high << low_width)
+                | bits.read_bits(offset + i * low_width, low_width);
+            position = one + 1;
+        }
+    }
+
+    // _location_split(bits, offset, num_keys, low_width, index)
+    //   Returns the `index`-th location of the block at `offset`, found by
+    //   selecting its terminating '1' directly rather than decoding the keys
+    //   before it.
+    size_t _location_split(
+        const BitArray& bits, size_t offset, size_t num_keys,
+        size_t low_width, size_t index
+    ) const {
+        size_t offset_high = offset + num_keys * low_width;
+        size_t high = bits.select_one(offset_high, index) - offset_high - index;
+        return (high << low_width)
+            | bits.read_bits(offset + index * low_width, low_width);
+    }
+};
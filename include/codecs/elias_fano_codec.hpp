@@ -0,0 +1,130 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include "base_codec.hpp"
+
+// Size in bits of the low-width field at the start of every block.
+#define EF_WIDTH_BITS 6
+
+
+// EliasFanoCodec
+//   Elias-Fano coding of a block. The low width is chosen per block as
+//   floor(log2(block_range / num_keys)), which minimizes the encoded size for
+//   the number of keys the block actually holds, rather than fixed from the
+//   average density. Blocks that the model over- or under-fills therefore
+//   stay compact, and nearly empty blocks shrink to a few bits. The width is
+//   stored in a small field at the start of the block, from which the key
+//   count follows given the block length. No select samples are stored, so
+//   random access and successor queries select within the unary section a
+//   word at a time: O(block bits / 64), a few words at the usual block
+//   sizes, rather than constant time.
+struct EliasFanoCodec : BaseCodec {
+    // Identifies this codec in a SNARF file.
+    static const uint32_t FILE_CODEC_ID = 1;
+
+    // EliasFanoCodec()
+    //   Default constructor with zero arguments.
+    EliasFanoCodec() {}
+
+    // EliasFanoCodec(bitset_size, block_range)
+    //   Constructs a codec for blocks covering `block_range` locations.
+    EliasFanoCodec(size_t bitset_size, size_t block_range) :
+        BaseCodec(bitset_size, block_range) {}
+
+    // _low_width(num_keys)
+    //   Returns the number of low bits per key for a block of `num_keys` keys.
+    size_t _low_width(size_t num_keys) const {
+        size_t ratio = this->_block_range / (num_keys > 0 ? num_keys : 1);
+        return ratio > 0 ? 63 - __builtin_clzll(ratio) : 0;
+    }
+
+    // block_bits(num_keys)
+    //   Returns the encoded size in bits of a block holding `num_keys` keys:
+    //   the width field, a low part per key and the unary section.
+    size_t block_bits(size_t num_keys) const {
+        size_t low_width = _low_width(num_keys);
+        return EF_WIDTH_BITS + num_keys * low_width
+            + this->_high_bits(num_keys, low_width);
+    }
+
+    // block_num_keys(bits, offset, end)
+    //   Returns the number of keys stored in the block spanning bits
+    //   [offset, end), recovered from its width field and length.
+    size_t block_num_keys(
+        const BitArray& bits, size_t offset, size_t end
+    ) const {
+        size_t low_width = bits.read_bits(offset, EF_WIDTH_BITS);
+        return (end - offset - EF_WIDTH_BITS - this->_high_bits(0, low_width))
+            / (low_width + 1);
+    }
+
+    // block_extent(bits, offset, num_keys)
+    //   Returns the number of bits from `offset` on that a query of the block
+    //   of `num_keys` keys reads, given the low width stored in the block
+    //   rather than the one block_bits() expects.
+    size_t block_extent(
+        const BitArray& bits, size_t offset, size_t num_keys
+    ) const {
+        size_t low_width = bits.read_bits(offset, EF_WIDTH_BITS);
+        return EF_WIDTH_BITS + num_keys * low_width
+            + this->_high_bits(num_keys, low_width);
+    }
+
+    // encode(first, last, lower_bound, bits, offset)
+    //   Encodes the sorted key locations in [first, last) as an Elias-Fano
+    //   block that starts at bit `offset` of `bits`. Locations are made
+    //   relative to the block's `lower_bound`.
+    void encode(
+        const size_t* first, const size_t* last, size_t lower_bound,
+        BitArray& bits, size_t offset
+    ) const {
+        size_t low_width = _low_width(last - first);
+        bits.write_bits(offset, low_width, EF_WIDTH_BITS);
+        this->_encode_split(
+            first, last, lower_bound, bits, offset + EF_WIDTH_BITS, low_width
+        );
+    }
+
+    // range_query(bits, offset, num_keys, lower, upper)
+    //   Checks if the block of `num_keys` keys at `offset` holds any location
+    //   within [lower, upper], relative to the block.
+    bool range_query(
+        const BitArray& bits, size_t offset, size_t num_keys,
+        size_t lower, size_t upper
+    ) const {
+        return this->_range_query_split(
+            bits, offset + EF_WIDTH_BITS, num_keys,
+            bits.read_bits(offset, EF_WIDTH_BITS), lower, upper
+        );
+    }
+
+    // location(bits, offset, num_keys, index)
+    //   Returns the `index`-th location of the block at `offset`, relative to
+    //   the block, without decoding the keys before it. Selecting its '1'
+    //   scans the unary section from its start, O(block bits / 64).
+    size_t location(
+        const BitArray& bits, size_t offset, size_t num_keys, size_t index
+    ) const {
+        return this->_location_split(
+            bits, offset + EF_WIDTH_BITS, num_keys,
+            bits.read_bits(offset, EF_WIDTH_BITS), index
+        );
+    }
+
+    // decode(bits, offset, num_keys, locations)
+    //   Decodes every location of the block at `offset` into `locations`,
+    //   relative to the block and in sorted order.
+    void decode(
+        const BitArray& bits, size_t offset, size_t num_keys,
+        size_t* locations
+    ) const {
+        this->_decode_split(
+            bits, offset + EF_WIDTH_BITS, num_keys,
+            bits.read_bits(offset, EF_WIDTH_BITS), locations
+        );
+    }
+};
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include "base_codec.hpp"
+
+
+// GolombCodec
+//   Golomb-Rice coding of a block, as in the original SNARF: every key has a
+//   `_bitset_size`-bit remainder and a unary quotient. The width is fixed, so
+//   a block's key count follows from its length alone.
+struct GolombCodec : BaseCodec {
+    // Identifies this codec in a SNARF file.
+    static const uint32_t FILE_CODEC_ID = 0;
+
+    // GolombCodec()
+    //   Default constructor with zero arguments.
+    GolombCodec() {}
+
+    // GolombCodec(bitset_size, block_range)
+    //   Constructs a codec for blocks covering `block_range` locations.
+    GolombCodec(size_t bitset_size, size_t block_range) :
+        BaseCodec(bitset_size, block_range) {}
+
+    // block_bits(num_keys)
+    //   Returns the encoded size in bits of a block holding `num_keys` keys: a
+    //   `_bitset_size`-bit remainder and a terminating '1' per key, plus room
+    //   for the '0's of the largest possible quotient.
+    size_t block_bits(size_t num_keys) const {
+        return num_keys * this->_bitset_size
+            + this->_high_bits(num_keys, this->_bitset_size);
+    }
+
+    // block_num_keys(bits, offset, end)
+    //   Returns the number of keys stored in the block spanning bits
+    //   [offset, end), recovered from the block length.
+    size_t block_num_keys(const BitArray&, size_t offset, size_t end) const {
+        return (end - offset - this->_high_bits(0, this->_bitset_size))
+            / (this->_bitset_size + 1);
+    }
+
+    // block_extent(bits, offset, num_keys)
+    //   Returns the number of bits from `offset` on that a query of the block
+    //   of `num_keys` keys reads, which is its encoded size.
+    size_t block_extent(const BitArray&, size_t, size_t num_keys) const {
+        return block_bits(num_keys);
+    }
+
+    // encode(first, last, lower_bound, bits, offset)
+    //   Encodes the sorted key locations in [first, last) as a GCS block that
+    //   starts at bit `offset` of `bits`. Locations are made relative to the
+    //   block's `lower_bound`.
+    void encode(
+        const size_t* first, const size_t* last, size_t lower_bound,
+        BitArray& bits, size_t offset
+    ) const {
+        this->_encode_split(
+            first, last, lower_bound, bits, offset, this->_bitset_size
+        );
+    }
+
+    // range_query(bits, offset, num_keys, lower, upper)
+    //   Checks if the block of `num_keys` keys at `offset` holds any location
+    //   within [lower, upper], relative to the block.
+    bool range_query(
+        const BitArray& bits, size_t offset, size_t num_keys,
+        size_t lower, size_t upper
+    ) const {
+        return this->_range_query_split(
+            bits, offset, num_keys, this->_bitset_size, lower, upper
+        );
+    }
+
+    // location(bits, offset, num_keys, index)
+    //   Returns the `index`-th location of the block at `offset`, relative to
+    //   the block.
+    size_t location(
+        const BitArray& bits, size_t offset, size_t num_keys, size_t index
+    ) const {
+        return this->_location_split(
+            bits, offset, num_keys, this->_bitset_size, index
+        );
+    }
+
+    // decode(bits, offset, num_keys, locations)
+    //   Decodes every location of the block at `offset` into `locations`,
+    //   relative to the block and in sorted order.
+    void decode(
+        const BitArray& bits, size_t offset, size_t num_keys,
+        size_t* locations
+    ) const {
+        this->_decode_split(
+            bits, offset, num_keys, this->_bitset_size, locations
+        );
+    }
+};
@@ -5,15 +5,45 @@
 
 #pragma once
 
+// Number of keys the models' predict_batch() searches and evaluates together.
+#define PREDICT_GROUP_SIZE 16
+
 #include <vector>
 #include <utility>
 #include <cmath>
+#include <algorithm>
 #include <stdexcept>
+#include <type_traits>
+
+#include "../storage.hpp"
+
+
+// ErrorBound
+//   Selects error-bounded fitting when passed to a model constructor in place
+//   of `R`. The model then keeps only as many keys as it needs for every
+//   input key's predicted CDF to be within `max_error` of its eCDF (the
+//   fraction of input keys less than or equal to it).
+struct ErrorBound {
+    double max_error;
+
+    explicit ErrorBound(double max_error) : max_error(max_error) {}
+};
 
 
 // BaseModel
 //   A `BaseModel` interface for a learned model that can be used to
-//   predict the CDF of a key, given a training data set to learn from.
+//   predict the CDF of a key, given a training data set to learn from. The
+//   interface is static: `SNARF` takes the model as a template parameter and
+//   calls it directly, so predictions are inlined into the query path rather
+//   than dispatched through a vtable. A model provides
+//     predict(key)        estimated CDF of `key`, within [0, 1] and
+//                         non-decreasing in `key`; only keys appended to
+//                         a `LinearSplineModel` go past 1
+//     predict_batch(keys, n, out)
+//                         predict() for `n` keys into `out`
+//     size_bytes()        size of the model in bytes
+//     print_model()       prints the model for debugging
+//   plus _save(writer), _map(reader) and a `FILE_MODEL_ID` for SNARF files.
 template <typename Key>
 struct BaseModel {
     // Data representation as <key, eCDF> pair.
@@ -23,12 +53,16 @@ struct BaseModel {
 
     // Array of <key, eCDF> pairs from the input data set chosen to construct
     // CDF model.
-    KeyCDFPairList _key_array;
+    Storage<KeyCDFPair> _key_array;
+
+    // BaseModel()
+    //   Constructs an empty model, to be filled in from a SNARF file.
+    BaseModel() {}
 
     // BaseModel(input_keys, R)
     //   Constructs the eCDF model given the entire set of input keys. Includes
     //   building the array of chosen keys and specified model. Assumes the
-    //   input keys are in sorted order.
+    //   input keys are in sorted order; see sort_keys().
     BaseModel(const std::vector<Key>& input_keys, size_t R) {
         if (R > input_keys.size()) {
             throw std::runtime_error(
@@ -36,69 +70,132 @@ struct BaseModel {
             );
         }
 
-        // A list of <key, eCDF> pairs of the input data set.
-        KeyCDFPairList training_data;
-        _compute_ecdf(input_keys, training_data);
-
-        // Sample the training data using the input parameter R.
-        _build_key_array(training_data, R);
+        // Sample the input keys using the input parameter R.
+        _sample_key_array(input_keys, R);
 
         // constructing the model is handled by child class
     }
 
-    // _compute_ecdf(input_keys, training_data)
-    //   Computes the eCDF of every input key in the training data. Assumes the
-    //   input keys are given in sorted order.
-    void _compute_ecdf(
-        const std::vector<Key>& input_keys, KeyCDFPairList& training_data
-    ) {
-        size_t input_keys_size = input_keys.size();
-        training_data.resize(input_keys_size);
-
-        // construct the eCDF list of keys
-        for (size_t i = 0; i < input_keys_size; ++i) {
-            // eCDF is equi-distant for each key
-            training_data[i] = std::make_pair(
-                input_keys[i], (i + 1) * 1.0 / input_keys_size
-            );
+    // BaseModel(input_keys, bound)
+    //   Constructs the eCDF model given the entire set of input keys, choosing
+    //   the key array to meet an error bound rather than sampling every R-th
+    //   key. Assumes the input keys are in sorted order; see sort_keys().
+    BaseModel(const std::vector<Key>& input_keys, ErrorBound bound) {
+        if (input_keys.empty()) {
+            throw std::runtime_error("ERROR: Requires at least one key.");
+        }
+        if (!(bound.max_error > 0.0)) {
+            throw std::runtime_error("ERROR: Error bound must be positive.");
         }
+
+        _build_error_bounded_key_array(input_keys, bound.max_error);
+
+        // constructing the model is handled by child class
     }
 
-    // _build_key_array(training_data, R)
-    //   Constructs the key array based on the input key array and interval
-    //   R to  select keys.
-    void _build_key_array(const KeyCDFPairList& training_data, size_t R) {
-        size_t training_data_size = training_data.size();
-        size_t key_array_size = ceil(training_data_size * 1.0 / R);
+    // _sample_key_array(input_keys, R)
+    //   Constructs the key array from every R-th input key, paired with its
+    //   eCDF, (index + 1) / num_keys. The final key is always included.
+    void _sample_key_array(const std::vector<Key>& input_keys, size_t R) {
+        size_t num_keys = input_keys.size();
+        size_t key_array_size = ceil(num_keys * 1.0 / R);
 
-        // we use N/R models, so every R-th key is sampled
         this->_key_array.resize(key_array_size);
         for (size_t i = 0; i < key_array_size; ++i) {
-            KeyCDFPair pair = training_data[
-                int(((i + 1) * training_data_size * 1.0) / key_array_size) - 1
-            ];
+            size_t index = i + 1 < key_array_size
+                ? size_t(((i + 1) * num_keys * 1.0) / key_array_size) - 1
+                : num_keys - 1;
             this->_key_array[i] = std::make_pair(
-                std::move(pair.first), std::move(pair.second)
+                input_keys[index], (index + 1) * 1.0 / num_keys
             );
         }
+    }
 
-        // add the final key to the chosen key array
-        this->_key_array[key_array_size - 1] = training_data[
-            training_data_size - 1
-        ];
+    // _key_distance(from, to)
+    //   Returns how far key `to` lies above key `from`, or 0 if it does not.
+    //   Integer keys are subtracted in their own type before converting, so
+    //   the distance is exact below 2^53 wherever the keys lie in the
+    //   keyspace. Converting each key to a double first would round away all
+    //   but the top 53 bits of large keys, such as nanosecond timestamps.
+    static double _key_distance(Key from, Key to) {
+        return to > from
+            ? _key_difference(from, to, std::is_integral<Key>()) : 0.0;
+    }
+
+    // _key_difference(from, to, is_integral)
+    //   Helpers for _key_distance(): `to - from` for `to` above `from`,
+    //   computed in unsigned arithmetic for integer keys so it cannot
+    //   overflow.
+    static double _key_difference(Key from, Key to, std::true_type) {
+        typedef typename std::make_unsigned<Key>::type UnsignedKey;
+        return double(UnsignedKey(UnsignedKey(to) - UnsignedKey(from)));
     }
 
-    // predict(key)
-    //   Given an input key, returns the CDF of the key, based on the specified
-    //   model.
-    virtual double predict(Key key) = 0;
+    static double _key_difference(Key from, Key to, std::false_type) {
+        return double(to - from);
+    }
+
+    // _build_error_bounded_key_array(input_keys, max_error)
+    //   Chooses the key array in one pass with a greedy spline corridor, so
+    //   that interpolating linearly between consecutive entries predicts every
+    //   input key's eCDF within `max_error`. Starting from the last entry, it
+    //   keeps the range of slopes that stays within the error of every key
+    //   seen since. When a key can no longer be reached with a slope in that
+    //   range, the key before it becomes the next entry. Flat regions of the
+    //   distribution thus need few entries and skewed ones get as many as
+    //   they need. Only the last copy of a repeated key is considered, since
+    //   it carries the key's eCDF.
+    void _build_error_bounded_key_array(
+        const std::vector<Key>& input_keys, double max_error
+    ) {
+        size_t num_keys = input_keys.size();
+        KeyCDFPairList knots;
+        KeyCDFPair base;        // the last entry chosen
+        KeyCDFPair previous;    // the last key seen
+        double upper = INFINITY;
+        double lower = -INFINITY;
+
+        for (size_t i = 0; i < num_keys; ++i) {
+            if (i + 1 < num_keys && input_keys[i + 1] == input_keys[i]) {
+                continue;
+            }
+            KeyCDFPair point(input_keys[i], (i + 1) * 1.0 / num_keys);
+            if (knots.empty()) {
+                knots.push_back(point);
+                base = previous = point;
+                continue;
+            }
+
+            double dx = _key_distance(base.first, point.first);
+            double slope = (point.second - base.second) / dx;
+            if (slope > upper || slope < lower) {
+                // Out of reach from the last entry: start a new segment at
+                // the key before this one.
+                knots.push_back(previous);
+                base = previous;
+                dx = _key_distance(base.first, point.first);
+                upper = INFINITY;
+                lower = -INFINITY;
+            }
+
+            // Narrow the corridor to stay within the error at this key.
+            upper = std::min(
+                upper, (point.second + max_error - base.second) / dx
+            );
+            lower = std::max(
+                lower, (point.second - max_error - base.second) / dx
+            );
+            previous = point;
+        }
 
-    // size()
-    //   Returns the size of the model in bytes.
-    virtual size_t size_bytes() = 0;
+        // add the final key to the chosen key array
+        if (knots.back().first != previous.first) {
+            knots.push_back(previous);
+        }
 
-    // print_model()
-    //   Prints the model to console in human-readable format. Used mainly for
-    //   debugging purposes.
-    virtual void print_model() = 0;
+        this->_key_array.resize(knots.size());
+        for (size_t i = 0; i < knots.size(); ++i) {
+            this->_key_array[i] = knots[i];
+        }
+    }
 };
@@ -6,8 +6,33 @@
 #pragma once
 
 #define SEARCH_LIMIT 10
+// Default number of bits of the radix table index.
+#define RADIX_TABLE_BITS 16
+// Largest supported number of bits of the radix table index.
+#define RADIX_TABLE_MAX_BITS 30
+
+#include <cstdint>
+#include <algorithm>
 
 #include "base_model.hpp"
+#include "../snarf_file.hpp"
+
+
+// SearchLayout
+//   How the spline searches its key array. The sorted layout binary searches
+//   the <key, eCDF> pairs directly. The Eytzinger layout keeps a keys-only
+//   copy in breadth-first (Eytzinger) order, so the first levels of every
+//   search share a few hot cache lines and each step can prefetch the lines
+//   of the steps after it, at the cost of `sizeof(Key) + 4` bytes per key.
+//   The radix layout (as in RadixSpline) splits the key range into 2^k equal
+//   slots and keeps a table of the first key array entry in each slot, so a
+//   search is one table lookup and a binary search of that slot's entries,
+//   at the cost of 4 bytes per slot.
+enum SearchLayout {
+    SEARCH_LAYOUT_SORTED = 0,
+    SEARCH_LAYOUT_EYTZINGER = 1,
+    SEARCH_LAYOUT_RADIX = 2
+};
 
 
 // BaseSplineModel
@@ -15,6 +40,22 @@
 //   generate and search the selected key array from training data.
 template <typename Key>
 struct BaseSplineModel : BaseModel<Key> {
+    // The key array's keys in Eytzinger order, 1-indexed, with an unused first
+    // element. Empty with the sorted layout.
+    Storage<Key, CacheAlignedAllocator<Key> > _eytzinger_keys;
+    // The index in the key array of every key in `_eytzinger_keys`.
+    Storage<uint32_t> _eytzinger_ranks;
+    // The index of the first key array entry in each radix slot and beyond,
+    // plus a final entry. Empty unless the radix layout is used.
+    Storage<uint32_t> _radix_table;
+    // The smallest key and the number of slots per unit of key, which map a
+    // key to its radix slot.
+    Storage<double> _radix_scale;
+
+    // BaseSplineModel()
+    //   Constructs an empty model, to be filled in from a SNARF file.
+    BaseSplineModel() {}
+
     // BaseSplineModel(input_keys, R)
     //   Constructs the key array based on the input key array and interval
     //   R to  select keys. Assumes the training data is given in sorted order
@@ -25,13 +66,310 @@ struct BaseSplineModel : BaseModel<Key> {
         // array of models is handled by child class
     }
 
+    // BaseSplineModel(input_keys, bound)
+    //   Constructs the key array to meet an error bound; see `ErrorBound`.
+    BaseSplineModel(
+        const std::vector<Key>& input_keys, ErrorBound bound
+    ) : BaseModel<Key>(input_keys, bound) {
+        // array of models is handled by child class
+    }
+
+    // set_search_layout(layout, radix_bits)
+    //   Switches how binary_search() searches the key array, building the
+    //   structure it needs and releasing any other. `radix_bits` sets the
+    //   number of slots (2^radix_bits) of the radix layout.
+    void set_search_layout(
+        SearchLayout layout, size_t radix_bits = RADIX_TABLE_BITS
+    ) {
+        this->_eytzinger_keys.resize(0);
+        this->_eytzinger_ranks.resize(0);
+        this->_radix_table.resize(0);
+        this->_radix_scale.resize(0);
+        if (layout == SEARCH_LAYOUT_SORTED) {
+            return;
+        }
+
+        size_t size = this->_key_array.size();
+        if (size > UINT32_MAX) {
+            throw std::runtime_error("ERROR: Key array too large to index.");
+        }
+        if (layout == SEARCH_LAYOUT_RADIX) {
+            _build_radix_table(radix_bits);
+            return;
+        }
+        this->_eytzinger_keys.resize(size + 1);
+        this->_eytzinger_ranks.resize(size + 1);
+        _fill_eytzinger(0, 1);
+    }
+
+    // _build_radix_table(radix_bits)
+    //   Splits [first key, last key] into 2^radix_bits equal slots and records
+    //   where each slot starts in the key array.
+    void _build_radix_table(size_t radix_bits) {
+        if (radix_bits == 0 || radix_bits > RADIX_TABLE_MAX_BITS) {
+            throw std::runtime_error("ERROR: Invalid number of radix bits.");
+        }
+
+        size_t size = this->_key_array.size();
+        size_t slots = size_t(1) << radix_bits;
+        double min = double(this->_key_array[0].first);
+        double range = double(this->_key_array[size - 1].first) - min;
+        this->_radix_scale.resize(2);
+        this->_radix_scale[0] = min;
+        this->_radix_scale[1] = range > 0.0 ? slots / range : 0.0;
+
+        // Slot `slot` starts at the first entry that maps to it or later.
+        this->_radix_table.resize(slots + 1);
+        size_t index = 0;
+        for (size_t slot = 0; slot <= slots; ++slot) {
+            while (
+                index < size && _radix_slot(this->_key_array[index].first) < slot
+            ) {
+                ++index;
+            }
+            this->_radix_table[slot] = static_cast<uint32_t>(index);
+        }
+    }
+
+    // _radix_slot(key)
+    //   Returns the radix slot of `key`. Keys outside the key array's range
+    //   fall in the first or last slot.
+    size_t _radix_slot(Key key) const {
+        double position = (double(key) - this->_radix_scale[0])
+            * this->_radix_scale[1];
+        size_t last = this->_radix_table.size() - 2;
+        return position <= 0.0 ? 0
+            : (position >= double(last) ? last : size_t(position));
+    }
+
+    // _fill_eytzinger(index, node)
+    //   Places the key array, from `index` on, into the subtree rooted at
+    //   `node` with an in-order traversal. Returns the next unplaced index.
+    size_t _fill_eytzinger(size_t index, size_t node) {
+        if (node < this->_eytzinger_keys.size()) {
+            index = _fill_eytzinger(index, 2 * node);
+            this->_eytzinger_keys[node] = this->_key_array[index].first;
+            this->_eytzinger_ranks[node] = static_cast<uint32_t>(index);
+            index = _fill_eytzinger(index + 1, 2 * node + 1);
+        }
+        return index;
+    }
+
     // binary_search(key)
-    //   Iterative binary search used to determine which spline model they input
-    //   key is located at.
-    size_t binary_search(Key key) {
-        size_t left = 0;
-        size_t right = this->_key_array.size() - 1;
+    //   Returns the index of the spline model the input key is located at: the
+    //   first key array entry greater than or equal to `key`, or the last one.
+    size_t binary_search(Key key) const {
+        if (!this->_eytzinger_keys.empty()) {
+            return _eytzinger_search(key);
+        }
+        if (!this->_radix_table.empty()) {
+            return _radix_search(key);
+        }
+        return _sorted_search(key, 0, this->_key_array.size() - 1);
+    }
+
+    // binary_search_batch(keys, n, indexes)
+    //   binary_search() for `n` keys at once. The searches of every group of
+    //   `PREDICT_GROUP_SIZE` keys advance in lockstep and prefetch their next
+    //   probes, so their cache misses overlap instead of following each other.
+    //   A sorted group that spans few segments, as when a filter is built,
+    //   is instead merged with the key array (see _merge_search_group()).
+    void binary_search_batch(
+        const Key* keys, size_t n, size_t* indexes
+    ) const {
+        size_t last = this->_key_array.size() - 1;
+        size_t lefts[PREDICT_GROUP_SIZE];
+        size_t rights[PREDICT_GROUP_SIZE];
+        for (size_t first = 0; first < n; first += PREDICT_GROUP_SIZE) {
+            size_t count = std::min(n - first, size_t(PREDICT_GROUP_SIZE));
+            if (_merge_search_group(keys + first, count, indexes + first)) {
+                continue;
+            }
+            if (!this->_eytzinger_keys.empty()) {
+                _eytzinger_search_group(keys + first, count, indexes + first);
+                continue;
+            }
 
+            // Narrow each search to its radix slot first, as _radix_search()
+            // does, or search the whole array.
+            for (size_t i = 0; i < count; ++i) {
+                lefts[i] = 0;
+                rights[i] = last;
+                if (!this->_radix_table.empty()) {
+                    size_t slot = _radix_slot(keys[first + i]);
+                    lefts[i] = std::min(size_t(this->_radix_table[slot]), last);
+                    rights[i] = std::min(
+                        size_t(this->_radix_table[slot + 1]), last
+                    );
+                }
+            }
+            _sorted_search_group(
+                keys + first, count, lefts, rights, indexes + first
+            );
+        }
+    }
+
+    // _predict_batch(keys, n, out, evaluate)
+    //   Helper for the spline models' predict_batch(): searches the keys in
+    //   groups with binary_search_batch() and stores `evaluate(index, key)`
+    //   for each, where `index` is the key's segment.
+    template <typename Evaluate>
+    void _predict_batch(
+        const Key* keys, size_t n, double* out, Evaluate evaluate
+    ) const {
+        size_t indexes[PREDICT_GROUP_SIZE];
+        for (size_t first = 0; first < n; first += PREDICT_GROUP_SIZE) {
+            size_t count = std::min(n - first, size_t(PREDICT_GROUP_SIZE));
+            binary_search_batch(keys + first, count, indexes);
+            for (size_t i = 0; i < count; ++i) {
+                out[first + i] = evaluate(indexes[i], keys[first + i]);
+            }
+        }
+    }
+
+    // _merge_search_group(keys, count, indexes)
+    //   Searches a group of sorted keys by finding the segments of the first
+    //   and last, then walking the key array between them. Returns false,
+    //   without searching, if the keys are not sorted or span more than
+    //   twice as many segments as there are keys.
+    bool _merge_search_group(
+        const Key* keys, size_t count, size_t* indexes
+    ) const {
+        for (size_t i = 1; i < count; ++i) {
+            if (keys[i] < keys[i - 1]) {
+                return false;
+            }
+        }
+        size_t index = binary_search(keys[0]);
+        size_t end = binary_search(keys[count - 1]);
+        if (end - index > 2 * count) {
+            return false;
+        }
+
+        // Each key's segment is at or after the previous key's, and at or
+        // before the last key's.
+        for (size_t i = 0; i < count; ++i) {
+            while (index < end && this->_key_array[index].first < keys[i]) {
+                ++index;
+            }
+            indexes[i] = index;
+        }
+        return true;
+    }
+
+    // _sorted_search_group(keys, count, lefts, rights, indexes)
+    //   Branch-free binary searches of entries [lefts[i], rights[i]] of the
+    //   sorted key array for up to `PREDICT_GROUP_SIZE` keys, with the result
+    //   of _sorted_search(). Every step halves all the ranges, after
+    //   prefetching both entries the next step may probe.
+    void _sorted_search_group(
+        const Key* keys, size_t count, const size_t* lefts,
+        const size_t* rights, size_t* indexes
+    ) const {
+        const typename BaseModel<Key>::KeyCDFPair* entries =
+            this->_key_array.data();
+        size_t size = this->_key_array.size();
+
+        // Each base is the last entry in its range known to be smaller than
+        // its key, or the start of the range.
+        size_t bases[PREDICT_GROUP_SIZE];
+        size_t lengths[PREDICT_GROUP_SIZE];
+        size_t longest = 1;
+        for (size_t i = 0; i < count; ++i) {
+            bases[i] = lefts[i];
+            lengths[i] = rights[i] - lefts[i] + 1;
+            longest = std::max(longest, lengths[i]);
+        }
+        for (; longest > 1; longest -= longest >> 1) {
+            for (size_t i = 0; i < count; ++i) {
+                size_t half = lengths[i] >> 1;
+                size_t next = (lengths[i] - half) >> 1;
+                __builtin_prefetch(entries + bases[i] + next);
+                __builtin_prefetch(entries + bases[i] + half + next);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                size_t half = lengths[i] >> 1;
+                bases[i] += entries[bases[i] + half].first < keys[i] ? half : 0;
+                lengths[i] -= half;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            size_t index = bases[i] + (entries[bases[i]].first < keys[i]);
+            indexes[i] = index < size ? index : size - 1;
+        }
+    }
+
+    // _eytzinger_search_group(keys, count, indexes)
+    //   _eytzinger_search() for up to `PREDICT_GROUP_SIZE` keys, descending
+    //   the tree one level at a time for all of them.
+    void _eytzinger_search_group(
+        const Key* keys, size_t count, size_t* indexes
+    ) const {
+        const Key* tree = this->_eytzinger_keys.data();
+        size_t size = this->_eytzinger_keys.size();
+        const size_t stride = CACHE_LINE_SIZE / sizeof(Key) > 0
+            ? CACHE_LINE_SIZE / sizeof(Key) : 1;
+
+        size_t nodes[PREDICT_GROUP_SIZE];
+        std::fill(nodes, nodes + count, size_t(1));
+        for (size_t level = 1; level < size; level *= 2) {
+            for (size_t i = 0; i < count; ++i) {
+                if (nodes[i] < size) {
+                    __builtin_prefetch(tree + nodes[i] * stride);
+                    nodes[i] = 2 * nodes[i] + (tree[nodes[i]] < keys[i]);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            size_t node = nodes[i] >> __builtin_ffsll(~nodes[i]);
+            indexes[i] = node == 0 ? this->_key_array.size() - 1
+                : this->_eytzinger_ranks[node];
+        }
+    }
+
+    // _radix_search(key)
+    //   Finds the key's slot in the radix table and searches only the entries
+    //   from the start of that slot to the start of the next, the first of
+    //   which is already past `key`.
+    size_t _radix_search(Key key) const {
+        size_t slot = _radix_slot(key);
+        size_t last = this->_key_array.size() - 1;
+        size_t left = this->_radix_table[slot];
+        size_t right = this->_radix_table[slot + 1];
+        if (left > last) {
+            return last;    // every entry is smaller than `key`
+        }
+        return _sorted_search(key, left, right < last ? right : last);
+    }
+
+    // _eytzinger_search(key)
+    //   Branch-free descent of the Eytzinger tree. Each step prefetches the
+    //   cache line holding the node's descendants a few levels down.
+    size_t _eytzinger_search(Key key) const {
+        const Key* keys = this->_eytzinger_keys.data();
+        size_t size = this->_eytzinger_keys.size();
+        const size_t stride = CACHE_LINE_SIZE / sizeof(Key) > 0
+            ? CACHE_LINE_SIZE / sizeof(Key) : 1;
+
+        size_t node = 1;
+        while (node < size) {
+            __builtin_prefetch(keys + node * stride);
+            node = 2 * node + (keys[node] < key);
+        }
+
+        // Undo the right turns taken after the last left turn, which lands on
+        // the last node that was not smaller than `key`.
+        node >>= __builtin_ffsll(~node);
+        return node == 0 ? this->_key_array.size() - 1
+            : this->_eytzinger_ranks[node];
+    }
+
+    // _sorted_search(key, left, right)
+    //   Iterative binary search over entries [left, right] of the sorted key
+    //   array, finishing with a linear scan.
+    size_t _sorted_search(Key key, size_t left, size_t right) const {
         // binary search until <= 10 elements remain
         while ((right - left) > SEARCH_LIMIT) {
             size_t mid = left + ((right - left) >> 1);
@@ -54,4 +392,69 @@ struct BaseSplineModel : BaseModel<Key> {
         // the input key is greater than the last key in the array
         return this->_key_array.size() - 1;
     }
+
+    // _segment_start(index)
+    //   Returns the <key, eCDF> point the spline segment ending at key array
+    //   entry `index` starts from: the previous entry, or for the first
+    //   segment the origin (or the first key, if it is not positive).
+    typename BaseModel<Key>::KeyCDFPair _segment_start(size_t index) const {
+        if (index == 0) {
+            return std::make_pair(
+                std::min(Key(0), this->_key_array[0].first), 0.0
+            );
+        }
+        return this->_key_array[index - 1];
+    }
+
+    // _search_size_bytes()
+    //   Returns the size of the search layout's structures in bytes.
+    size_t _search_size_bytes() const {
+        return sizeof(Key) * this->_eytzinger_keys.size()
+            + sizeof(uint32_t) * this->_eytzinger_ranks.size()
+            + sizeof(uint32_t) * this->_radix_table.size()
+            + sizeof(double) * this->_radix_scale.size();
+    }
+
+    // _save_search(writer)
+    //   Adds the search layout's structures (empty if unused) to a SNARF file.
+    void _save_search(SNARFFileWriter& writer) const {
+        writer.add_section(this->_eytzinger_keys);
+        writer.add_section(this->_eytzinger_ranks);
+        writer.add_section(this->_radix_table);
+        writer.add_section(this->_radix_scale);
+    }
+
+    // _map_search(reader)
+    //   Points the search layout's structures at a mapped SNARF file.
+    void _map_search(SNARFFileReader& reader) {
+        reader.next_section(this->_eytzinger_keys);
+        reader.next_section(this->_eytzinger_ranks);
+        reader.next_section(this->_radix_table);
+        reader.next_section(this->_radix_scale);
+        if (!_valid_search()) {
+            throw std::runtime_error("ERROR: SNARF file model is invalid.");
+        }
+    }
+
+    // _valid_search()
+    //   Checks that the search layout's structures index only the key array.
+    bool _valid_search() const {
+        size_t size = this->_eytzinger_keys.size();
+        bool valid = this->_eytzinger_ranks.size() == size
+            && (size == 0 || size == this->_key_array.size() + 1);
+        for (size_t i = 1; valid && i < size; ++i) {
+            valid = this->_eytzinger_ranks[i] < this->_key_array.size();
+        }
+
+        // The radix table must never point backwards or past the key array.
+        size_t slots = this->_radix_table.size();
+        valid = valid && (slots == 0 || (
+            slots >= 3 && this->_radix_scale.size() == 2 && size == 0
+        ));
+        for (size_t i = 1; valid && i < slots; ++i) {
+            valid = this->_radix_table[i - 1] <= this->_radix_table[i]
+                && this->_radix_table[i] <= this->_key_array.size();
+        }
+        return valid;
+    }
 };
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+// Number of spline segments encoded together in one frame.
+#define SPLINE_FRAME_SIZE 32
+
+#include <iostream>
+#include <type_traits>
+
+#include "base_model.hpp"
+#include "../bit_array.hpp"
+#include "../snarf_file.hpp"
+
+
+// CompactSplineModel
+//   The linear spline in compressed form, for integer keys. The knots of the
+//   spline are grouped in frames of `SPLINE_FRAME_SIZE`. Every frame stores its
+//   first key in full, then the offset of each knot's key from it and of each
+//   knot's rank (its eCDF times the number of keys, an integer) from the
+//   first rank, packed at the smallest fixed widths that fit the frame.
+//   Segments are searched and evaluated in this form: a binary search over
+//   the frames' first keys, then over the frame's packed keys.
+//
+//   Knots cost a few bytes instead of the 32 bytes per segment of
+//   `LinearSplineModel` with 64-bit keys, so a smaller R fits in the same
+//   memory. Nothing is rounded: the ranks are exact, and a prediction
+//   interpolates between the two knots around the key from the key's integer
+//   offset to the first. It is therefore monotone and matches the linear
+//   spline, so SNARF needs no wider query ranges to avoid false negatives.
+template <typename Key>
+struct CompactSplineModel : BaseModel<Key> {
+    static_assert(
+        std::is_integral<Key>::value,
+        "CompactSplineModel requires integer keys."
+    );
+
+    // Keys converted to unsigned, so the offset between two keys never
+    // overflows.
+    typedef typename std::make_unsigned<Key>::type UnsignedKey;
+
+    // SplineFrame
+    //   Where a frame's packed offsets start in `_deltas`, and their widths.
+    struct SplineFrame {
+        uint64_t offset;
+        uint64_t first_rank;
+        uint32_t key_width;
+        uint32_t rank_width;
+    };
+
+    // The number of knots and the number of input keys.
+    Storage<uint64_t> _sizes;
+    // The first key of every frame.
+    Storage<Key> _frame_keys;
+    // The packing of every frame.
+    Storage<SplineFrame> _frames;
+    // The packed key offsets of every frame, followed by its rank offsets.
+    BitArray _deltas;
+
+    // Identifies this model in a SNARF file.
+    static const uint32_t FILE_MODEL_ID = 8;
+
+    // CompactSplineModel()
+    //   Constructs an empty model, to be filled in from a SNARF file.
+    CompactSplineModel() {}
+
+    // CompactSplineModel(input_keys, R)
+    //   Samples every R-th key like `LinearSplineModel` and packs the knots.
+    CompactSplineModel(
+        const std::vector<Key>& input_keys, size_t R
+    ) : BaseModel<Key>(input_keys, R) {
+        _pack(input_keys.size());
+    }
+
+    // CompactSplineModel(input_keys, bound)
+    //   Chooses the knots to meet an error bound (see `ErrorBound`) and packs
+    //   them.
+    CompactSplineModel(
+        const std::vector<Key>& input_keys, ErrorBound bound
+    ) : BaseModel<Key>(input_keys, bound) {
+        _pack(input_keys.size());
+    }
+
+    // _bit_width(value)
+    //   Returns the number of bits needed to store `value`.
+    static size_t _bit_width(uint64_t value) {
+        return value == 0 ? 0 : 64 - __builtin_clzll(value);
+    }
+
+    // _pack(num_keys)
+    //   Packs the key array into frames and releases it.
+    void _pack(size_t num_keys) {
+        size_t size = this->_key_array.size();
+        size_t num_frames = (size + SPLINE_FRAME_SIZE - 1) / SPLINE_FRAME_SIZE;
+        this->_sizes.resize(2);
+        this->_sizes[0] = size;
+        this->_sizes[1] = num_keys;
+        this->_frame_keys.resize(num_frames);
+        this->_frames.resize(num_frames);
+
+        // Size the frames first, so the deltas are written in one pass.
+        std::vector<uint64_t> ranks(size);
+        for (size_t i = 0; i < size; ++i) {
+            ranks[i] = uint64_t(llround(this->_key_array[i].second * num_keys));
+        }
+        size_t offset = 0;
+        for (size_t f = 0; f < num_frames; ++f) {
+            size_t first = f * SPLINE_FRAME_SIZE;
+            size_t last = std::min(first + SPLINE_FRAME_SIZE, size);
+            SplineFrame& frame = this->_frames[f];
+            this->_frame_keys[f] = this->_key_array[first].first;
+            frame.offset = offset;
+            frame.first_rank = ranks[first];
+            frame.key_width = _bit_width(
+                UnsignedKey(this->_key_array[last - 1].first)
+                    - UnsignedKey(this->_key_array[first].first)
+            );
+            frame.rank_width = _bit_width(ranks[last - 1] - ranks[first]);
+            offset += (last - first) * (frame.key_width + frame.rank_width);
+        }
+
+        this->_deltas._initialize_bit_array(offset);
+        for (size_t i = 0; i < size; ++i) {
+            size_t f = i / SPLINE_FRAME_SIZE;
+            size_t position = i % SPLINE_FRAME_SIZE;
+            const SplineFrame& frame = this->_frames[f];
+            this->_deltas.write_bits(
+                frame.offset + position * frame.key_width,
+                UnsignedKey(this->_key_array[i].first)
+                    - UnsignedKey(this->_frame_keys[f]),
+                frame.key_width
+            );
+            this->_deltas.write_bits(
+                frame.offset + _frame_length(f) * frame.key_width
+                    + position * frame.rank_width,
+                ranks[i] - frame.first_rank, frame.rank_width
+            );
+        }
+
+        this->_key_array.resize(0);
+    }
+
+    // _frame_length(frame)
+    //   Returns the number of knots in a frame.
+    size_t _frame_length(size_t frame) const {
+        return std::min(
+            size_t(SPLINE_FRAME_SIZE),
+            size_t(this->_sizes[0]) - frame * SPLINE_FRAME_SIZE
+        );
+    }
+
+    // _field(offset, width)
+    //   Reads the packed field of `width` bits at `offset`. Fields of zero
+    //   width, such as those of a frame with a single knot, are not read:
+    //   the last frame's may start at the very end of `_deltas`, past which
+    //   read_bits() loads a word.
+    uint64_t _field(size_t offset, size_t width) const {
+        return width == 0 ? 0 : this->_deltas.read_bits(offset, width);
+    }
+
+    // _key(index)
+    //   Decodes the key of knot `index`.
+    Key _key(size_t index) const {
+        size_t f = index / SPLINE_FRAME_SIZE;
+        const SplineFrame& frame = this->_frames[f];
+        return Key(UnsignedKey(this->_frame_keys[f]) + UnsignedKey(
+            _field(
+                frame.offset + (index % SPLINE_FRAME_SIZE) * frame.key_width,
+                frame.key_width
+            )
+        ));
+    }
+
+    // _rank(index)
+    //   Decodes the rank of knot `index`.
+    uint64_t _rank(size_t index) const {
+        size_t f = index / SPLINE_FRAME_SIZE;
+        const SplineFrame& frame = this->_frames[f];
+        return frame.first_rank + _field(
+            frame.offset + _frame_length(f) * frame.key_width
+                + (index % SPLINE_FRAME_SIZE) * frame.rank_width,
+            frame.rank_width
+        );
+    }
+
+    // _search(key)
+    //   Returns the index of the first knot greater than or equal to `key`, or
+    //   the last knot. Binary searches the frames' first keys, then the last
+    //   frame that starts below `key`.
+    size_t _search(Key key) const {
+        size_t left = 0;
+        size_t right = this->_frame_keys.size();
+        while (left < right) {
+            size_t middle = left + ((right - left) >> 1);
+            if (this->_frame_keys[middle] < key) {
+                left = middle + 1;
+            } else {
+                right = middle;
+            }
+        }
+        if (left == 0) {
+            return 0;   // the first knot is not smaller than `key`
+        }
+
+        // Compare packed offsets from the frame's first key directly. Every
+        // knot of the following frame is at least `key`.
+        size_t f = left - 1;
+        const SplineFrame& frame = this->_frames[f];
+        UnsignedKey target =
+            UnsignedKey(key) - UnsignedKey(this->_frame_keys[f]);
+        size_t first = 1;
+        size_t last = _frame_length(f);
+        while (first < last) {
+            size_t middle = first + ((last - first) >> 1);
+            uint64_t delta = _field(
+                frame.offset + middle * frame.key_width, frame.key_width
+            );
+            if (delta < target) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        return std::min(
+            f * SPLINE_FRAME_SIZE + first, size_t(this->_sizes[0]) - 1
+        );
+    }
+
+    // predict(Key key)
+    //   Implements the `BaseModel`'s predict() function that takes an input key
+    //   and estimates its CDF by interpolating between the knots around it.
+    double predict(Key key) const {
+        size_t index = _search(key);
+        Key end = _key(index);
+        double end_rank = double(_rank(index));
+
+        // The first segment starts at the origin, or at the first knot.
+        Key start = index > 0 ? _key(index - 1) : std::min(Key(0), end);
+        double start_rank = index > 0 ? double(_rank(index - 1)) : 0.0;
+
+        double rank = key <= start ? start_rank
+            : (key >= end ? end_rank : start_rank + (end_rank - start_rank)
+                * double(UnsignedKey(key) - UnsignedKey(start))
+                / double(UnsignedKey(end) - UnsignedKey(start)));
+        return rank / this->_sizes[1];
+    }
+
+    // predict_batch(keys, n, out)
+    //   Predicts the CDFs of `n` keys into `out`.
+    void predict_batch(const Key* keys, size_t n, double* out) const {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = predict(keys[i]);
+        }
+    }
+
+    // size_bytes()
+    //   Returns the size of the compact model in bytes.
+    size_t size_bytes() const {
+        return sizeof(uint64_t) * this->_sizes.size()
+            + sizeof(Key) * this->_frame_keys.size()
+            + sizeof(SplineFrame) * this->_frames.size()
+            + this->_deltas.size_bytes();
+    }
+
+    // _save(writer)
+    //   Adds the sizes, the frames and the packed deltas to a SNARF file.
+    void _save(SNARFFileWriter& writer) const {
+        writer.add_section(this->_sizes);
+        writer.add_section(this->_frame_keys);
+        writer.add_section(this->_frames);
+        writer.add_bit_array(this->_deltas);
+    }
+
+    // _map(reader)
+    //   Points the model at its arrays in a mapped SNARF file. Every frame must
+    //   lie within the packed deltas.
+    void _map(SNARFFileReader& reader) {
+        reader.next_section(this->_sizes);
+        reader.next_section(this->_frame_keys);
+        reader.next_section(this->_frames);
+        reader.next_bit_array(this->_deltas);
+        if (!_valid_frames()) {
+            throw std::runtime_error("ERROR: SNARF file model is invalid.");
+        }
+    }
+
+    // _valid_frames()
+    //   Checks that every frame's packed offsets lie within `_deltas`.
+    bool _valid_frames() const {
+        bool valid = this->_sizes.size() == 2 && this->_sizes[0] > 0
+            && this->_sizes[1] > 0 && this->_frame_keys.size()
+                == (this->_sizes[0] + SPLINE_FRAME_SIZE - 1) / SPLINE_FRAME_SIZE
+            && this->_frames.size() == this->_frame_keys.size();
+        for (size_t f = 0; valid && f < this->_frames.size(); ++f) {
+            const SplineFrame& frame = this->_frames[f];
+            valid = frame.key_width <= 64 && frame.rank_width <= 64
+                && frame.offset + _frame_length(f)
+                    * (frame.key_width + frame.rank_width)
+                    <= this->_deltas.size();
+        }
+        return valid;
+    }
+
+    // print_model()
+    //   Implements a member function to print the compact spline model in
+    //   human-readable format for debugging purposes.
+    void print_model() const {
+        std::cout << "--------------------\n";
+        std::cout << "KNOTS [Key, Rank]\n";
+        for (size_t i = 0; i < this->_sizes[0]; ++i) {
+            std::cout << "[" << _key(i) << ", " << _rank(i) << "]";
+        }
+        std::cout << "\nFRAMES [Key Width, Rank Width]\n";
+        for (size_t f = 0; f < this->_frames.size(); ++f) {
+            std::cout << "[" << this->_frames[f].key_width << ", "
+                << this->_frames[f].rank_width << "]";
+        }
+        std::cout << "\n--------------------\n";
+    }
+};
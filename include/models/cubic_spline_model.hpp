@@ -0,0 +1,73 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include "kernel_spline_model.hpp"
+
+// Largest end slope of a cubic segment, which keeps it monotone.
+#define CUBIC_MAX_SLOPE 3.0
+
+
+// CubicKernel
+//   The cubic Hermite curve from (0, 0) to (1, 1) with slopes d_0 and d_1 at
+//   its ends:
+//     f(t) = (3 - 2t) t^2 + d_0 t (1 - t)^2 + d_1 t^2 (t - 1)
+//   By Fritsch and Carlson's condition, it is non-decreasing whenever both
+//   slopes are in [0, 3]. Unlike the quadratic, it can follow an S-shaped
+//   segment. Two coefficients per segment.
+struct CubicKernel {
+    static const size_t NUM_COEFFICIENTS = 2;
+    static const uint32_t FILE_MODEL_ID = 4;
+    static constexpr const char* NAME = "CUBIC";
+
+    // evaluate(coefficients, t)
+    //   Returns the kernel at t.
+    static double evaluate(const double* coefficients, double t) {
+        double s = 1.0 - t;
+        return t * (t * (3.0 - 2.0 * t) + s * (
+            coefficients[0] * s - coefficients[1] * t
+        ));
+    }
+
+    // fit(points, coefficients)
+    //   Least-squares fit of both slopes, which the kernel is linear in, by
+    //   solving the 2x2 normal equations. Each slope is then clamped to the
+    //   monotone range. Too few points to determine both slopes give the
+    //   identity (d_0 = d_1 = 1).
+    static void fit(const KernelPointList& points, double* coefficients) {
+        double a_00 = 0.0, a_01 = 0.0, a_11 = 0.0, b_0 = 0.0, b_1 = 0.0;
+        for (const auto& point : points) {
+            double t = point.first;
+            double h_0 = t * (1.0 - t) * (1.0 - t);
+            double h_1 = t * t * (t - 1.0);
+            double residual = point.second - t * t * (3.0 - 2.0 * t);
+            a_00 += h_0 * h_0;
+            a_01 += h_0 * h_1;
+            a_11 += h_1 * h_1;
+            b_0 += h_0 * residual;
+            b_1 += h_1 * residual;
+        }
+
+        double determinant = a_00 * a_11 - a_01 * a_01;
+        if (!(determinant > 1e-12 * a_00 * a_11)) {
+            coefficients[0] = 1.0;
+            coefficients[1] = 1.0;
+            return;
+        }
+        double d_0 = (b_0 * a_11 - b_1 * a_01) / determinant;
+        double d_1 = (b_1 * a_00 - b_0 * a_01) / determinant;
+        coefficients[0] = d_0 < 0.0 ? 0.0
+            : (d_0 > CUBIC_MAX_SLOPE ? CUBIC_MAX_SLOPE : d_0);
+        coefficients[1] = d_1 < 0.0 ? 0.0
+            : (d_1 > CUBIC_MAX_SLOPE ? CUBIC_MAX_SLOPE : d_1);
+    }
+};
+
+
+// CubicSplineModel
+//   A spline of monotone cubic segments; see `KernelSplineModel`.
+template <typename Key>
+using CubicSplineModel = KernelSplineModel<Key, CubicKernel>;
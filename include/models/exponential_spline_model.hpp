@@ -0,0 +1,55 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include "kernel_spline_model.hpp"
+
+// Largest magnitude of a searched when fitting an exponential segment. The
+// slopes at the two ends of a segment differ by at most a factor of e^a, so a
+// larger rate could squeeze a wide, empty stretch of keys into a handful of
+// locations, which makes queries there false positives.
+#define EXP_KERNEL_MAX_RATE 8.0
+// Smallest magnitude of a evaluated as an exponential, rather than as the
+// identity it approaches.
+#define EXP_KERNEL_MIN_RATE 1e-9
+
+
+// ExponentialKernel
+//   f(t) = (e^(a t) - 1) / (e^a - 1): a curve through (0, 0) and (1, 1) that is
+//   convex for a > 0, as for keys that grow denser over a range, and concave
+//   for a < 0. It approaches the identity as a goes to 0. One coefficient per
+//   segment.
+struct ExponentialKernel {
+    static const size_t NUM_COEFFICIENTS = 1;
+    static const uint32_t FILE_MODEL_ID = 6;
+    static constexpr const char* NAME = "EXPONENTIAL";
+
+    // evaluate(coefficients, t)
+    //   Returns the kernel at t.
+    static double evaluate(const double* coefficients, double t) {
+        double a = coefficients[0];
+        return std::abs(a) > EXP_KERNEL_MIN_RATE ? expm1(a * t) / expm1(a) : t;
+    }
+
+    // fit(points, coefficients)
+    //   Fits a over [-EXP_KERNEL_MAX_RATE, EXP_KERNEL_MAX_RATE].
+    static void fit(const KernelPointList& points, double* coefficients) {
+        coefficients[0] = 0.0;
+        if (points.empty()) {
+            return;
+        }
+        coefficients[0] = fit_kernel_parameter<ExponentialKernel>(
+            points, -EXP_KERNEL_MAX_RATE, EXP_KERNEL_MAX_RATE,
+            [](double a) { return a; }
+        );
+    }
+};
+
+
+// ExponentialSplineModel
+//   A spline of exponential segments; see `KernelSplineModel`.
+template <typename Key>
+using ExponentialSplineModel = KernelSplineModel<Key, ExponentialKernel>;
@@ -0,0 +1,400 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+// Number of golden-section steps used to fit a one-parameter kernel.
+#define KERNEL_FIT_STEPS 40
+// Largest number of points a one-parameter kernel is fit to.
+#define KERNEL_FIT_POINTS 256
+
+#include <iostream>
+#include <algorithm>
+
+#include "base_spline_model.hpp"
+#include "../snarf_file.hpp"
+
+
+// KernelPoint
+//   A training point of one spline segment, normalized so the segment runs
+//   from (0, 0) to (1, 1): <position in the segment, fraction of its CDF>.
+typedef std::pair<double, double> KernelPoint;
+// Collection of normalized training points.
+typedef std::vector<KernelPoint> KernelPointList;
+
+
+// fit_kernel_parameter<Kernel>(points, lower, upper, coefficient)
+//   Golden-section search for the parameter in [lower, upper] whose kernel,
+//   with the single coefficient `coefficient(parameter)`, has the least
+//   squared error over `points`. Returns that coefficient. Assumes the error
+//   is unimodal in the parameter, which holds for the one-parameter kernels
+//   here. At most `KERNEL_FIT_POINTS` evenly spread points are used.
+template <typename Kernel, typename Coefficient>
+double fit_kernel_parameter(
+    const KernelPointList& points, double lower, double upper,
+    Coefficient coefficient
+) {
+    size_t stride = (points.size() + KERNEL_FIT_POINTS - 1) / KERNEL_FIT_POINTS;
+    auto error = [&](double parameter) {
+        double c = coefficient(parameter);
+        double sum = 0.0;
+        for (size_t i = stride / 2; i < points.size(); i += stride) {
+            double residual = Kernel::evaluate(&c, points[i].first)
+                - points[i].second;
+            sum += residual * residual;
+        }
+        return sum;
+    };
+
+    const double ratio = 0.6180339887498949;
+    double left = upper - ratio * (upper - lower);
+    double right = lower + ratio * (upper - lower);
+    double left_error = error(left);
+    double right_error = error(right);
+    for (size_t i = 0; i < KERNEL_FIT_STEPS; ++i) {
+        if (left_error < right_error) {
+            upper = right;
+            right = left;
+            right_error = left_error;
+            left = upper - ratio * (upper - lower);
+            left_error = error(left);
+        } else {
+            lower = left;
+            left = right;
+            left_error = right_error;
+            right = lower + ratio * (upper - lower);
+            right_error = error(right);
+        }
+    }
+    return coefficient((lower + upper) / 2);
+}
+
+
+// fit_kernel_segment<Kernel>(points, first, last, start, end, coefficients)
+//   Fits the kernel of the segment from `start` to `end` to the <key, eCDF>
+//   points in [first, last) that lie strictly between them. Returns the
+//   largest CDF error of the fitted segment over those points.
+template <typename Kernel, typename KeyCDFPairList>
+double fit_kernel_segment(
+    const KeyCDFPairList& points, size_t first, size_t last,
+    typename KeyCDFPairList::value_type start,
+    typename KeyCDFPairList::value_type end, double* coefficients
+) {
+    typedef BaseModel<typename KeyCDFPairList::value_type::first_type> Model;
+    double width = Model::_key_distance(start.first, end.first);
+    double height = end.second - start.second;
+
+    KernelPointList normalized;
+    normalized.reserve(last - first);
+    for (size_t i = first; i < last && height > 0.0; ++i) {
+        // Keys below a non-positive first key are predicted as 0.
+        double t = Model::_key_distance(start.first, points[i].first) / width;
+        if (t > 0.0 && t < 1.0) {
+            normalized.push_back(std::make_pair(
+                t, (points[i].second - start.second) / height
+            ));
+        }
+    }
+    Kernel::fit(normalized, coefficients);
+
+    double max_error = 0.0;
+    for (const auto& point : normalized) {
+        double error = std::abs(
+            Kernel::evaluate(coefficients, point.first) - point.second
+        ) * height;
+        max_error = std::max(max_error, error);
+    }
+    return max_error;
+}
+
+
+// kernel_segment_reach<Kernel>(points, base, max_error, coefficients)
+//   Returns the furthest distinct point a segment starting at point `base`
+//   can end at while the kernel fits every point in between within
+//   `max_error`, and fills in that segment's coefficients. Doubles the length
+//   of the segment until a fit fails, then binary searches between the last
+//   two lengths, so a segment of L points costs O(L log L) to find.
+//   Requires base + 1 < points.size().
+template <typename Kernel, typename KeyCDFPairList>
+size_t kernel_segment_reach(
+    const KeyCDFPairList& points, size_t base, double max_error,
+    double* coefficients
+) {
+    std::vector<double> candidate(Kernel::NUM_COEFFICIENTS);
+    auto fits = [&](size_t end) {
+        return fit_kernel_segment<Kernel>(
+            points, base + 1, end, points[base], points[end],
+            candidate.data()
+        ) <= max_error;
+    };
+
+    // A segment to the next point has nothing in between, so it fits.
+    size_t good = base + 1;
+    size_t bad = points.size();
+    Kernel::fit(KernelPointList(), coefficients);
+    for (size_t length = 2; base + length < points.size(); length *= 2) {
+        if (!fits(base + length)) {
+            bad = base + length;
+            break;
+        }
+        good = base + length;
+        std::copy(candidate.begin(), candidate.end(), coefficients);
+    }
+    while (bad - good > 1) {
+        size_t middle = good + (bad - good) / 2;
+        if (fits(middle)) {
+            good = middle;
+            std::copy(candidate.begin(), candidate.end(), coefficients);
+        } else {
+            bad = middle;
+        }
+    }
+    return good;
+}
+
+
+// KernelSplineModel
+//   A spline whose segments follow a non-linear kernel between consecutive
+//   keys of the key array. `Kernel` maps the position t in [0, 1] within a
+//   segment to the fraction of the segment's CDF below it, through
+//   `Kernel::NUM_COEFFICIENTS` fitted coefficients per segment. Every kernel
+//   runs from (0, 0) to (1, 1) and is non-decreasing for any coefficients its
+//   fit returns, so the spline interpolates the key array and stays monotone,
+//   which SNARF needs to avoid false negatives. A kernel provides
+//     evaluate(coefficients, t)       the kernel at t
+//     fit(points, coefficients)       least-squares fit to normalized points
+//                                     (the identity kernel when empty)
+//   and a `FILE_MODEL_ID` and `NAME` for the model.
+//
+//   With an `ErrorBound`, each segment is grown as far as the fitted kernel
+//   keeps every key within the bound, so a kernel that matches the shape of
+//   the data needs far fewer segments than the linear spline.
+template <typename Key, typename Kernel>
+struct KernelSplineModel : BaseSplineModel<Key> {
+    typedef typename BaseModel<Key>::KeyCDFPair KeyCDFPair;
+    typedef typename BaseModel<Key>::KeyCDFPairList KeyCDFPairList;
+
+    // The kernel coefficients of every segment, `Kernel::NUM_COEFFICIENTS` per
+    // key array entry. Segment `i` ends at key array entry `i` and starts at
+    // entry `i - 1` (or the origin, for the first segment).
+    Storage<double> _coefficients;
+
+    // Identifies this model in a SNARF file.
+    static const uint32_t FILE_MODEL_ID = Kernel::FILE_MODEL_ID;
+
+    // KernelSplineModel()
+    //   Constructs an empty model, to be filled in from a SNARF file.
+    KernelSplineModel() {}
+
+    // KernelSplineModel(input_keys, R)
+    //   Samples every R-th key like the linear spline, then fits the kernel of
+    //   each segment to the input keys that fall within it.
+    KernelSplineModel(
+        const std::vector<Key>& input_keys, size_t R
+    ) : BaseSplineModel<Key>(input_keys, R) {
+        KeyCDFPairList points;
+        _distinct_points(input_keys, points);
+        _fit_segments(points);
+    }
+
+    // KernelSplineModel(input_keys, bound)
+    //   Chooses the key array so that the kernel spline predicts the CDF of
+    //   every input key within the error bound; see `ErrorBound`.
+    KernelSplineModel(
+        const std::vector<Key>& input_keys, ErrorBound bound
+    ) {
+        if (input_keys.empty()) {
+            throw std::runtime_error("ERROR: Requires at least one key.");
+        }
+        if (!(bound.max_error > 0.0)) {
+            throw std::runtime_error("ERROR: Error bound must be positive.");
+        }
+
+        KeyCDFPairList points;
+        _distinct_points(input_keys, points);
+        _build_error_bounded_segments(points, bound.max_error);
+    }
+
+    // _distinct_points(input_keys, points)
+    //   Collects the <key, eCDF> pair of the last copy of every distinct key.
+    static void _distinct_points(
+        const std::vector<Key>& input_keys, KeyCDFPairList& points
+    ) {
+        size_t num_keys = input_keys.size();
+        points.clear();
+        for (size_t i = 0; i < num_keys; ++i) {
+            if (i + 1 == num_keys || input_keys[i + 1] != input_keys[i]) {
+                points.push_back(
+                    std::make_pair(input_keys[i], (i + 1) * 1.0 / num_keys)
+                );
+            }
+        }
+    }
+
+    // _fit_segments(points)
+    //   Fits the kernel of every segment of the sampled key array to the
+    //   distinct points between its ends.
+    void _fit_segments(const KeyCDFPairList& points) {
+        size_t size = this->_key_array.size();
+        this->_coefficients.resize(size * Kernel::NUM_COEFFICIENTS);
+
+        size_t first = 0;
+        for (size_t i = 0; i < size; ++i) {
+            Key end = this->_key_array[i].first;
+            size_t last = first;
+            while (last < points.size() && points[last].first < end) {
+                ++last;
+            }
+            fit_kernel_segment<Kernel>(
+                points, first, last, this->_segment_start(i),
+                this->_key_array[i],
+                &this->_coefficients[i * Kernel::NUM_COEFFICIENTS]
+            );
+
+            // skip the segment's end, which the spline passes through
+            first = last < points.size() && points[last].first == end
+                ? last + 1 : last;
+        }
+    }
+
+    // _build_error_bounded_segments(points, max_error)
+    //   Greedily grows every segment from the end of the last one as far as
+    //   the kernel still fits within `max_error`; see kernel_segment_reach().
+    //   The first segment ends at the first key, as in the linear spline.
+    void _build_error_bounded_segments(
+        const KeyCDFPairList& points, double max_error
+    ) {
+        KeyCDFPairList knots(1, points[0]);
+        std::vector<double> coefficients(Kernel::NUM_COEFFICIENTS);
+        Kernel::fit(KernelPointList(), coefficients.data());
+
+        std::vector<double> fitted(Kernel::NUM_COEFFICIENTS);
+        for (size_t base = 0; base + 1 < points.size(); ) {
+            base = kernel_segment_reach<Kernel>(
+                points, base, max_error, fitted.data()
+            );
+            knots.push_back(points[base]);
+            coefficients.insert(
+                coefficients.end(), fitted.begin(), fitted.end()
+            );
+        }
+
+        this->_key_array.resize(knots.size());
+        this->_coefficients.resize(coefficients.size());
+        for (size_t i = 0; i < knots.size(); ++i) {
+            this->_key_array[i] = knots[i];
+        }
+        for (size_t i = 0; i < coefficients.size(); ++i) {
+            this->_coefficients[i] = coefficients[i];
+        }
+    }
+
+    // predict(Key key)
+    //   Implements the `BaseModel`'s predict() function that takes an input key
+    //   and estimates its CDF. The result is clamped to the CDFs at the ends of
+    //   the key's segment, so rounding cannot break monotonicity between
+    //   segments.
+    double predict(Key key) const {
+        return _evaluate(this->binary_search(key), key);
+    }
+
+    // predict_batch(keys, n, out)
+    //   Predicts the CDFs of `n` keys into `out`, searching them in groups
+    //   (see `binary_search_batch`).
+    void predict_batch(const Key* keys, size_t n, double* out) const {
+        this->_predict_batch(keys, n, out, [this](size_t index, Key key) {
+            return this->_evaluate(index, key);
+        });
+    }
+
+    // _evaluate(index, key)
+    //   Evaluates the kernel of segment `index` at `key`.
+    double _evaluate(size_t index, Key key) const {
+        KeyCDFPair start = this->_segment_start(index);
+        const KeyCDFPair& end = this->_key_array[index];
+
+        // The key's position within the segment, from its distance to the
+        // start (see `_key_distance`).
+        double width = this->_key_distance(start.first, end.first);
+        double t = width > 0.0
+            ? this->_key_distance(start.first, key) / width : 1.0;
+        t = t > 1.0 ? 1.0 : t;
+
+        double ecdf = start.second + (end.second - start.second)
+            * Kernel::evaluate(
+                &this->_coefficients[index * Kernel::NUM_COEFFICIENTS], t
+            );
+        return ecdf < start.second ? start.second
+            : (ecdf > end.second ? end.second : ecdf);
+    }
+
+    // size_bytes()
+    //   Returns the size of the kernel spline model in bytes.
+    size_t size_bytes() const {
+        size_t model_size = 0;
+
+        // Size contribution of base model.
+        size_t KeyCDFPair_size = sizeof(Key) + sizeof(double);
+        model_size += KeyCDFPair_size * this->_key_array.size();
+
+        // Size contribution of the kernel coefficients.
+        model_size += sizeof(double) * this->_coefficients.size();
+
+        // Size contribution of the search layout, if used.
+        model_size += this->_search_size_bytes();
+
+        return model_size;
+    }
+
+    // _save(writer)
+    //   Adds the key array, the search layout and the kernel coefficients to
+    //   a SNARF file.
+    void _save(SNARFFileWriter& writer) const {
+        writer.add_section(this->_key_array);
+        this->_save_search(writer);
+        writer.add_section(this->_coefficients);
+    }
+
+    // _map(reader)
+    //   Points the model at its arrays in a mapped SNARF file.
+    void _map(SNARFFileReader& reader) {
+        reader.next_section(this->_key_array);
+        this->_map_search(reader);
+        reader.next_section(this->_coefficients);
+        if (
+            this->_key_array.empty() ||
+            this->_coefficients.size()
+                != this->_key_array.size() * Kernel::NUM_COEFFICIENTS
+        ) {
+            throw std::runtime_error("ERROR: SNARF file model is invalid.");
+        }
+    }
+
+    // print_model()
+    //   Implements a member function to print the kernel spline model in
+    //   human-readable format for debugging purposes.
+    void print_model() const {
+        std::cout << "--------------------\n";
+        std::cout << "KEY ARRAY [Key, eCDF]\n";
+        for (
+            auto it = this->_key_array.begin();
+            it != this->_key_array.end();
+            ++it
+        ) {
+            std::cout << "[" << it->first << ", " << it->second << "]";
+        }
+
+        std::cout << "\n" << Kernel::NAME << " KERNEL COEFFICIENTS\n";
+        for (size_t i = 0; i < this->_key_array.size(); ++i) {
+            std::cout << "[";
+            for (size_t j = 0; j < Kernel::NUM_COEFFICIENTS; ++j) {
+                std::cout << (j > 0 ? ", " : "")
+                    << this->_coefficients[i * Kernel::NUM_COEFFICIENTS + j];
+            }
+            std::cout << "]";
+        }
+        std::cout << "\n--------------------\n";
+    }
+};
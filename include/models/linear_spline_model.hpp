@@ -5,7 +5,10 @@
 
 #pragma once
 
+#include <iostream>
+
 #include "base_spline_model.hpp"
+#include "../snarf_file.hpp"
 
 
 // LinearSplineModel
@@ -14,10 +17,20 @@
 template <typename Key>
 struct LinearSplineModel : BaseSplineModel<Key> {
     // Data representation of a single linear model as a <slope, bias> pair.
+    // The bias is the CDF at the segment's start key, and the slope applies
+    // to the key's distance from it (see `_key_distance`), so keys keep their
+    // full resolution anywhere in the keyspace.
     typedef std::pair<double, double> SlopeBiasPair;
 
     // An array of linear models (of type `SlopeBiasPair`).
-    std::vector<SlopeBiasPair> _linear_models_array;
+    Storage<SlopeBiasPair> _linear_models_array;
+
+    // Identifies this model in a SNARF file.
+    static const uint32_t FILE_MODEL_ID = 1;
+
+    // LinearSplineModel()
+    //   Constructs an empty model, to be filled in from a SNARF file.
+    LinearSplineModel() {}
 
     // LinearSplineModel(input_keys, R)
     //   Constructs a spline of linear models using an array of `SlopeBiasPair`s
@@ -25,50 +38,148 @@ struct LinearSplineModel : BaseSplineModel<Key> {
     LinearSplineModel(
         const std::vector<Key>& input_keys, size_t R
     ) : BaseSplineModel<Key>(input_keys, R) {
-        size_t model_array_size = this->_key_array.size() + 1;
-        this->_linear_models_array.resize(model_array_size);
+        _build_linear_models();
+    }
 
-        // build first linear model
-        this->_linear_models_array[0] = _calculate_slope_bias(
-            std::make_pair(0, 0), this->_key_array[0]
+    // LinearSplineModel(input_keys, bound)
+    //   Constructs a spline of linear models with as few segments as keep the
+    //   predicted CDF of every input key within the error bound.
+    LinearSplineModel(
+        const std::vector<Key>& input_keys, ErrorBound bound
+    ) : BaseSplineModel<Key>(input_keys, bound) {
+        _build_linear_models();
+    }
+
+    // _build_linear_models()
+    //   Fits one linear model to every segment of the key array, from the
+    //   origin to the first key and between consecutive keys after it. A
+    //   final flat model continues past the last key.
+    void _build_linear_models() {
+        size_t size = this->_key_array.size();
+        this->_linear_models_array.resize(size + 1);
+        for (size_t i = 0; i < size; ++i) {
+            this->_linear_models_array[i] = _calculate_slope_bias(
+                this->_segment_start(i), this->_key_array[i]
+            );
+        }
+        this->_linear_models_array[size] = std::make_pair(
+            0.0, this->_key_array[size - 1].second
         );
+    }
 
-        // build second model and onwards
-        for (size_t i = 0; i < this->_key_array.size(); ++i) {
-            this->_linear_models_array[i + 1] = _calculate_slope_bias(
-                this->_key_array[i], this->_key_array[i + 1]
+    // append(keys, first_rank, num_keys, R, replace_last)
+    //   Extends the spline past its last key with the strictly increasing
+    //   `keys`, all greater than it, taking every R-th of them, counted from
+    //   that last key, and the last of them as new key array entries. The
+    //   key at index i of `keys` gets the CDF (first_rank + i) / num_keys,
+    //   where `num_keys` stays the count the existing CDFs are relative to,
+    //   so appended CDFs go past 1. With `replace_last`, the last entry is
+    //   dropped first: a caller passes it when that entry ended an earlier
+    //   call between two R-th keys, along with the keys after the entry
+    //   before it, so that a call of fewer than R keys adds no entry of its
+    //   own. Only the final flat model and the segment of a dropped entry
+    //   are replaced; the other segments are left as they are. Requires the
+    //   sorted search layout, which needs no rebuilding as the key array
+    //   grows.
+    void append(
+        const std::vector<Key>& keys, size_t first_rank, size_t num_keys,
+        size_t R, bool replace_last = false
+    ) {
+        if (keys.empty()) {
+            return;
+        }
+        if (R == 0) {
+            throw std::runtime_error("ERROR: R must be positive.");
+        }
+        if (!this->_eytzinger_keys.empty() || !this->_radix_table.empty()) {
+            throw std::runtime_error(
+                "ERROR: Appending requires the sorted search layout."
             );
         }
+        size_t old_size = this->_key_array.size() - (replace_last ? 1 : 0);
+        if (old_size == 0) {
+            throw std::runtime_error("ERROR: No key array entry to replace.");
+        }
+        if (!(this->_key_array[old_size - 1].first < keys[0])) {
+            throw std::runtime_error(
+                "ERROR: Appended keys must be greater than the model's keys."
+            );
+        }
+        for (size_t i = 1; i < keys.size(); ++i) {
+            if (!(keys[i - 1] < keys[i])) {
+                throw std::runtime_error(
+                    "ERROR: Appended keys must be strictly increasing."
+                );
+            }
+        }
+
+        size_t count = keys.size() / R + (keys.size() % R != 0 ? 1 : 0);
+        this->_key_array.resize(old_size + count);
+        this->_linear_models_array.resize(old_size + count + 1);
+        for (size_t i = 0; i < count; ++i) {
+            size_t index = std::min((i + 1) * R, keys.size()) - 1;
+            this->_key_array[old_size + i] = std::make_pair(
+                keys[index], double(first_rank + index) / num_keys
+            );
+        }
+        for (size_t i = old_size; i < old_size + count; ++i) {
+            this->_linear_models_array[i] = _calculate_slope_bias(
+                this->_segment_start(i), this->_key_array[i]
+            );
+        }
+        this->_linear_models_array[old_size + count] = std::make_pair(
+            0.0, this->_key_array[old_size + count - 1].second
+        );
     }
 
     // predict(Key key)
     //   Implements the `BaseModel`'s predict() function that takes an input key
-    //   and estimates its CDF.
-    double predict(Key key) override {
-        SlopeBiasPair model = _linear_models_array[
-            this->binary_search(key)
-        ];
-        double ecdf = model.first * key + model.second;
-        return ecdf < 0.0 ? 0.0 : (ecdf > 1.0 ? 1.0 : ecdf);
+    //   and estimates its CDF from its distance to the start of its segment.
+    double predict(Key key) const {
+        return _evaluate(this->binary_search(key), key);
+    }
+
+    // predict_batch(keys, n, out)
+    //   Predicts the CDFs of `n` keys into `out`, searching them in groups
+    //   (see `binary_search_batch`).
+    void predict_batch(const Key* keys, size_t n, double* out) const {
+        this->_predict_batch(keys, n, out, [this](size_t index, Key key) {
+            return this->_evaluate(index, key);
+        });
+    }
+
+    // _evaluate(index, key)
+    //   Evaluates the linear model of segment `index` at `key`, clamped to
+    //   [0, 1], or up to the segment's end CDF for appended segments that
+    //   go past 1 (see append()).
+    double _evaluate(size_t index, Key key) const {
+        const SlopeBiasPair& model = _linear_models_array[index];
+        Key start = index > 0 ? this->_key_array[index - 1].first
+            : std::min(Key(0), this->_key_array[0].first);
+        double ecdf = model.second
+            + model.first * this->_key_distance(start, key);
+        double end = this->_key_array[
+            std::min(index, this->_key_array.size() - 1)
+        ].second;
+        double upper = end > 1.0 ? end : 1.0;
+        return ecdf < 0.0 ? 0.0 : (ecdf > upper ? upper : ecdf);
     }
 
     // _calculate_slope_bias(pair_1, pair_2)
-    //   A simple calculation of (y2 - y1) / (x2 - x1) to generate the slope and
-    //   c = y2 - m * x1 and returns it as a pair.
+    //   A simple calculation of (y2 - y1) / (x2 - x1) to generate the slope,
+    //   returned with the bias y1 at x1 as a pair.
     SlopeBiasPair _calculate_slope_bias(
         typename BaseModel<Key>::KeyCDFPair pair_1,
         typename BaseModel<Key>::KeyCDFPair pair_2
     ) {
-        double slope = (
-            (pair_2.second - pair_1.second) / (pair_2.first - pair_1.first)
-        );
-        double bias = pair_2.second - slope * pair_2.first;
-        return std::make_pair(slope, bias);
+        double dx = this->_key_distance(pair_1.first, pair_2.first);
+        double slope = dx > 0.0 ? (pair_2.second - pair_1.second) / dx : 0.0;
+        return std::make_pair(slope, pair_1.second);
     }
 
     // size()
     //   Returns the size of the linear model in bytes.
-    size_t size_bytes() override {
+    size_t size_bytes() const {
         size_t model_size = 0;
 
         // Size contribution of base model.
@@ -79,13 +190,39 @@ struct LinearSplineModel : BaseSplineModel<Key> {
         size_t SlopeBiasPair_size = sizeof(double) * 2;
         model_size += SlopeBiasPair_size * this->_linear_models_array.size();
 
+        // Size contribution of the Eytzinger search layout, if used.
+        model_size += this->_search_size_bytes();
+
         return model_size;
     }
 
+    // _save(writer)
+    //   Adds the key array, the search layout and the linear models to a
+    //   SNARF file.
+    void _save(SNARFFileWriter& writer) const {
+        writer.add_section(this->_key_array);
+        this->_save_search(writer);
+        writer.add_section(this->_linear_models_array);
+    }
+
+    // _map(reader)
+    //   Points the model at its arrays in a mapped SNARF file.
+    void _map(SNARFFileReader& reader) {
+        reader.next_section(this->_key_array);
+        this->_map_search(reader);
+        reader.next_section(this->_linear_models_array);
+        if (
+            this->_key_array.empty() ||
+            this->_linear_models_array.size() != this->_key_array.size() + 1
+        ) {
+            throw std::runtime_error("ERROR: SNARF file model is invalid.");
+        }
+    }
+
     // print_model()
     //   Implements a member function to print the linear spline model in human-
     //   readable format for debugging purposes.
-    void print_model() override {
+    void print_model() const {
         std::cout << "--------------------\n";
         std::cout << "KEY ARRAY [Key, eCDF]\n";
         for (
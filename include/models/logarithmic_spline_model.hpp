@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include "kernel_spline_model.hpp"
+
+// Range of log10(a) searched when fitting a logarithmic segment.
+#define LOG_KERNEL_MIN_EXPONENT -3.0
+#define LOG_KERNEL_MAX_EXPONENT 9.0
+
+
+// LogarithmicKernel
+//   f(t) = log(1 + a t) / log(1 + a) for a > 0: a concave curve through (0, 0)
+//   and (1, 1) whose CDF rises quickly at the start of the segment and then
+//   flattens, as for keys that thin out over a range. It approaches the
+//   identity as a goes to 0. One coefficient per segment.
+struct LogarithmicKernel {
+    static const size_t NUM_COEFFICIENTS = 1;
+    static const uint32_t FILE_MODEL_ID = 5;
+    static constexpr const char* NAME = "LOGARITHMIC";
+
+    // evaluate(coefficients, t)
+    //   Returns the kernel at t.
+    static double evaluate(const double* coefficients, double t) {
+        double a = coefficients[0];
+        return a > 0.0 ? log1p(a * t) / log1p(a) : t;
+    }
+
+    // fit(points, coefficients)
+    //   Fits a over a logarithmic scale, keeping the identity (a = 0) if no
+    //   curve fits better.
+    static void fit(const KernelPointList& points, double* coefficients) {
+        coefficients[0] = 0.0;
+        if (points.empty()) {
+            return;
+        }
+
+        double a = fit_kernel_parameter<LogarithmicKernel>(
+            points, LOG_KERNEL_MIN_EXPONENT, LOG_KERNEL_MAX_EXPONENT,
+            [](double exponent) { return pow(10.0, exponent); }
+        );
+
+        double curve_error = 0.0;
+        double identity_error = 0.0;
+        for (const auto& point : points) {
+            double residual = evaluate(&a, point.first) - point.second;
+            curve_error += residual * residual;
+            identity_error += (point.first - point.second)
+                * (point.first - point.second);
+        }
+        if (curve_error < identity_error) {
+            coefficients[0] = a;
+        }
+    }
+};
+
+
+// LogarithmicSplineModel
+//   A spline of logarithmic segments; see `KernelSplineModel`.
+template <typename Key>
+using LogarithmicSplineModel = KernelSplineModel<Key, LogarithmicKernel>;
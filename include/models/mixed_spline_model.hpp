@@ -0,0 +1,340 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+// Number of segments whose kernel kinds are packed in one 64-bit word.
+#define SEGMENT_KINDS_PER_WORD 32
+
+#include <iostream>
+
+#include "kernel_spline_model.hpp"
+#include "../bit_utils.hpp"
+#include "quadratic_spline_model.hpp"
+#include "cubic_spline_model.hpp"
+
+
+// SegmentKernel
+//   The kernel of one segment of a `MixedSplineModel`, as a 2-bit code whose
+//   number of set bits is the number of coefficients the segment stores.
+enum SegmentKernel {
+    SEGMENT_KERNEL_LINEAR = 0,
+    SEGMENT_KERNEL_QUADRATIC = 1,
+    SEGMENT_KERNEL_CUBIC = 3
+};
+
+
+// LinearKernel
+//   f(t) = t, the straight line through (0, 0) and (1, 1), with nothing to
+//   fit.
+struct LinearKernel {
+    static const size_t NUM_COEFFICIENTS = 0;
+
+    static double evaluate(const double*, double t) {
+        return t;
+    }
+
+    static void fit(const KernelPointList&, double*) {}
+};
+
+
+// MixedSplineModel
+//   A spline in which every segment uses the kernel that covers the most keys
+//   per byte within the error bound: linear (no coefficients), quadratic (one)
+//   or cubic (two). So long flat regions cost no more than the key array, and
+//   only knees pay for a curve.
+//
+//   All three kernels are cubic Hermite curves: a line has end slopes (1, 1)
+//   and the quadratic t + a t (t - 1) has end slopes (1 - a, 1 + a). A
+//   prediction therefore evaluates one curve, with its slopes picked by
+//   conditional moves rather than a branch on the kernel. The kernel kinds are
+//   packed 2 bits per segment, and a segment's coefficients are found by
+//   counting the bits set before it in its word.
+template <typename Key>
+struct MixedSplineModel : BaseSplineModel<Key> {
+    typedef typename BaseModel<Key>::KeyCDFPair KeyCDFPair;
+    typedef typename BaseModel<Key>::KeyCDFPairList KeyCDFPairList;
+
+    // The `SegmentKernel` of every segment, `SEGMENT_KINDS_PER_WORD` per word.
+    Storage<uint64_t> _kernel_kinds;
+    // The index in `_coefficients` of the first coefficient of each word of
+    // `_kernel_kinds`, plus a final entry for the total.
+    Storage<uint32_t> _kernel_offsets;
+    // The coefficients of every segment in order, plus two padding entries so
+    // that a prediction can always read two coefficients.
+    Storage<double> _coefficients;
+
+    // Identifies this model in a SNARF file.
+    static const uint32_t FILE_MODEL_ID = 7;
+
+    // MixedSplineModel()
+    //   Constructs an empty model, to be filled in from a SNARF file.
+    MixedSplineModel() {}
+
+    // MixedSplineModel(input_keys, bound)
+    //   Grows each segment as far as every kernel allows within the bound and
+    //   keeps the one that covers the most keys per byte of its key array
+    //   entry and coefficients, preferring cheaper kernels on ties. The choice
+    //   needs the error bound, so there is no constructor that samples every
+    //   R-th key.
+    MixedSplineModel(const std::vector<Key>& input_keys, ErrorBound bound) {
+        if (input_keys.empty()) {
+            throw std::runtime_error("ERROR: Requires at least one key.");
+        }
+        if (!(bound.max_error > 0.0)) {
+            throw std::runtime_error("ERROR: Error bound must be positive.");
+        }
+
+        KeyCDFPairList points;
+        KernelSplineModel<Key, CubicKernel>::_distinct_points(
+            input_keys, points
+        );
+
+        // The first segment ends at the first key, as in the linear spline.
+        KeyCDFPairList knots(1, points[0]);
+        std::vector<SegmentKernel> kinds(1, SEGMENT_KERNEL_LINEAR);
+        std::vector<double> coefficients;
+
+        double max_error = bound.max_error;
+        double quadratic[QuadraticKernel::NUM_COEFFICIENTS];
+        double cubic[CubicKernel::NUM_COEFFICIENTS];
+        for (size_t base = 0; base + 1 < points.size(); ) {
+            size_t ends[] = {
+                kernel_segment_reach<LinearKernel>(
+                    points, base, max_error, nullptr
+                ),
+                kernel_segment_reach<QuadraticKernel>(
+                    points, base, max_error, quadratic
+                ),
+                kernel_segment_reach<CubicKernel>(
+                    points, base, max_error, cubic
+                )
+            };
+
+            size_t best = 0;
+            double best_rate = 0.0;
+            for (size_t i = 0; i < 3; ++i) {
+                double rate = (ends[i] - base) * 1.0
+                    / (sizeof(Key) + sizeof(double) * (1 + i));
+                if (rate > best_rate) {
+                    best = i;
+                    best_rate = rate;
+                }
+            }
+
+            if (best == 0) {
+                kinds.push_back(SEGMENT_KERNEL_LINEAR);
+            } else if (best == 1) {
+                kinds.push_back(SEGMENT_KERNEL_QUADRATIC);
+                coefficients.push_back(quadratic[0]);
+            } else {
+                kinds.push_back(SEGMENT_KERNEL_CUBIC);
+                coefficients.push_back(cubic[0]);
+                coefficients.push_back(cubic[1]);
+            }
+            base = ends[best];
+            knots.push_back(points[base]);
+        }
+
+        this->_key_array.resize(knots.size());
+        for (size_t i = 0; i < knots.size(); ++i) {
+            this->_key_array[i] = knots[i];
+        }
+        _pack_kernels(kinds, coefficients);
+    }
+
+    // _pack_kernels(kinds, coefficients)
+    //   Packs the kernel kinds of the segments and indexes their coefficients.
+    void _pack_kernels(
+        const std::vector<SegmentKernel>& kinds,
+        std::vector<double>& coefficients
+    ) {
+        if (coefficients.size() > UINT32_MAX) {
+            throw std::runtime_error("ERROR: Too many coefficients to index.");
+        }
+
+        size_t num_words = (kinds.size() + SEGMENT_KINDS_PER_WORD - 1)
+            / SEGMENT_KINDS_PER_WORD;
+        this->_kernel_kinds.resize(num_words);
+        this->_kernel_offsets.resize(num_words + 1);
+        uint32_t offset = 0;
+        for (size_t i = 0; i < kinds.size(); ++i) {
+            size_t word = i / SEGMENT_KINDS_PER_WORD;
+            if (i % SEGMENT_KINDS_PER_WORD == 0) {
+                this->_kernel_kinds[word] = 0;
+                this->_kernel_offsets[word] = offset;
+            }
+            this->_kernel_kinds[word] |=
+                uint64_t(kinds[i]) << (2 * (i % SEGMENT_KINDS_PER_WORD));
+            offset += GenericBitOps::popcount(kinds[i]);
+        }
+        this->_kernel_offsets[num_words] = offset;
+
+        coefficients.resize(coefficients.size() + 2, 0.0);
+        this->_coefficients.resize(coefficients.size());
+        for (size_t i = 0; i < coefficients.size(); ++i) {
+            this->_coefficients[i] = coefficients[i];
+        }
+    }
+
+    // _kernel_kind(index)
+    //   Returns the `SegmentKernel` of segment `index`.
+    SegmentKernel _kernel_kind(size_t index) const {
+        uint64_t word = this->_kernel_kinds[index / SEGMENT_KINDS_PER_WORD];
+        return SegmentKernel(
+            (word >> (2 * (index % SEGMENT_KINDS_PER_WORD))) & 3
+        );
+    }
+
+    // predict(Key key)
+    //   Implements the `BaseModel`'s predict() function that takes an input key
+    //   and estimates its CDF, clamped to the CDFs at the ends of the key's
+    //   segment like the other kernel splines.
+    double predict(Key key) const {
+        return _evaluate(this->binary_search(key), key);
+    }
+
+    // predict_batch(keys, n, out)
+    //   Predicts the CDFs of `n` keys into `out`, searching them in groups
+    //   (see `binary_search_batch`).
+    void predict_batch(const Key* keys, size_t n, double* out) const {
+        this->_predict_batch(keys, n, out, [this](size_t index, Key key) {
+            return this->_evaluate(index, key);
+        });
+    }
+
+    // _evaluate(index, key)
+    //   Evaluates the kernel of segment `index` at `key`.
+    double _evaluate(size_t index, Key key) const {
+        KeyCDFPair start = this->_segment_start(index);
+        const KeyCDFPair& end = this->_key_array[index];
+
+        double width = this->_key_distance(start.first, end.first);
+        double t = width > 0.0
+            ? this->_key_distance(start.first, key) / width : 1.0;
+        t = t > 1.0 ? 1.0 : t;
+
+        // Locate the segment's coefficients from the kinds before it.
+        uint64_t word = this->_kernel_kinds[index / SEGMENT_KINDS_PER_WORD];
+        size_t shift = 2 * (index % SEGMENT_KINDS_PER_WORD);
+        uint64_t kind = (word >> shift) & 3;
+        const double* coefficients = &this->_coefficients[
+            this->_kernel_offsets[index / SEGMENT_KINDS_PER_WORD]
+                + GenericBitOps::popcount(word & ((uint64_t(1) << shift) - 1))
+        ];
+
+        // The Hermite end slopes of the segment's kernel.
+        double a = kind == SEGMENT_KERNEL_QUADRATIC ? coefficients[0] : 0.0;
+        bool cubic = kind == SEGMENT_KERNEL_CUBIC;
+        double slopes[] = {
+            cubic ? coefficients[0] : 1.0 - a,
+            cubic ? coefficients[1] : 1.0 + a
+        };
+
+        double ecdf = start.second + (end.second - start.second)
+            * CubicKernel::evaluate(slopes, t);
+        return ecdf < start.second ? start.second
+            : (ecdf > end.second ? end.second : ecdf);
+    }
+
+    // size_bytes()
+    //   Returns the size of the mixed spline model in bytes.
+    size_t size_bytes() const {
+        size_t model_size = 0;
+
+        // Size contribution of base model.
+        size_t KeyCDFPair_size = sizeof(Key) + sizeof(double);
+        model_size += KeyCDFPair_size * this->_key_array.size();
+
+        // Size contribution of the kernel kinds and coefficients.
+        model_size += sizeof(uint64_t) * this->_kernel_kinds.size();
+        model_size += sizeof(uint32_t) * this->_kernel_offsets.size();
+        model_size += sizeof(double) * this->_coefficients.size();
+
+        // Size contribution of the search layout, if used.
+        model_size += this->_search_size_bytes();
+
+        return model_size;
+    }
+
+    // _save(writer)
+    //   Adds the key array, the search layout, the kernel kinds and the
+    //   coefficients to a SNARF file.
+    void _save(SNARFFileWriter& writer) const {
+        writer.add_section(this->_key_array);
+        this->_save_search(writer);
+        writer.add_section(this->_kernel_kinds);
+        writer.add_section(this->_kernel_offsets);
+        writer.add_section(this->_coefficients);
+    }
+
+    // _map(reader)
+    //   Points the model at its arrays in a mapped SNARF file. Every segment's
+    //   coefficients must be where its kind says, so predictions stay within
+    //   the coefficient array.
+    void _map(SNARFFileReader& reader) {
+        reader.next_section(this->_key_array);
+        this->_map_search(reader);
+        reader.next_section(this->_kernel_kinds);
+        reader.next_section(this->_kernel_offsets);
+        reader.next_section(this->_coefficients);
+        if (!_valid_kernels()) {
+            throw std::runtime_error("ERROR: SNARF file model is invalid.");
+        }
+    }
+
+    // _valid_kernels()
+    //   Checks that the segment kinds are known and that their offsets add
+    //   up to the coefficients.
+    bool _valid_kernels() const {
+        size_t num_words = this->_kernel_kinds.size();
+        bool valid = !this->_key_array.empty()
+            && num_words == (this->_key_array.size()
+                + SEGMENT_KINDS_PER_WORD - 1) / SEGMENT_KINDS_PER_WORD
+            && this->_kernel_offsets.size() == num_words + 1
+            && this->_kernel_offsets[0] == 0;
+        for (size_t i = 0; valid && i < num_words; ++i) {
+            // No segment may use the unassigned code 2 (high bit only).
+            uint64_t word = this->_kernel_kinds[i];
+            valid = ((word >> 1) & ~word & 0x5555555555555555ULL) == 0
+                && this->_kernel_offsets[i] + GenericBitOps::popcount(word)
+                    == this->_kernel_offsets[i + 1];
+        }
+        valid = valid && this->_coefficients.size()
+            == size_t(this->_kernel_offsets[num_words]) + 2;
+        return valid;
+    }
+
+    // print_model()
+    //   Implements a member function to print the mixed spline model in
+    //   human-readable format for debugging purposes.
+    void print_model() const {
+        std::cout << "--------------------\n";
+        std::cout << "KEY ARRAY [Key, eCDF]\n";
+        for (
+            auto it = this->_key_array.begin();
+            it != this->_key_array.end();
+            ++it
+        ) {
+            std::cout << "[" << it->first << ", " << it->second << "]";
+        }
+
+        std::cout << "\nSEGMENT KERNELS [Kind: Coefficients]\n";
+        size_t offset = 0;
+        for (size_t i = 0; i < this->_key_array.size(); ++i) {
+            SegmentKernel kind = _kernel_kind(i);
+            std::cout << "[" << (
+                kind == SEGMENT_KERNEL_LINEAR ? "LINEAR"
+                    : (kind == SEGMENT_KERNEL_QUADRATIC ? "QUADRATIC" : "CUBIC")
+            );
+            for (size_t j = 0; j < GenericBitOps::popcount(kind); ++j) {
+                std::cout << (j > 0 ? ", " : ": ")
+                    << this->_coefficients[offset++];
+            }
+            std::cout << "]";
+        }
+        std::cout << "\n--------------------\n";
+    }
+};
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include "kernel_spline_model.hpp"
+
+
+// QuadraticKernel
+//   f(t) = t + a * t * (t - 1), a parabola through (0, 0) and (1, 1). Its slope
+//   runs from 1 - a to 1 + a, so it is non-decreasing for a in [-1, 1]: convex
+//   for positive a and concave for negative a. One coefficient per segment.
+struct QuadraticKernel {
+    static const size_t NUM_COEFFICIENTS = 1;
+    static const uint32_t FILE_MODEL_ID = 3;
+    static constexpr const char* NAME = "QUADRATIC";
+
+    // evaluate(coefficients, t)
+    //   Returns the kernel at t.
+    static double evaluate(const double* coefficients, double t) {
+        return t + coefficients[0] * t * (t - 1.0);
+    }
+
+    // fit(points, coefficients)
+    //   Least-squares fit of a, which has a closed form since the kernel is
+    //   linear in it, clamped to the monotone range.
+    static void fit(const KernelPointList& points, double* coefficients) {
+        double numerator = 0.0;
+        double denominator = 0.0;
+        for (const auto& point : points) {
+            double basis = point.first * (point.first - 1.0);
+            numerator += basis * (point.second - point.first);
+            denominator += basis * basis;
+        }
+        double a = denominator > 0.0 ? numerator / denominator : 0.0;
+        coefficients[0] = a < -1.0 ? -1.0 : (a > 1.0 ? 1.0 : a);
+    }
+};
+
+
+// QuadraticSplineModel
+//   A spline of monotone quadratic segments; see `KernelSplineModel`.
+template <typename Key>
+using QuadraticSplineModel = KernelSplineModel<Key, QuadraticKernel>;
@@ -0,0 +1,293 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+
+#include "base_model.hpp"
+#include "../snarf_file.hpp"
+
+
+// RMIModel
+//   A two-level recursive model index (RMI). A root linear model maps a key
+//   straight to one of `num_leaves` leaf linear models, which estimates the
+//   CDF, so a prediction costs two multiply-adds and one memory access with no
+//   search. Each leaf's output is clamped to the CDF range of the keys routed
+//   to it, which bounds the error of a poorly fit leaf. The ranges of
+//   consecutive leaves meet but never overlap, and the root is non-decreasing,
+//   so the model as a whole stays monotone, which SNARF needs to avoid false
+//   negatives.
+template <typename Key>
+struct RMIModel : BaseModel<Key> {
+    // Data representation of a single linear model as a <slope, bias> pair.
+    typedef std::pair<double, double> SlopeBiasPair;
+    // A <key, CDF> point, with the key converted to floating point.
+    typedef std::pair<double, double> KeyCDFPoint;
+
+    // RMILeaf
+    //   A leaf linear model and the range its CDF estimates are clamped to.
+    struct RMILeaf {
+        double slope;
+        double bias;
+        double lower;
+        double upper;
+    };
+
+    // The root model, with a single entry, scaled to predict a leaf index.
+    Storage<SlopeBiasPair> _root;
+    // The leaf models.
+    Storage<RMILeaf> _leaves;
+
+    // Identifies this model in a SNARF file.
+    static const uint32_t FILE_MODEL_ID = 2;
+
+    // RMIModel()
+    //   Constructs an empty model, to be filled in from a SNARF file.
+    RMIModel() {}
+
+    // RMIModel(input_keys, R, num_leaves)
+    //   Trains the RMI on every R-th input key. `num_leaves` defaults to one
+    //   leaf per sampled key. The sampled key array is only needed for
+    //   training and is released afterwards.
+    RMIModel(
+        const std::vector<Key>& input_keys, size_t R, size_t num_leaves = 0
+    ) : BaseModel<Key>(input_keys, R) {
+        _build_root(num_leaves > 0 ? num_leaves : this->_key_array.size());
+        _build_leaves();
+        this->_key_array.resize(0);
+    }
+
+    // RMIModel(input_keys, bound, num_leaves)
+    //   Trains the RMI on a key array chosen to meet an error bound (see
+    //   `ErrorBound`), so the leaves follow the shape of the data.
+    RMIModel(
+        const std::vector<Key>& input_keys, ErrorBound bound,
+        size_t num_leaves = 0
+    ) : BaseModel<Key>(input_keys, bound) {
+        _build_root(num_leaves > 0 ? num_leaves : this->_key_array.size());
+        _build_leaves();
+        this->_key_array.resize(0);
+    }
+
+    // _fit(first, last)
+    //   Least-squares fit of the CDF over the key array entries in
+    //   [first, last). The slope is never negative, since the keys are sorted.
+    SlopeBiasPair _fit(size_t first, size_t last) {
+        size_t count = last - first;
+        double mean_key = 0.0;
+        double mean_cdf = 0.0;
+        for (size_t i = first; i < last; ++i) {
+            mean_key += double(this->_key_array[i].first) / count;
+            mean_cdf += this->_key_array[i].second / count;
+        }
+
+        // Centered sums keep precision for large keys.
+        double covariance = 0.0;
+        double variance = 0.0;
+        for (size_t i = first; i < last; ++i) {
+            double dx = double(this->_key_array[i].first) - mean_key;
+            covariance += dx * (this->_key_array[i].second - mean_cdf);
+            variance += dx * dx;
+        }
+
+        double slope = variance > 0.0 ? covariance / variance : 0.0;
+        slope = slope > 0.0 ? slope : 0.0;
+        return std::make_pair(slope, mean_cdf - slope * mean_key);
+    }
+
+    // _build_root(num_leaves)
+    //   Fits the root model over the whole key array and scales it to
+    //   predict a leaf index.
+    void _build_root(size_t num_leaves) {
+        SlopeBiasPair root = _fit(0, this->_key_array.size());
+        this->_root.resize(1);
+        this->_root[0] = std::make_pair(
+            root.first * num_leaves, root.second * num_leaves
+        );
+        this->_leaves.resize(num_leaves);
+    }
+
+    // _leaf_index(key)
+    //   Returns the leaf the root model routes `key` to.
+    size_t _leaf_index(Key key) const {
+        double position = this->_root[0].first * key + this->_root[0].second;
+        double last = double(this->_leaves.size() - 1);
+        return position <= 0.0 ? 0
+            : (position >= last ? this->_leaves.size() - 1 : size_t(position));
+    }
+
+    // _build_leaves()
+    //   Routes the key array through the root. Between two entries routed to
+    //   different leaves, the CDF is interpolated and split where the root
+    //   switches leaves. Every leaf is then the line between the split points
+    //   at either end of the keys routed to it. This line meets its neighbours
+    //   and spans its whole range, so no key is clamped to a flat stretch.
+    void _build_leaves() {
+        size_t size = this->_key_array.size();
+        size_t num_leaves = this->_leaves.size();
+
+        // The point the next leaf starts from, initially the origin as in the
+        // spline models (or the first entry, if it is not positive).
+        KeyCDFPoint start(
+            std::min(0.0, double(this->_key_array[0].first)), 0.0
+        );
+
+        size_t leaf = 0;        // the first leaf not yet built
+        size_t first = 0;
+        while (first < size) {
+            // Entries are routed in order, since the root is monotone.
+            size_t target = _leaf_index(this->_key_array[first].first);
+            size_t last = first + 1;
+            while (
+                last < size && _leaf_index(this->_key_array[last].first) == target
+            ) {
+                ++last;
+            }
+
+            // Empty leaves before the target cover part of the gap between
+            // the previous entry and this one.
+            for (; leaf < target; ++leaf) {
+                KeyCDFPoint end = _split_point(first, leaf + 1);
+                _build_leaf(leaf, start, end);
+                start = end;
+            }
+
+            // The target leaf ends within the gap after its last entry, or at
+            // the last entry itself.
+            KeyCDFPoint end = last < size ? _split_point(last, target + 1)
+                : KeyCDFPoint(
+                    double(this->_key_array[size - 1].first),
+                    this->_key_array[size - 1].second
+                );
+            _build_leaf(target, start, end);
+            start = end;
+
+            leaf = target + 1;
+            first = last;
+        }
+
+        // Leaves past the last entry predict its CDF.
+        for (; leaf < num_leaves; ++leaf) {
+            _build_leaf(leaf, start, start);
+        }
+    }
+
+    // _build_leaf(leaf, start, end)
+    //   Makes `leaf` the line from `start` to `end`, clamped to the CDFs at
+    //   both points.
+    void _build_leaf(size_t leaf, KeyCDFPoint start, KeyCDFPoint end) {
+        RMILeaf& model = this->_leaves[leaf];
+        double dx = end.first - start.first;
+        model.slope = dx > 0.0 ? (end.second - start.second) / dx : 0.0;
+        model.slope = model.slope > 0.0 ? model.slope : 0.0;
+        model.bias = end.second - model.slope * end.first;
+        model.lower = start.second;
+        model.upper = std::max(start.second, end.second);
+    }
+
+    // _split_point(index, leaf)
+    //   Returns the point, interpolated between key array entries `index - 1`
+    //   and `index`, where the root starts routing keys to `leaf`. Before the
+    //   first entry, it is interpolated from the origin (or the first entry,
+    //   if it is not positive), where _build_leaves() starts. A flat root,
+    //   as for keys that are all equal, routes every key to one leaf, so the
+    //   split is the entry itself rather than a division by zero.
+    KeyCDFPoint _split_point(size_t index, size_t leaf) {
+        double x_1 = double(this->_key_array[index].first);
+        double y_1 = this->_key_array[index].second;
+        if (!(this->_root[0].first > 0.0)) {
+            return KeyCDFPoint(x_1, y_1);
+        }
+        double x_0 = index > 0 ? double(this->_key_array[index - 1].first)
+            : std::min(0.0, x_1);
+        double y_0 = index > 0 ? this->_key_array[index - 1].second : 0.0;
+
+        double split = (leaf - this->_root[0].second) / this->_root[0].first;
+        double t = x_1 > x_0 ? (split - x_0) / (x_1 - x_0) : 1.0;
+        t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+        return KeyCDFPoint(x_0 + t * (x_1 - x_0), y_0 + t * (y_1 - y_0));
+    }
+
+    // predict(Key key)
+    //   Implements the `BaseModel`'s predict() function that takes an input key
+    //   and estimates its CDF.
+    double predict(Key key) const {
+        return _evaluate(_leaf_index(key), key);
+    }
+
+    // predict_batch(keys, n, out)
+    //   Predicts the CDFs of `n` keys into `out`. The leaves of a group of
+    //   keys are found and prefetched before any of them is evaluated, so
+    //   their cache misses overlap.
+    void predict_batch(const Key* keys, size_t n, double* out) const {
+        size_t leaves[PREDICT_GROUP_SIZE];
+        for (size_t first = 0; first < n; first += PREDICT_GROUP_SIZE) {
+            size_t count = std::min(n - first, size_t(PREDICT_GROUP_SIZE));
+            for (size_t i = 0; i < count; ++i) {
+                leaves[i] = _leaf_index(keys[first + i]);
+                __builtin_prefetch(&this->_leaves[leaves[i]]);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                out[first + i] = _evaluate(leaves[i], keys[first + i]);
+            }
+        }
+    }
+
+    // _evaluate(leaf, key)
+    //   Evaluates `leaf` at `key`.
+    double _evaluate(size_t leaf, Key key) const {
+        const RMILeaf& model = this->_leaves[leaf];
+        double ecdf = model.slope * key + model.bias;
+        return ecdf < model.lower ? model.lower
+            : (ecdf > model.upper ? model.upper : ecdf);
+    }
+
+    // size_bytes()
+    //   Returns the size of the RMI in bytes.
+    size_t size_bytes() const {
+        return sizeof(SlopeBiasPair) * this->_root.size()
+            + sizeof(RMILeaf) * this->_leaves.size();
+    }
+
+    // _save(writer)
+    //   Adds the root and the leaves to a SNARF file.
+    void _save(SNARFFileWriter& writer) const {
+        writer.add_section(this->_root);
+        writer.add_section(this->_leaves);
+    }
+
+    // _map(reader)
+    //   Points the model at its arrays in a mapped SNARF file.
+    void _map(SNARFFileReader& reader) {
+        reader.next_section(this->_root);
+        reader.next_section(this->_leaves);
+        if (this->_root.size() != 1 || this->_leaves.empty()) {
+            throw std::runtime_error("ERROR: SNARF file model is invalid.");
+        }
+    }
+
+    // print_model()
+    //   Implements a member function to print the RMI in human-readable format
+    //   for debugging purposes.
+    void print_model() const {
+        std::cout << "--------------------\n";
+        std::cout << "ROOT MODEL [Slope, Bias]\n";
+        std::cout << "[" << this->_root[0].first << ", "
+            << this->_root[0].second << "]";
+
+        std::cout << "\nLEAF MODELS [Slope, Bias, Lower, Upper]\n";
+        for (
+            auto it = this->_leaves.begin();
+            it != this->_leaves.end();
+            ++it
+        ) {
+            std::cout << "[" << it->slope << ", " << it->bias << ", "
+                << it->lower << ", " << it->upper << "]";
+        }
+        std::cout << "\n--------------------\n";
+    }
+};
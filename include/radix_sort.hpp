@@ -0,0 +1,198 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// Number of key bits sorted by one pass of the radix sort.
+#define RADIX_SORT_BITS 8
+// Number of keys below which std::sort is faster than the radix sort.
+#define RADIX_SORT_MIN_KEYS 1024
+// Number of keys one task of a parallel radix sort pass handles.
+#define PARALLEL_SORT_KEYS (1 << 16)
+
+
+// RadixSort
+//   Least-significant-digit radix sort of integer keys, `RADIX_SORT_BITS`
+//   bits per pass. Keys are mapped to unsigned integers of the same order,
+//   and the passes over digits that every key has in common are skipped, so
+//   keys from a narrow range take few passes. Each pass counts the digits
+//   of consecutive chunks of keys, possibly on the threads of a pool, and
+//   then scatters every chunk to its own place, which keeps the sort stable
+//   and the result independent of the number of threads.
+template <typename Key>
+struct RadixSort {
+    static_assert(
+        std::is_integral<Key>::value, "RadixSort requires integer keys."
+    );
+
+    typedef typename std::make_unsigned<Key>::type Radix;
+
+    static const size_t NUM_BUCKETS = size_t(1) << RADIX_SORT_BITS;
+
+    // sort(keys, pool)
+    //   Sorts `keys` in ascending order, on the threads of `pool` if given.
+    //   Uses a scratch buffer as large as the keys, released on return.
+    static void sort(std::vector<Key>& keys, ThreadPool* pool = nullptr) {
+        size_t size = keys.size();
+        if (size < RADIX_SORT_MIN_KEYS) {
+            std::sort(keys.begin(), keys.end());
+            return;
+        }
+
+        size_t chunk_size = pool == nullptr ? size : PARALLEL_SORT_KEYS;
+        size_t num_tasks = (size + chunk_size - 1) / chunk_size;
+        std::vector<size_t> counts(num_tasks * NUM_BUCKETS);
+        std::vector<Key> buffer(size);
+        const Key* from = keys.data();
+        Key* to = buffer.data();
+
+        Radix varying = _varying_bits(from, size, chunk_size, pool);
+        for (
+            size_t shift = 0;
+            shift < std::numeric_limits<Radix>::digits;
+            shift += RADIX_SORT_BITS
+        ) {
+            if (((varying >> shift) & (NUM_BUCKETS - 1)) == 0) {
+                continue;
+            }
+
+            // Count each chunk's digits.
+            _run(pool, num_tasks, [&](size_t task) {
+                size_t* count = &counts[task * NUM_BUCKETS];
+                std::fill(count, count + NUM_BUCKETS, 0);
+                size_t first = task * chunk_size;
+                size_t last = std::min(first + chunk_size, size);
+                for (size_t i = first; i < last; ++i) {
+                    ++count[_digit(from[i], shift)];
+                }
+            });
+
+            // Turn the counts into where each chunk's keys of each digit go:
+            // digit by digit, and within a digit chunk by chunk.
+            size_t position = 0;
+            for (size_t digit = 0; digit < NUM_BUCKETS; ++digit) {
+                for (size_t task = 0; task < num_tasks; ++task) {
+                    size_t count = counts[task * NUM_BUCKETS + digit];
+                    counts[task * NUM_BUCKETS + digit] = position;
+                    position += count;
+                }
+            }
+
+            _run(pool, num_tasks, [&](size_t task) {
+                size_t* next = &counts[task * NUM_BUCKETS];
+                size_t first = task * chunk_size;
+                size_t last = std::min(first + chunk_size, size);
+                for (size_t i = first; i < last; ++i) {
+                    to[next[_digit(from[i], shift)]++] = from[i];
+                }
+            });
+
+            from = to;
+            to = from == buffer.data() ? keys.data() : buffer.data();
+        }
+
+        // An odd number of passes leaves the keys in the buffer.
+        if (from == buffer.data()) {
+            keys.swap(buffer);
+        }
+    }
+
+    // _radix(key)
+    //   Maps a key to an unsigned integer of the same order, by flipping the
+    //   sign bit of signed keys.
+    static Radix _radix(Key key) {
+        Radix sign = std::is_signed<Key>::value
+            ? Radix(Radix(1) << (std::numeric_limits<Radix>::digits - 1))
+            : Radix(0);
+        return Radix(key) ^ sign;
+    }
+
+    // _digit(key, shift)
+    //   Returns the digit of `key` sorted by the pass at bit `shift`.
+    static size_t _digit(Key key, size_t shift) {
+        return (_radix(key) >> shift) & (NUM_BUCKETS - 1);
+    }
+
+    // _varying_bits(keys, size, chunk_size, pool)
+    //   Returns the bits in which some key differs from the first one, in
+    //   tasks of `chunk_size` keys.
+    static Radix _varying_bits(
+        const Key* keys, size_t size, size_t chunk_size, ThreadPool* pool
+    ) {
+        size_t num_tasks = (size + chunk_size - 1) / chunk_size;
+        std::vector<Radix> varying(num_tasks, 0);
+        Radix first_key = _radix(keys[0]);
+        _run(pool, num_tasks, [&](size_t task) {
+            Radix bits = 0;
+            size_t first = task * chunk_size;
+            size_t last = std::min(first + chunk_size, size);
+            for (size_t i = first; i < last; ++i) {
+                bits |= _radix(keys[i]) ^ first_key;
+            }
+            varying[task] = bits;
+        });
+
+        Radix bits = 0;
+        for (Radix task_bits : varying) {
+            bits |= task_bits;
+        }
+        return bits;
+    }
+
+    // _run(pool, num_tasks, task)
+    //   Calls `task(i)` for every i in [0, num_tasks), on the threads of
+    //   `pool` if given.
+    template <typename Task>
+    static void _run(ThreadPool* pool, size_t num_tasks, Task task) {
+        if (pool == nullptr) {
+            for (size_t i = 0; i < num_tasks; ++i) {
+                task(i);
+            }
+            return;
+        }
+        pool->run(num_tasks, task);
+    }
+};
+
+
+// _sort_keys(keys, pool, is_integral)
+//   Sorts integer keys with `RadixSort`, and any other keys with std::sort.
+template <typename Key>
+void _sort_keys(std::vector<Key>& keys, ThreadPool* pool, std::true_type) {
+    RadixSort<Key>::sort(keys, pool);
+}
+
+template <typename Key>
+void _sort_keys(std::vector<Key>& keys, ThreadPool*, std::false_type) {
+    std::sort(keys.begin(), keys.end());
+}
+
+
+// sort_keys(keys, unique, pool)
+//   Sorts `keys` in place, as the models and `SNARF` expect their input
+//   keys, and with `unique` removes duplicate keys. Integer keys are radix
+//   sorted, on the threads of `pool` if given.
+template <typename Key>
+void sort_keys(
+    std::vector<Key>& keys, bool unique = false, ThreadPool* pool = nullptr
+) {
+    _sort_keys(
+        keys, pool, std::integral_constant<
+            bool,
+            std::is_integral<Key>::value && !std::is_same<Key, bool>::value
+        >()
+    );
+    if (unique) {
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+}
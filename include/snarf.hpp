@@ -3,20 +3,110 @@
  * See LICENSE in the directory root for terms of use.
  */
 
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+
 #include "models/linear_spline_model.hpp"
+#include "models/rmi_model.hpp"
+#include "models/quadratic_spline_model.hpp"
+#include "models/cubic_spline_model.hpp"
+#include "models/logarithmic_spline_model.hpp"
+#include "models/exponential_spline_model.hpp"
+#include "models/mixed_spline_model.hpp"
+#include "models/compact_spline_model.hpp"
+#include "codecs/golomb_codec.hpp"
+#include "codecs/elias_fano_codec.hpp"
 #include "bit_array.hpp"
+#include "snarf_file.hpp"
+#include "thread_pool.hpp"
+#include "radix_sort.hpp"
+
+// Number of blocks that share one absolute offset in the block directory.
+#define SUPERBLOCK_SIZE 64
+// Size in bits of the header at the start of every cache-line block.
+#define LINE_HEADER_BITS 64
+// Number of keys whose locations are predicted in one batch.
+#define PREDICT_BATCH_SIZE 256
+// Number of range queries in flight in range_query_interleaved().
+#define INTERLEAVE_GROUP_SIZE 16
+// Number of cache lines of a block prefetched before it is scanned.
+#define INTERLEAVE_PREFETCH_LINES 4
+// Number of range queries in one task of range_query_parallel(). A multiple
+// of 64, so that tasks write whole words of the results.
+#define PARALLEL_CHUNK_SIZE 4096
+// Number of blocks one task of a parallel build encodes.
+#define PARALLEL_BUILD_BLOCKS 1024
+
+
+// BlockLayout
+//   How the Golomb-coded blocks are laid out in memory. The arena layout packs
+//   variable-length blocks back to back behind an offset directory. The line
+//   layouts give every block a fixed, aligned 64- or 128-byte line that starts
+//   with a header describing the block, so a query touches exactly one line.
+enum BlockLayout {
+    BLOCK_LAYOUT_ARENA = 0,
+    BLOCK_LAYOUT_LINE_64 = 64,
+    BLOCK_LAYOUT_LINE_128 = 128
+};
+
 
+// KeyOrder
+//   The order of the input keys given to a filter. Sorted keys are used as
+//   they are. Unsorted keys are sorted in place first, see sort_keys(), and
+//   optionally deduplicated.
+enum KeyOrder {
+    KEYS_SORTED = 0,
+    KEYS_UNSORTED = 1,
+    KEYS_UNSORTED_UNIQUE = 2
+};
 
-template <typename Key>
+
+// SNARF
+//   The learned range filter. `Model` estimates the CDF of a key and must be
+//   monotone, like `LinearSplineModel` or `RMIModel`; see `BaseModel` for the
+//   interface it provides. `Codec` encodes the key locations within each
+//   block; see `BaseCodec` for the interface it provides.
+template <
+    typename Key,
+    typename Model = LinearSplineModel<Key>,
+    typename Codec = GolombCodec
+>
 struct SNARF {
+    static_assert(
+        std::is_base_of<BaseModel<Key>, Model>::value,
+        "SNARF model must derive from BaseModel<Key>."
+    );
+
     // Underlying predictive model.
-    LinearSplineModel<Key> _model;
-    // Vector of bitsets used to store the underlying location index data.
-    std::vector<BitArray> _bitsets;
-    // Vector storing the number of keys in each bitset block.
-    std::vector<uint32_t> _keys_per_block;
-    // The total number of input keys.
+    Model _model;
+    // Encodes and decodes the key locations of a block.
+    Codec _codec;
+    // Single cache-aligned arena holding every encoded block back to back.
+    // In the line layouts it only holds blocks that overflow their line.
+    BitArray _blocks;
+    // Fixed-size, self-describing blocks, one per line (line layouts only).
+    BitArray _lines;
+    // Absolute bit offset of the first block of every `SUPERBLOCK_SIZE` blocks.
+    Storage<uint64_t> _superblock_offsets;
+    // Bit offset of each block relative to its superblock, plus a final entry
+    // marking the end of the last block. A block's key count is derived from
+    // its length, so no separate count is stored.
+    Storage<uint32_t> _block_offsets;
+    // The number of input keys the filter was built from, which sets the
+    // number of locations. Keys added by merged() or append() are not
+    // counted.
     size_t _num_keys;
+    // The number of keys added by append(), ranked after the input keys.
+    size_t _num_appended;
+    // The keys appended since the last one the model sampled, which the next
+    // append() predicts again. Not saved, as mapped filters take no appends.
+    std::vector<Key> _pending;
+    // Whether merged() added keys. A merged key past the spline's last fixed
+    // entry has the location the old tail of the spline gave it, which
+    // append() would move, so such a filter takes no appends.
+    bool _merged;
     // The scaling factor used to determine the false positive rate.
     size_t _scaling_factor;
     // The number of elements in each block.
@@ -25,20 +115,155 @@ struct SNARF {
     size_t _bitset_size;
     // The total number of blocks.
     size_t _total_blocks;
+    // The memory layout of the blocks.
+    BlockLayout _layout;
+    // The file the structure is mapped from, if any. Keeps the mapping alive
+    // for as long as the arrays above point into it.
+    std::shared_ptr<const MappedFile> _file;
 
-    // SNARF(input_Keys, bits_per_key, elements_per_block)
-    //   Constructor for the SNARF structure initializes the Golomb-coded bit
-    //   arrays. Assumes that the input keys are given in sorted order.
+    // SNARF(input_Keys, bits_per_key, block_size, R, layout, pool)
+    //   Constructor for the SNARF structure initializes the encoded bit
+    //   arrays. Assumes that the input keys are given in sorted order; see the
+    //   constructor taking a `KeyOrder` otherwise. With a line layout,
+    //   `block_size` is ignored and the number of keys per line is chosen
+    //   from `bits_per_key` instead. Given a `pool`, the key locations are
+    //   predicted and the blocks encoded on its threads, with the same
+    //   result.
     SNARF(
         const std::vector<Key>& input_keys,
         double bits_per_key,
         size_t block_size,
-        size_t R
+        size_t R,
+        BlockLayout layout = BLOCK_LAYOUT_ARENA,
+        ThreadPool* pool = nullptr
     ) :
         _model(input_keys, R),
         _num_keys(input_keys.size()),
-        _block_size(block_size)
+        _num_appended(0),
+        _merged(false),
+        _block_size(block_size),
+        _layout(layout)
+    {
+        _build(input_keys, bits_per_key, pool);
+    }
+
+    // SNARF(input_Keys, bits_per_key, block_size, bound, layout, pool)
+    //   Like the constructor above, but fits the model to an error bound
+    //   instead of sampling every R-th key; see `ErrorBound`.
+    SNARF(
+        const std::vector<Key>& input_keys,
+        double bits_per_key,
+        size_t block_size,
+        ErrorBound bound,
+        BlockLayout layout = BLOCK_LAYOUT_ARENA,
+        ThreadPool* pool = nullptr
+    ) :
+        _model(input_keys, bound),
+        _num_keys(input_keys.size()),
+        _num_appended(0),
+        _merged(false),
+        _block_size(block_size),
+        _layout(layout)
+    {
+        _build(input_keys, bits_per_key, pool);
+    }
+
+    // SNARF(input_keys, order, bits_per_key, block_size, fit, layout, pool)
+    //   Like the constructors above, fit to every R-th key or to an error
+    //   bound (`fit`), but takes the input keys in the given `order`. Unsorted
+    //   keys are sorted in place before the model is trained, on the threads
+    //   of `pool` if given, which leaves them sorted for the caller.
+    template <typename Fit>
+    SNARF(
+        std::vector<Key>& input_keys,
+        KeyOrder order,
+        double bits_per_key,
+        size_t block_size,
+        Fit fit,
+        BlockLayout layout = BLOCK_LAYOUT_ARENA,
+        ThreadPool* pool = nullptr
+    ) :
+        // `_model` is initialized first, so the keys are counted once
+        // sorted and deduplicated.
+        _model(_order_keys(input_keys, order, pool), fit),
+        _num_keys(input_keys.size()),
+        _num_appended(0),
+        _merged(false),
+        _block_size(block_size),
+        _layout(layout)
     {
+        _build(input_keys, bits_per_key, pool);
+    }
+
+    // SNARF()
+    //   Constructs an empty structure, to be filled in by map().
+    SNARF() : _num_appended(0), _merged(false) {}
+
+    // _build(input_keys, bits_per_key, pool)
+    //   Encodes the locations the trained model predicts for the input keys,
+    //   on the threads of `pool` if given. Each block's locations are
+    //   predicted and encoded in one go, so no more than a block of locations
+    //   is held at a time. The arena is sized by the first key of every
+    //   block, which is found first; lines have a fixed size.
+    void _build(
+        const std::vector<Key>& input_keys, double bits_per_key,
+        ThreadPool* pool
+    ) {
+        _set_parameters(bits_per_key);
+
+        if (this->_layout == BLOCK_LAYOUT_ARENA) {
+            std::vector<size_t> block_starts;
+            _find_block_starts(input_keys, block_starts, pool);
+            _build_arena(input_keys, block_starts, pool);
+        } else {
+            _build_lines(input_keys, pool);
+        }
+    }
+
+    // _order_keys(input_keys, order, pool)
+    //   Sorts the input keys in place unless `order` says they are sorted,
+    //   and returns them.
+    static const std::vector<Key>& _order_keys(
+        std::vector<Key>& input_keys, KeyOrder order, ThreadPool* pool
+    ) {
+        if (order != KEYS_SORTED) {
+            sort_keys(input_keys, order == KEYS_UNSORTED_UNIQUE, pool);
+        }
+        return input_keys;
+    }
+
+    // _for_each_chunk(pool, size, chunk_size, function)
+    //   Calls `function(first, last)` for consecutive chunks [first, last) of
+    //   `chunk_size` items covering [0, size), as tasks on the threads of
+    //   `pool`. Without a pool, calls it once for the whole range.
+    template <typename Function>
+    static void _for_each_chunk(
+        ThreadPool* pool, size_t size, size_t chunk_size, Function function
+    ) {
+        if (pool == nullptr) {
+            function(size_t(0), size);
+            return;
+        }
+        pool->run((size + chunk_size - 1) / chunk_size, [&](size_t chunk) {
+            size_t first = chunk * chunk_size;
+            function(first, std::min(first + chunk_size, size));
+        });
+    }
+
+    // set_search_layout(layout, radix_bits)
+    //   Chooses how the model searches its key array. The Eytzinger and radix
+    //   layouts speed up predictions for models with many segments (small
+    //   `R`); see `SearchLayout`.
+    void set_search_layout(
+        SearchLayout layout, size_t radix_bits = RADIX_TABLE_BITS
+    ) {
+        this->_model.set_search_layout(layout, radix_bits);
+    }
+
+    // _set_parameters(bits_per_key)
+    //   Derives the codec parameters and block geometry from the target bits
+    //   per key. Expects `_num_keys`, `_block_size` and `_layout` to be set.
+    void _set_parameters(double bits_per_key) {
         // Check if more than 3 bits per key.
         if (bits_per_key <= 3) {
             throw std::runtime_error("ERROR: Requires >3 bits per key.");
@@ -48,177 +273,806 @@ struct SNARF {
         double target_FPR = pow(0.5, bits_per_key - 3.0);
         this->_scaling_factor = pow(2, ceil(log2(1.0 / target_FPR)));
         this->_bitset_size = ceil(log2(1.0 / target_FPR));
+        if (this->_layout != BLOCK_LAYOUT_ARENA) {
+            this->_block_size = _keys_per_line();
+        }
         this->_total_blocks = ceil(_num_keys * 1.0 / this->_block_size);
+        _set_codec();
+    }
 
-        // Build Golomb compressed bit array of key locations.
-        std::vector<size_t> locations;
-        _set_locations(input_keys, locations);
-        _build_blocks(locations);
+    // _set_codec()
+    //   Configures the codec for the block geometry.
+    void _set_codec() {
+        this->_codec = Codec(
+            this->_bitset_size, this->_block_size * this->_scaling_factor
+        );
     }
 
-    // _set_locations(input_keys, locations)
-    //   Calculates and sets the bit array locations for input keys based on the
-    //   model's predictions. Assumes keys are in sorted order.
-    void _set_locations(
-        const std::vector<Key>& input_keys, std::vector<size_t>& locations
-    ) {
-        locations.clear();
-        locations.reserve(this->_num_keys);
+    // _predict_location(key)
+    //   Predicts the CDF of `key` and scales it to a location in the
+    //   uncompressed bit array. The model already clamps its prediction to
+    //   [0, 1], so truncating is a floor and only a CDF of 1 needs clamping.
+    //   CDFs past 1, of appended keys, are clamped to the appended blocks.
+    size_t _predict_location(const Key& key) const {
+        return _cdf_location(this->_model.predict(key));
+    }
 
-        // Collect the predicted location of every input key.
-        for (const auto& key : input_keys) {
-            double cdf = this->_model.predict(key);
+    // _cdf_location(cdf)
+    //   Scales a predicted CDF in [0, 1] to a location; see
+    //   _predict_location().
+    size_t _cdf_location(double cdf) const {
+        size_t num_locations = this->_num_keys * this->_scaling_factor;
+        size_t location = size_t(cdf * num_locations);
+        if (location < num_locations) {
+            return location;
+        }
+        if (cdf <= 1.0) {
+            return num_locations - 1;
+        }
+        size_t end = this->_total_blocks * this->_block_size
+            * this->_scaling_factor;
+        return location < end ? location : end - 1;
+    }
 
-            // Scale to the size of the uncompressed bit array.
-            size_t location = size_t(
-                floor(cdf * this->_num_keys * this->_scaling_factor)
-            );
-            location = std::min(
-                std::max(location, size_t(0)),
-                size_t(this->_num_keys * this->_scaling_factor - 1)
-            );
+    // _predict_locations(keys, n, locations)
+    //   Predicts the locations of `n` sorted keys into `locations`, in
+    //   batches (see the models' predict_batch()).
+    void _predict_locations(
+        const Key* keys, size_t n, size_t* locations
+    ) const {
+        double cdfs[PREDICT_BATCH_SIZE];
+        for (size_t first = 0; first < n; ) {
+            size_t count = std::min(n - first, size_t(PREDICT_BATCH_SIZE));
+            this->_model.predict_batch(keys + first, count, cdfs);
+            for (size_t i = 0; i < count; ++i) {
+                locations[first + i] = _cdf_location(cdfs[i]);
+            }
+            first += count;
+        }
+    }
 
-            locations.push_back(location);
+    // _first_key_at(input_keys, from, location, guess)
+    //   Returns the index of the first input key from `from` on whose
+    //   predicted location is at least `location`, or the number of keys.
+    //   Predicted locations never decrease, so it gallops away from `guess`
+    //   in the direction of the key and then binary searches, with few
+    //   predictions when the guess is close.
+    size_t _first_key_at(
+        const std::vector<Key>& input_keys, size_t from, size_t location,
+        size_t guess
+    ) const {
+        size_t size = input_keys.size();
+        guess = std::min(std::max(guess, from), size);
+        size_t low = guess;     // every key before is predicted lower
+        size_t high = guess;    // this key, if any, is predicted higher
+        if (guess < size && _predict_location(input_keys[guess]) < location) {
+            for (
+                size_t step = 1;
+                high < size && _predict_location(input_keys[high]) < location;
+                step <<= 1
+            ) {
+                low = high + 1;
+                high = low + step;
+            }
+            high = std::min(high, size);
+        } else {
+            for (size_t step = 1; low > from; step <<= 1) {
+                size_t probe = low - std::min(step, low - from);
+                if (_predict_location(input_keys[probe]) < location) {
+                    low = probe + 1;
+                    break;
+                }
+                low = high = probe;
+            }
+        }
+        while (low < high) {
+            size_t middle = low + ((high - low) >> 1);
+            if (_predict_location(input_keys[middle]) < location) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
         }
+        return low;
+    }
+
+    // _find_block_starts(input_keys, block_starts, pool)
+    //   Finds the first key of each block, with a final entry for the number
+    //   of keys, in tasks of `PARALLEL_BUILD_BLOCKS` blocks on the threads of
+    //   `pool` if given. Blocks hold `_block_size` keys on average, so the
+    //   search for each start begins that far past the previous one.
+    void _find_block_starts(
+        const std::vector<Key>& input_keys, std::vector<size_t>& block_starts,
+        ThreadPool* pool = nullptr
+    ) const {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        block_starts.resize(this->_total_blocks + 1);
+        _for_each_chunk(
+            pool, this->_total_blocks, PARALLEL_BUILD_BLOCKS,
+            [&](size_t first, size_t last) {
+                size_t start = 0;
+                for (size_t i = first; i < last; ++i) {
+                    size_t guess = i == first
+                        ? first * this->_block_size
+                        : start + this->_block_size;
+                    start = _first_key_at(
+                        input_keys, start, i * block_range, guess
+                    );
+                    block_starts[i] = start;
+                }
+            }
+        );
+        block_starts[this->_total_blocks] = input_keys.size();
     }
 
-    // _create_gcs_block(batch, block)
-    //   Encodes a batch of key locations into a GCS block within the input bit
-    //   array.
-    void _create_gcs_block(const std::vector<size_t>& batch, BitArray& block) {
-        // Initialize bit block with sufficient size for everything in batch.
-        block = BitArray(
-            (this->_bitset_size + 1) * batch.size() + this->_block_size
+    // _for_each_block(input_keys, first, last, function)
+    //   Calls `function(block_index, key_index, locations)` for each of the
+    //   blocks [first, last) in order, with the index of its first key and
+    //   the locations of its keys. The keys are predicted in batches from
+    //   the first one of block `first` on, and only the current block's
+    //   locations are held.
+    template <typename Function>
+    void _for_each_block(
+        const std::vector<Key>& input_keys, size_t first, size_t last,
+        Function function
+    ) const {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t end_location = last * block_range;
+        size_t size = input_keys.size();
+        size_t index = _first_key_at(
+            input_keys, 0, first * block_range, first * this->_block_size
         );
+        size_t block_index = first;
+        size_t block_start = index;
+        std::vector<size_t> locations;
+        double cdfs[PREDICT_BATCH_SIZE];
+        while (index < size) {
+            size_t count = std::min(size - index, size_t(PREDICT_BATCH_SIZE));
+            this->_model.predict_batch(input_keys.data() + index, count, cdfs);
+            size_t i = 0;
+            for (; i < count; ++i) {
+                size_t location = _cdf_location(cdfs[i]);
+                if (location >= end_location) {
+                    break;
+                }
+                while (location >= (block_index + 1) * block_range) {
+                    function(block_index, block_start, locations);
+                    locations.clear();
+                    ++block_index;
+                    block_start = index + i;
+                }
+                locations.push_back(location);
+            }
+            index += i;
+            if (i < count) {
+                break;
+            }
+        }
+
+        // The last blocks, which may be empty.
+        for (; block_index < last; ++block_index) {
+            function(block_index, block_start, locations);
+            locations.clear();
+            block_start = index;
+        }
+    }
 
+    // _block_bits(num_keys)
+    //   Returns the encoded size in bits of a block holding `num_keys` keys.
+    size_t _block_bits(size_t num_keys) const {
+        return this->_codec.block_bits(num_keys);
+    }
+
+    // _line_bits()
+    //   Returns the size in bits of one line in a line layout.
+    size_t _line_bits() const {
+        return size_t(this->_layout) * 8;
+    }
+
+    // _keys_per_line()
+    //   Chooses the expected number of keys per line so that a line is about
+    //   80% full on average. A key costs `_bitset_size + 2` bits on average (a
+    //   remainder, a terminating '1' and one '0'), and the slack absorbs the
+    //   natural variation in how many keys land in a line.
+    size_t _keys_per_line() const {
+        size_t capacity = _line_bits() - LINE_HEADER_BITS;
+        size_t keys = capacity * 4 / (5 * (this->_bitset_size + 2));
+        return keys > 0 ? keys : 1;
+    }
+
+    // _block_offset(block_index)
+    //   Returns the absolute bit offset of a block within the arena. Passing
+    //   `_total_blocks` returns the end of the last block.
+    size_t _block_offset(size_t block_index) const {
+        return this->_superblock_offsets[block_index / SUPERBLOCK_SIZE]
+            + this->_block_offsets[block_index];
+    }
+
+    // _set_block_offset(block_index, offset)
+    //   Records the absolute bit offset of a block in the directory. Blocks
+    //   must be recorded in order, since the first block of a superblock sets
+    //   the superblock's offset.
+    void _set_block_offset(size_t block_index, size_t offset) {
+        if (block_index % SUPERBLOCK_SIZE == 0) {
+            this->_superblock_offsets[block_index / SUPERBLOCK_SIZE] = offset;
+        }
+
+        size_t relative = offset
+            - this->_superblock_offsets[block_index / SUPERBLOCK_SIZE];
+        if (relative > UINT32_MAX) {
+            throw std::runtime_error(
+                "ERROR: Block directory overflow, too many keys per block."
+            );
+        }
+        this->_block_offsets[block_index] = static_cast<uint32_t>(relative);
+    }
+
+    // _block_num_keys(offset, end)
+    //   Returns the number of keys stored in the block spanning bits
+    //   [offset, end) of the arena.
+    size_t _block_num_keys(size_t offset, size_t end) const {
+        return this->_codec.block_num_keys(this->_blocks, offset, end);
+    }
+
+    // _build_arena(input_keys, block_starts, pool)
+    //   Lays out the blocks back to back in the arena. The block directory is
+    //   computed first so that the arena is allocated once and every block is
+    //   encoded in place. With a `pool`, every chunk of blocks is encoded
+    //   into a bit array of its own, aligned like the arena, whose words are
+    //   copied in. The first and last words of a chunk may hold bits of the
+    //   neighbouring chunks, so they are merged in afterwards.
+    void _build_arena(
+        const std::vector<Key>& input_keys,
+        const std::vector<size_t>& block_starts,
+        ThreadPool* pool = nullptr
+    ) {
+        // Lay out the blocks back to back and record the directory.
+        this->_superblock_offsets.resize(
+            this->_total_blocks / SUPERBLOCK_SIZE + 1
+        );
+        this->_block_offsets.resize(this->_total_blocks + 1);
         size_t offset = 0;
+        for (size_t i = 0; i <= this->_total_blocks; ++i) {
+            _set_block_offset(i, offset);
+            if (i < this->_total_blocks) {
+                offset += _block_bits(block_starts[i + 1] - block_starts[i]);
+            }
+        }
 
-        // Write the binary codes for each key continuously.
-        for (auto location : batch) {
-            block.write_bits(
-                offset, location % this->_scaling_factor, this->_bitset_size
+        // Allocate the arena once and encode each block into it.
+        this->_blocks = BitArray(offset);
+        if (pool == nullptr) {
+            _encode_arena_blocks(
+                input_keys, 0, this->_total_blocks, this->_blocks, 0
             );
-            offset += this->_bitset_size;
+            return;
         }
 
-        // Write the unary codes for each key continuously.
-        size_t delta_zero = 0;
-        for (size_t location : batch) {
-            size_t unary_part = location / this->_scaling_factor;
+        size_t num_chunks = (this->_total_blocks + PARALLEL_BUILD_BLOCKS - 1)
+            / PARALLEL_BUILD_BLOCKS;
+        std::vector<uint64_t> edge_words(2 * num_chunks, 0);
+        _for_each_chunk(
+            pool, this->_total_blocks, PARALLEL_BUILD_BLOCKS,
+            [&](size_t first, size_t last) {
+                size_t begin = _block_offset(first);
+                size_t end = _block_offset(last);
+                if (begin == end) {
+                    return;
+                }
+                size_t base = begin & ~size_t(63);
+                BitArray chunk(end - base);
+                _encode_arena_blocks(input_keys, first, last, chunk, base);
 
-            // Write the zeros.
-            while (delta_zero < unary_part) {
-                block.write_bits(offset++, 0, 1);
-                ++delta_zero;
+                size_t first_word = begin >> 6;
+                size_t last_word = (end - 1) >> 6;
+                for (size_t word = first_word + 1; word < last_word; ++word) {
+                    this->_blocks._words[word] =
+                        chunk._words[word - first_word];
+                }
+                size_t index = first / PARALLEL_BUILD_BLOCKS;
+                edge_words[2 * index] = chunk._words[0];
+                edge_words[2 * index + 1] =
+                    chunk._words[last_word - first_word];
             }
+        );
 
-            // Write the terminating one for the unary code.
-            block.write_bits(offset++, 1, 1);
+        for (size_t index = 0; index < num_chunks; ++index) {
+            size_t first = index * PARALLEL_BUILD_BLOCKS;
+            size_t last = std::min(
+                first + PARALLEL_BUILD_BLOCKS, this->_total_blocks
+            );
+            size_t begin = _block_offset(first);
+            size_t end = _block_offset(last);
+            if (begin < end) {
+                this->_blocks._words[begin >> 6] |= edge_words[2 * index];
+                this->_blocks._words[(end - 1) >> 6] |=
+                    edge_words[2 * index + 1];
+            }
         }
     }
 
-    // _build_bit_blocks(locations)
-    //   Constructs Golomb-coded bit blocks from sorted locations of input keys.
-    void _build_blocks(const std::vector<size_t>& locations) {
-        std::vector<size_t> batch;  // locations for current block
-        size_t batch_count = ceil(locations.size() * 1.0 / this->_block_size);
+    // _encode_arena_blocks(input_keys, first, last, bits, base)
+    //   Predicts and encodes blocks [first, last) into `bits`, which holds the
+    //   arena from bit `base` on.
+    void _encode_arena_blocks(
+        const std::vector<Key>& input_keys, size_t first, size_t last,
+        BitArray& bits, size_t base
+    ) const {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        _for_each_block(input_keys, first, last, [&](
+            size_t block_index, size_t, const std::vector<size_t>& locations
+        ) {
+            this->_codec.encode(
+                locations.data(), locations.data() + locations.size(),
+                block_index * block_range, bits,
+                _block_offset(block_index) - base
+            );
+        });
+    }
 
-        // Initialize bitset array and key count vectors.
-        size_t index = 0;
-        this->_bitsets.resize(this->_total_blocks);
-        this->_keys_per_block.resize(batch_count, 0);
+    // _build_lines(input_keys, pool)
+    //   Encodes every block into its own line, behind a 64-bit header. A
+    //   header is either
+    //     [0] = 0 | [1, 64) key count
+    //   for a block stored in its line, or
+    //     [0] = 1 | [1, 64) bit offset of the block in the overflow arena
+    //   for a block with too many keys to fit. An overflow block starts with a
+    //   64-bit key count followed by the usual encoding. Lines are whole
+    //   words, so with a `pool` they are encoded on its threads. The few
+    //   overflow blocks are only counted there, and predicted again and
+    //   encoded after, once the size of the overflow arena is known.
+    void _build_lines(
+        const std::vector<Key>& input_keys, ThreadPool* pool = nullptr
+    ) {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t capacity = _line_bits() - LINE_HEADER_BITS;
+        this->_lines = BitArray(this->_total_blocks * _line_bits());
 
-        // Fill each block with keys based on their locations
-        for (size_t i = 0; i < batch_count; ++i) {
-            batch.resize(0);
-            size_t lower_bound = i * this->_block_size * this->_scaling_factor;
-            size_t upper_bound = (i + 1) * this->_block_size
-                * this->_scaling_factor;
+        // The first key of every overflow block, by chunk of blocks. Their
+        // headers hold their key counts until they are placed.
+        size_t num_chunks = (this->_total_blocks + PARALLEL_BUILD_BLOCKS - 1)
+            / PARALLEL_BUILD_BLOCKS;
+        std::vector<std::vector<std::pair<size_t, size_t> > > overflow_blocks(
+            num_chunks
+        );
+        _for_each_chunk(
+            pool, this->_total_blocks, PARALLEL_BUILD_BLOCKS,
+            [&](size_t first, size_t last) {
+                auto& overflow = overflow_blocks[first / PARALLEL_BUILD_BLOCKS];
+                _for_each_block(input_keys, first, last, [&](
+                    size_t block_index, size_t key_index,
+                    const std::vector<size_t>& locations
+                ) {
+                    size_t line = block_index * _line_bits();
+                    this->_lines.write_bits(line, locations.size() << 1, 64);
+                    if (_block_bits(locations.size()) > capacity) {
+                        overflow.push_back(std::make_pair(
+                            block_index, key_index
+                        ));
+                        return;
+                    }
+                    this->_codec.encode(
+                        locations.data(), locations.data() + locations.size(),
+                        block_index * block_range, this->_lines,
+                        line + LINE_HEADER_BITS
+                    );
+                });
+            }
+        );
 
-            // Collect locations that fall within the current block's range.
-            while (
-                index < locations.size() &&
-                lower_bound <= locations[index] &&
-                locations[index] < upper_bound
-            ) {
-                // Adjust location relative to start of the block.
-                batch.push_back(locations[index++] - lower_bound);
+        // Size the overflow arena, allocate it once, and encode the overflow
+        // blocks into it.
+        size_t overflow_bits = 0;
+        for (const auto& overflow : overflow_blocks) {
+            for (const auto& block : overflow) {
+                size_t line = block.first * _line_bits();
+                size_t num_keys = this->_lines.read_bits(line, 64) >> 1;
+                overflow_bits += 64 + _block_bits(num_keys);
             }
+        }
+        this->_blocks = BitArray(overflow_bits);
 
-            // Create Golomb-coded bit block for the current batch of locations.
-            _create_gcs_block(batch, this->_bitsets[i]);
-            // Record the number of keys encoded in the current block.
-            this->_keys_per_block[i] = static_cast<uint32_t>(batch.size());
+        size_t overflow_offset = 0;
+        std::vector<size_t> locations;
+        for (const auto& overflow : overflow_blocks) {
+            for (const auto& block : overflow) {
+                size_t line = block.first * _line_bits();
+                locations.resize(this->_lines.read_bits(line, 64) >> 1);
+                _predict_locations(
+                    input_keys.data() + block.second, locations.size(),
+                    locations.data()
+                );
+                this->_lines.write_bits(line, (overflow_offset << 1) | 1, 64);
+                this->_blocks.write_bits(
+                    overflow_offset, locations.size(), 64
+                );
+                this->_codec.encode(
+                    locations.data(), locations.data() + locations.size(),
+                    block.first * block_range, this->_blocks,
+                    overflow_offset + 64
+                );
+                overflow_offset += 64 + _block_bits(locations.size());
+            }
         }
     }
 
-    // _query_block(lower_location, upper_location, bitset, num_keys_read)
-    //   Checks if a specific block contains any key within the specified range
-    //   [lower_location, upper_location].
-    bool _range_query_in_block(
-        size_t lower_location,
-        size_t upper_location,
-        BitArray& bitset,
-        size_t num_keys_read
+    // merged(keys)
+    //   Returns a copy of the filter with the sorted `keys` added. The model
+    //   is kept, so the keys already in the filter keep their locations: only
+    //   the blocks the new keys fall in are decoded, merged with their
+    //   locations and encoded again, and every other block is copied bit for
+    //   bit. As the blocks fill up, the false positive rate grows with the
+    //   share of merged keys, until the filter is built again from all keys.
+    //   The result is laid out in new storage, so every unchanged block is
+    //   still copied: a merge takes time in proportion to the filter size,
+    //   not to the number of new keys, though far less than a rebuild. The
+    //   result cannot be appended to (see append()).
+    SNARF merged(const std::vector<Key>& keys) const {
+        SNARF result;
+        result._model = this->_model;
+        result._codec = this->_codec;
+        result._num_keys = this->_num_keys;
+        result._num_appended = this->_num_appended;
+        result._pending = this->_pending;
+        result._merged = this->_merged || !keys.empty();
+        result._scaling_factor = this->_scaling_factor;
+        result._block_size = this->_block_size;
+        result._bitset_size = this->_bitset_size;
+        result._total_blocks = this->_total_blocks;
+        result._layout = this->_layout;
+        result._file = this->_file;
+
+        std::vector<size_t> locations(keys.size());
+        _predict_locations(keys.data(), keys.size(), locations.data());
+        result._merge_blocks(*this, locations);
+        return result;
+    }
+
+    // _merge_blocks(source, locations)
+    //   Lays out the blocks of `source`, an otherwise identical filter, with
+    //   the sorted `locations` added. The sizes of all blocks are found first,
+    //   so that the arena is allocated once.
+    void _merge_blocks(
+        const SNARF& source, const std::vector<size_t>& locations
     ) {
-        size_t offset_binary = 0;
-        size_t offset_unary = num_keys_read * this->_bitset_size;
-        size_t delta_zero = 0;
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t capacity = _line_bits() - LINE_HEADER_BITS;
+        bool arena = this->_layout == BLOCK_LAYOUT_ARENA;
 
-        // Iterate over every key (at most num_keys_read) in the block.
-        for (size_t i = 0; i < num_keys_read; ++i) {
-            // Get the unary bit.
-            size_t unary_part = bitset.read_bit(offset_unary++);
+        // The first new location of each block, with a final entry.
+        std::vector<size_t> added(this->_total_blocks + 1);
+        size_t next = 0;
+        for (size_t i = 0; i < this->_total_blocks; ++i) {
+            added[i] = next;
+            size_t end = (i + 1) * block_range;
+            while (next < locations.size() && locations[next] < end) {
+                ++next;
+            }
+        }
+        added[this->_total_blocks] = locations.size();
 
-            // Check if at the end of the unary bit for key (i.e. == 1).
-            if (
-                unary_part &&
-                ((delta_zero + 1) * this->_scaling_factor >= lower_location) &&
-                (upper_location >= delta_zero * this->_scaling_factor)
-            ) {
-                // Reconstruct the original location value.
-                size_t value = delta_zero * this->_scaling_factor
-                    + bitset.read_bits(offset_binary, this->_bitset_size);
+        // Size the blocks and the arena they go in: all of them, or only
+        // those that overflow their line.
+        if (arena) {
+            this->_superblock_offsets.resize(
+                this->_total_blocks / SUPERBLOCK_SIZE + 1
+            );
+            this->_block_offsets.resize(this->_total_blocks + 1);
+        } else {
+            this->_lines = BitArray(this->_total_blocks * _line_bits());
+        }
+        size_t arena_bits = 0;
+        for (size_t i = 0; i < this->_total_blocks; ++i) {
+            size_t offset, num_keys;
+            source._locate_block(i, offset, num_keys);
+            size_t bits = _block_bits(num_keys + added[i + 1] - added[i]);
+            if (arena) {
+                _set_block_offset(i, arena_bits);
+                arena_bits += bits;
+            } else if (bits > capacity) {
+                arena_bits += 64 + bits;
+            }
+        }
+        if (arena) {
+            _set_block_offset(this->_total_blocks, arena_bits);
+        }
+        this->_blocks = BitArray(arena_bits);
+
+        // Copy the blocks without new locations, and merge the others.
+        size_t overflow_offset = 0;
+        std::vector<size_t> old_locations, merged_locations;
+        for (size_t i = 0; i < this->_total_blocks; ++i) {
+            size_t offset, num_keys;
+            const BitArray& bits = source._locate_block(i, offset, num_keys);
+            size_t merged_keys = num_keys + added[i + 1] - added[i];
 
-                // Check if the location is between the range query.
-                if (value >= lower_location && value <= upper_location) {
-                    return true;
+            BitArray* target = &this->_blocks;
+            size_t target_offset = arena ? _block_offset(i) : 0;
+            if (!arena) {
+                size_t line = i * _line_bits();
+                if (_block_bits(merged_keys) > capacity) {
+                    this->_lines.write_bits(
+                        line, (overflow_offset << 1) | 1, 64
+                    );
+                    this->_blocks.write_bits(overflow_offset, merged_keys, 64);
+                    target_offset = overflow_offset + 64;
+                    overflow_offset += 64 + _block_bits(merged_keys);
+                } else {
+                    this->_lines.write_bits(line, merged_keys << 1, 64);
+                    target = &this->_lines;
+                    target_offset = line + LINE_HEADER_BITS;
                 }
             }
 
-            delta_zero += (1 - unary_part); // update number of '0's seen.
-            i -= (1 - unary_part);  // determine if need to loop to next '0'.
-            offset_binary += (unary_part * this->_bitset_size);
+            if (added[i + 1] == added[i]) {
+                target->copy_bits(
+                    bits, offset, target_offset, _block_bits(num_keys)
+                );
+                continue;
+            }
+            old_locations.resize(num_keys);
+            this->_codec.decode(bits, offset, num_keys, old_locations.data());
+            for (size_t& location : old_locations) {
+                location += i * block_range;
+            }
+            merged_locations.resize(merged_keys);
+            std::merge(
+                old_locations.begin(), old_locations.end(),
+                locations.begin() + added[i], locations.begin() + added[i + 1],
+                merged_locations.begin()
+            );
+            this->_codec.encode(
+                merged_locations.data(), merged_locations.data() + merged_keys,
+                i * block_range, *target, target_offset
+            );
         }
-
-        return false;   // no key locations found within this range
     }
 
-    // range_query(lower, upper)
-    //   Performs a range query to check if any key within the specified range
-    //   [lower, upper] exists.
-    bool range_query(const Key& lower, const Key& upper) {
-        // Calculate the approximate locations for the query range.
-        double lower_cdf = this->_model.predict(lower);
-        double upper_cdf = this->_model.predict(upper);
+    // append(keys, R)
+    //   Adds the strictly increasing `keys`, all greater than the keys
+    //   already in the filter, as time-series or log-sequence keys are. The
+    //   keys are ranked right after the keys before them, filling the last
+    //   block's remaining ranks. The model's spline is extended past its
+    //   last key (see LinearSplineModel::append()), taking every R-th
+    //   appended key across calls, so a call of fewer than R keys moves the
+    //   spline's last entry instead of adding one. The keys appended since
+    //   the last R-th key are kept in `_pending` to be predicted again when
+    //   that entry moves. Only the blocks from the first of their locations
+    //   on are encoded again, which leaves the rest of the blocks and
+    //   segments untouched: an append costs time in proportion to the number
+    //   of keys plus R and a block, amortized over the growth of the arrays.
+    //   Requires a model that supports appending, its sorted search layout,
+    //   and a filter that is not mapped and has no keys added by merged():
+    //   those are not tracked, so they could not be predicted again.
+    void append(const std::vector<Key>& keys, size_t R) {
+        if (keys.empty()) {
+            return;
+        }
+        if (this->_merged) {
+            throw std::runtime_error(
+                "ERROR: Cannot append to a filter with merged keys."
+            );
+        }
+        if (!this->_pending.empty() && !(this->_pending.back() < keys[0])) {
+            throw std::runtime_error(
+                "ERROR: Appended keys must be greater than the model's keys."
+            );
+        }
+
+        // The pending keys are predicted again with the extended spline, so
+        // their old locations are dropped from the blocks.
+        std::vector<Key> extended(this->_pending);
+        extended.insert(extended.end(), keys.begin(), keys.end());
+        std::vector<size_t> old_locations(this->_pending.size());
+        _predict_locations(
+            this->_pending.data(), this->_pending.size(), old_locations.data()
+        );
+        size_t first_rank = this->_num_keys + this->_num_appended
+            - this->_pending.size() + 1;
+        this->_model.append(
+            extended, first_rank, this->_num_keys, R, !this->_pending.empty()
+        );
+        this->_num_appended += keys.size();
+        this->_pending.assign(
+            extended.end() - extended.size() % R, extended.end()
+        );
 
-        size_t lower_location = floor(
-            lower_cdf * this->_num_keys * this->_scaling_factor
+        // The last key is at location (_num_keys + _num_appended) times the
+        // scaling factor, in the block after as many full blocks.
+        size_t old_blocks = this->_total_blocks;
+        this->_total_blocks = std::max(
+            old_blocks,
+            (this->_num_keys + this->_num_appended) / this->_block_size + 1
         );
-        size_t upper_location = floor(
-            upper_cdf * this->_num_keys * this->_scaling_factor
+        std::vector<size_t> new_locations(extended.size());
+        _predict_locations(
+            extended.data(), extended.size(), new_locations.data()
         );
 
-        // Ensure the locations are within bounds.
-        lower_location = std::min(
-            std::max(lower_location, size_t(0)),
-            this->_num_keys * this->_scaling_factor - 1
+        // Decode the blocks from the first old or new location on, and
+        // replace the old locations with the new ones.
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t first_location = new_locations[0];
+        if (!old_locations.empty()) {
+            first_location = std::min(first_location, old_locations[0]);
+        }
+        size_t first_block = std::min(first_location / block_range, old_blocks);
+        std::vector<size_t> decoded;
+        for (size_t i = first_block; i < old_blocks; ++i) {
+            size_t offset, num_keys;
+            const BitArray& bits = _locate_block(i, offset, num_keys);
+            size_t start = decoded.size();
+            decoded.resize(start + num_keys);
+            this->_codec.decode(
+                bits, offset, num_keys, decoded.data() + start
+            );
+            for (size_t j = start; j < decoded.size(); ++j) {
+                decoded[j] += i * block_range;
+            }
+        }
+        std::vector<size_t> kept;
+        std::set_difference(
+            decoded.begin(), decoded.end(),
+            old_locations.begin(), old_locations.end(),
+            std::back_inserter(kept)
         );
-        upper_location = std::min(
-            std::max(upper_location, size_t(0)),
-            this->_num_keys * this->_scaling_factor - 1
+        std::vector<size_t> locations(kept.size() + new_locations.size());
+        std::merge(
+            kept.begin(), kept.end(),
+            new_locations.begin(), new_locations.end(), locations.begin()
         );
 
+        if (this->_layout == BLOCK_LAYOUT_ARENA) {
+            _append_arena(first_block, locations);
+        } else {
+            _append_lines(first_block, locations);
+        }
+    }
+
+    // _append_arena(first_block, locations)
+    //   Encodes the sorted `locations` into the blocks from `first_block` on,
+    //   in place of what they held: the arena is cut at the first of them,
+    //   which are the last blocks in it, and grown to hold them again.
+    void _append_arena(
+        size_t first_block, const std::vector<size_t>& locations
+    ) {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t offset = _block_offset(first_block);
+        this->_blocks._initialize_bit_array(offset);
+        this->_superblock_offsets.resize(
+            this->_total_blocks / SUPERBLOCK_SIZE + 1
+        );
+        this->_block_offsets.resize(this->_total_blocks + 1);
+
+        // The first location of each block, with a final entry.
+        std::vector<size_t> starts(this->_total_blocks - first_block + 1);
+        size_t next = 0;
+        for (size_t i = first_block; i < this->_total_blocks; ++i) {
+            starts[i - first_block] = next;
+            size_t end = (i + 1) * block_range;
+            while (next < locations.size() && locations[next] < end) {
+                ++next;
+            }
+            _set_block_offset(i, offset);
+            offset += _block_bits(next - starts[i - first_block]);
+        }
+        starts.back() = locations.size();
+        _set_block_offset(this->_total_blocks, offset);
+
+        this->_blocks._initialize_bit_array(offset);
+        for (size_t i = first_block; i < this->_total_blocks; ++i) {
+            this->_codec.encode(
+                locations.data() + starts[i - first_block],
+                locations.data() + starts[i - first_block + 1],
+                i * block_range, this->_blocks, _block_offset(i)
+            );
+        }
+    }
+
+    // _append_lines(first_block, locations)
+    //   Encodes the sorted `locations` into the lines from `first_block` on,
+    //   in place of what they held, as _build_lines() does. Overflow blocks
+    //   are laid out in block order, so the overflow arena is cut at the
+    //   first one of these lines and theirs are placed after the rest.
+    void _append_lines(
+        size_t first_block, const std::vector<size_t>& locations
+    ) {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t capacity = _line_bits() - LINE_HEADER_BITS;
+        size_t old_blocks = this->_lines.size() / _line_bits();
+        size_t overflow_end = this->_blocks.size();
+        for (size_t i = first_block; i < old_blocks; ++i) {
+            uint64_t header = this->_lines.read_bits(i * _line_bits(), 64);
+            if (header & 1) {
+                overflow_end = std::min(overflow_end, size_t(header >> 1));
+            }
+        }
+        this->_blocks._initialize_bit_array(overflow_end);
+        this->_lines._initialize_bit_array(first_block * _line_bits());
+        this->_lines._initialize_bit_array(
+            this->_total_blocks * _line_bits()
+        );
+
+        size_t next = 0;
+        for (size_t i = first_block; i < this->_total_blocks; ++i) {
+            size_t start = next;
+            size_t end = (i + 1) * block_range;
+            while (next < locations.size() && locations[next] < end) {
+                ++next;
+            }
+            size_t num_keys = next - start;
+            size_t line = i * _line_bits();
+            size_t bits = _block_bits(num_keys);
+            BitArray* target = &this->_lines;
+            size_t offset = line + LINE_HEADER_BITS;
+            if (bits > capacity) {
+                size_t overflow_offset = this->_blocks.size();
+                this->_blocks._initialize_bit_array(
+                    overflow_offset + 64 + bits
+                );
+                this->_lines.write_bits(line, (overflow_offset << 1) | 1, 64);
+                this->_blocks.write_bits(overflow_offset, num_keys, 64);
+                target = &this->_blocks;
+                offset = overflow_offset + 64;
+            } else {
+                this->_lines.write_bits(line, num_keys << 1, 64);
+            }
+            this->_codec.encode(
+                locations.data() + start, locations.data() + next,
+                i * block_range, *target, offset
+            );
+        }
+    }
+
+    // _locate_block(block_index, offset, num_keys)
+    //   Finds a block according to the layout. Returns the bit array it is
+    //   encoded in, and sets its bit offset there and its key count.
+    const BitArray& _locate_block(
+        size_t block_index, size_t& offset, size_t& num_keys
+    ) const {
+        if (this->_layout == BLOCK_LAYOUT_ARENA) {
+            offset = _block_offset(block_index);
+            num_keys = _block_num_keys(offset, _block_offset(block_index + 1));
+            return this->_blocks;
+        }
+
+        // Line layouts: everything needed is in the line's header.
+        size_t line = block_index * _line_bits();
+        uint64_t header = this->_lines.read_bits(line, 64);
+        if (header & 1) {
+            offset = (header >> 1) + 64;
+            num_keys = this->_blocks.read_bits(header >> 1, 64);
+            return this->_blocks;
+        }
+        offset = line + LINE_HEADER_BITS;
+        num_keys = header >> 1;
+        return this->_lines;
+    }
+
+    // _range_query_in_block(lower_location, upper_location, block_index)
+    //   Checks if a specific block contains any key within the specified range
+    //   [lower_location, upper_location], locating the block according to the
+    //   layout.
+    bool _range_query_in_block(
+        size_t lower_location,
+        size_t upper_location,
+        size_t block_index
+    ) const {
+        size_t offset, num_keys;
+        const BitArray& bits = _locate_block(block_index, offset, num_keys);
+        return this->_codec.range_query(
+            bits, offset, num_keys, lower_location, upper_location
+        );
+    }
+
+    // range_query(lower, upper)
+    //   Performs a range query to check if any key within the specified range
+    //   [lower, upper] exists.
+    bool range_query(const Key& lower, const Key& upper) const {
+        // Calculate the approximate locations for the query range.
+        size_t lower_location = _predict_location(lower);
+        size_t upper_location = _predict_location(upper);
+
         // Determine block indices for the lower and upper query locations.
         size_t lower_block_index = lower_location / (
             this->_block_size * this->_scaling_factor
@@ -245,8 +1099,7 @@ struct SNARF {
                 _range_query_in_block(
                     block_lower_value,
                     block_upper_value,
-                    this->_bitsets[block_index],
-                    this->_keys_per_block[block_index]
+                    block_index
                 )
             ) {
                 return true;    // found matching value within range
@@ -256,9 +1109,382 @@ struct SNARF {
         return false;   // no matching key found within range
     }
 
+    // BlockProbe
+    //   The part of a batched range query that falls in one block, as
+    //   locations relative to the block.
+    struct BlockProbe {
+        size_t block_index;
+        size_t lower;
+        size_t upper;
+        size_t query;
+
+        bool operator<(const BlockProbe& other) const {
+            return block_index != other.block_index
+                ? block_index < other.block_index : lower < other.lower;
+        }
+    };
+
+    // range_query_batch(lowers, uppers, n, results)
+    //   Performs range_query() for the `n` ranges [lowers[i], uppers[i]] and
+    //   sets bit i of `results`, resized to `n` bits, for every range that
+    //   may hold a key. The bounds are predicted in batches, and the parts of
+    //   the ranges in their first and last blocks are sorted by block. Blocks
+    //   are then visited in order, and one that several ranges touch is
+    //   decoded once and merged with all of them. Any key in a block between
+    //   the first and last answers a range on its own.
+    void range_query_batch(
+        const Key* lowers, const Key* uppers, size_t n, BitArray& results
+    ) const {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        results = BitArray(n);
+
+        std::vector<double> lower_cdfs(n);
+        std::vector<double> upper_cdfs(n);
+        this->_model.predict_batch(lowers, n, lower_cdfs.data());
+        this->_model.predict_batch(uppers, n, upper_cdfs.data());
+
+        std::vector<BlockProbe> probes;
+        probes.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            size_t lower_location = _cdf_location(lower_cdfs[i]);
+            size_t upper_location = _cdf_location(upper_cdfs[i]);
+            size_t lower_block_index = lower_location / block_range;
+            size_t upper_block_index = upper_location / block_range;
+            BlockProbe probe = {
+                lower_block_index, lower_location % block_range,
+                upper_location % block_range, i
+            };
+            if (lower_block_index == upper_block_index) {
+                probes.push_back(probe);
+                continue;
+            }
+            if (lower_block_index > upper_block_index) {
+                continue;   // an empty range
+            }
+            if (_any_key_between(lower_block_index, upper_block_index)) {
+                results.write_bits(i, 1, 1);
+                continue;
+            }
+
+            probe.upper = block_range - 1;
+            probes.push_back(probe);
+            probe.block_index = upper_block_index;
+            probe.lower = 0;
+            probe.upper = upper_location % block_range;
+            probes.push_back(probe);
+        }
+        _sort_probes(probes);
+
+        std::vector<size_t> locations;
+        for (size_t first = 0; first < probes.size(); ) {
+            size_t block_index = probes[first].block_index;
+            size_t last = first + 1;
+            while (
+                last < probes.size() && probes[last].block_index == block_index
+            ) {
+                ++last;
+            }
+
+            // A range whose first block held a key is already answered.
+            if (last - first == 1) {
+                const BlockProbe& probe = probes[first];
+                if (
+                    !results.read_bit(probe.query) && _range_query_in_block(
+                        probe.lower, probe.upper, block_index
+                    )
+                ) {
+                    results.write_bits(probe.query, 1, 1);
+                }
+                first = last;
+                continue;
+            }
+
+            // Probes are sorted by their lower bound, so a single pass over
+            // the block's sorted locations finds the first at or above each.
+            size_t offset, num_keys;
+            const BitArray& bits = _locate_block(
+                block_index, offset, num_keys
+            );
+            locations.resize(num_keys);
+            this->_codec.decode(bits, offset, num_keys, locations.data());
+            size_t index = 0;
+            for (; first < last; ++first) {
+                const BlockProbe& probe = probes[first];
+                while (index < num_keys && locations[index] < probe.lower) {
+                    ++index;
+                }
+                if (index < num_keys && locations[index] <= probe.upper) {
+                    results.write_bits(probe.query, 1, 1);
+                }
+            }
+        }
+    }
+
+    // _sort_probes(probes)
+    //   Sorts the probes of a batch by block, then by lower bound. A batch
+    //   with probes in a good share of the blocks is distributed over them
+    //   with a counting sort first, so only each block's few probes are
+    //   compared.
+    void _sort_probes(std::vector<BlockProbe>& probes) const {
+        if (probes.size() * 8 < this->_total_blocks) {
+            std::sort(probes.begin(), probes.end());
+            return;
+        }
+
+        std::vector<uint32_t> starts(this->_total_blocks + 1, 0);
+        for (const BlockProbe& probe : probes) {
+            ++starts[probe.block_index + 1];
+        }
+        for (size_t i = 0; i < this->_total_blocks; ++i) {
+            starts[i + 1] += starts[i];
+        }
+        std::vector<BlockProbe> sorted(probes.size());
+        for (const BlockProbe& probe : probes) {
+            sorted[starts[probe.block_index]++] = probe;
+        }
+
+        // Each start now marks the end of its block's probes.
+        size_t first = 0;
+        for (size_t i = 0; i < this->_total_blocks; ++i) {
+            std::sort(sorted.begin() + first, sorted.begin() + starts[i]);
+            first = starts[i];
+        }
+        probes.swap(sorted);
+    }
+
+    // _any_key_between(lower_block_index, upper_block_index)
+    //   Checks if any block strictly between the two holds a key.
+    bool _any_key_between(
+        size_t lower_block_index, size_t upper_block_index
+    ) const {
+        for (
+            size_t block_index = lower_block_index + 1;
+            block_index < upper_block_index;
+            ++block_index
+        ) {
+            size_t offset, num_keys;
+            _locate_block(block_index, offset, num_keys);
+            if (num_keys > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // QueryState
+    //   A range query in flight in range_query_interleaved(): the block it
+    //   reads next, its locations relative to that block, where the block is
+    //   encoded once located, and the step it resumes at.
+    struct QueryState {
+        enum Step { IDLE, LOCATE, SCAN };
+
+        Step step;
+        size_t query;
+        size_t block_index;
+        size_t upper_block_index;
+        size_t lower;
+        size_t upper;
+        size_t upper_location;
+        const BitArray* bits;
+        size_t offset;
+        size_t end;
+        size_t num_keys;
+    };
+
+    // range_query_interleaved(lowers, uppers, n, results)
+    //   Performs range_query() for the `n` ranges [lowers[i], uppers[i]] and
+    //   sets bit i of `results`, resized to `n` bits, for every range that
+    //   may hold a key. Unlike range_query_batch(), the queries run in their
+    //   own order: `INTERLEAVE_GROUP_SIZE` of them are kept in flight, and
+    //   each yields to the next after prefetching what it reads next (the
+    //   block directory or line, then the block), so their cache misses
+    //   overlap. The bounds are predicted in batches with predict_batch().
+    void range_query_interleaved(
+        const Key* lowers, const Key* uppers, size_t n, BitArray& results
+    ) const {
+        results = BitArray(n);
+
+        double lower_cdfs[PREDICT_BATCH_SIZE];
+        double upper_cdfs[PREDICT_BATCH_SIZE];
+        QueryState states[INTERLEAVE_GROUP_SIZE];
+        for (QueryState& state : states) {
+            state.step = QueryState::IDLE;
+        }
+
+        size_t next = 0;        // the next query to start
+        size_t predicted = 0;   // the queries whose bounds are predicted
+        size_t active = 0;      // the queries in flight
+        for (size_t slot = 0; next < n || active > 0; ) {
+            QueryState& state = states[slot];
+            slot = (slot + 1) % INTERLEAVE_GROUP_SIZE;
+
+            if (state.step == QueryState::IDLE) {
+                if (next == n) {
+                    continue;
+                }
+                if (next == predicted) {
+                    size_t count = std::min(
+                        n - next, size_t(PREDICT_BATCH_SIZE)
+                    );
+                    this->_model.predict_batch(
+                        lowers + next, count, lower_cdfs
+                    );
+                    this->_model.predict_batch(
+                        uppers + next, count, upper_cdfs
+                    );
+                    predicted += count;
+                }
+                size_t i = next % PREDICT_BATCH_SIZE;
+                if (_start_query(state, next, lower_cdfs[i], upper_cdfs[i])) {
+                    ++active;
+                }
+                ++next;
+            } else if (state.step == QueryState::LOCATE) {
+                _locate_query_block(state);
+            } else if (_scan_query_block(state, results)) {
+                state.step = QueryState::IDLE;
+                --active;
+            }
+        }
+    }
+
+    // range_query_parallel(lowers, uppers, n, results, pool)
+    //   range_query_interleaved() spread over the threads of `pool`, in tasks
+    //   of `PARALLEL_CHUNK_SIZE` queries. Queries only read the filter, so any
+    //   number of threads may query one filter at once, through this or the
+    //   other range query functions.
+    void range_query_parallel(
+        const Key* lowers, const Key* uppers, size_t n, BitArray& results,
+        ThreadPool& pool
+    ) const {
+        results = BitArray(n);
+        size_t num_chunks = (n + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+        pool.run(num_chunks, [&](size_t chunk) {
+            size_t first = chunk * PARALLEL_CHUNK_SIZE;
+            size_t count = std::min(n - first, size_t(PARALLEL_CHUNK_SIZE));
+            BitArray chunk_results;
+            this->range_query_interleaved(
+                lowers + first, uppers + first, count, chunk_results
+            );
+
+            // Every chunk owns its words of the results.
+            for (size_t word = 0; word * 64 < count; ++word) {
+                results._words[first / 64 + word] = chunk_results._words[word];
+            }
+        });
+    }
+
+    // _start_query(state, query, lower_cdf, upper_cdf)
+    //   Sets up `state` for a range query from the CDFs of its bounds and
+    //   prefetches the directory entry or line of its first block. Returns
+    //   false, leaving `state` idle, if the range is empty.
+    bool _start_query(
+        QueryState& state, size_t query, double lower_cdf, double upper_cdf
+    ) const {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t lower_location = _cdf_location(lower_cdf);
+        size_t upper_location = _cdf_location(upper_cdf);
+        if (lower_location / block_range > upper_location / block_range) {
+            return false;
+        }
+
+        state.query = query;
+        state.block_index = lower_location / block_range;
+        state.upper_block_index = upper_location / block_range;
+        state.lower = lower_location % block_range;
+        state.upper_location = upper_location;
+        _enter_block(state);
+        return true;
+    }
+
+    // _enter_block(state)
+    //   Sets the upper location of a query within its current block and
+    //   prefetches the block's directory entries or line.
+    void _enter_block(QueryState& state) const {
+        size_t block_range = this->_block_size * this->_scaling_factor;
+        size_t block_index = state.block_index;
+        state.upper = block_index == state.upper_block_index
+            ? state.upper_location % block_range : block_range - 1;
+        state.step = QueryState::LOCATE;
+
+        if (this->_layout == BLOCK_LAYOUT_ARENA) {
+            __builtin_prefetch(
+                &this->_superblock_offsets[block_index / SUPERBLOCK_SIZE]
+            );
+            __builtin_prefetch(&this->_block_offsets[block_index]);
+            __builtin_prefetch(&this->_block_offsets[block_index + 1]);
+        } else {
+            size_t line = block_index * _line_bits();
+            _prefetch_bits(this->_lines, line, line + _line_bits());
+        }
+    }
+
+    // _locate_query_block(state)
+    //   Finds where the current block of a query is encoded and prefetches
+    //   its start. An arena block's key count is left to the scan, since
+    //   some codecs read it from the block itself.
+    void _locate_query_block(QueryState& state) const {
+        if (this->_layout == BLOCK_LAYOUT_ARENA) {
+            state.bits = &this->_blocks;
+            state.offset = _block_offset(state.block_index);
+            state.end = _block_offset(state.block_index + 1);
+        } else {
+            state.bits = &_locate_block(
+                state.block_index, state.offset, state.num_keys
+            );
+            state.end = state.offset + _block_bits(state.num_keys);
+        }
+        _prefetch_bits(*state.bits, state.offset, state.end);
+        state.step = QueryState::SCAN;
+    }
+
+    // _scan_query_block(state, results)
+    //   Checks the current block of a query, then moves the query on to its
+    //   next block. Returns true once the query is answered.
+    bool _scan_query_block(
+        QueryState& state, BitArray& results
+    ) const {
+        if (this->_layout == BLOCK_LAYOUT_ARENA) {
+            state.num_keys = _block_num_keys(state.offset, state.end);
+        }
+        if (
+            this->_codec.range_query(
+                *state.bits, state.offset, state.num_keys,
+                state.lower, state.upper
+            )
+        ) {
+            results.write_bits(state.query, 1, 1);
+            return true;
+        }
+        if (state.block_index == state.upper_block_index) {
+            return true;
+        }
+        ++state.block_index;
+        state.lower = 0;
+        _enter_block(state);
+        return false;
+    }
+
+    // _prefetch_bits(bits, offset, end)
+    //   Prefetches the cache lines holding bits [offset, end) of a bit array,
+    //   up to `INTERLEAVE_PREFETCH_LINES` of them.
+    static void _prefetch_bits(
+        const BitArray& bits, size_t offset, size_t end
+    ) {
+        size_t last = std::min(
+            end > offset ? (end - 1) >> 9 : offset >> 9,
+            (offset >> 9) + INTERLEAVE_PREFETCH_LINES - 1
+        );
+        for (size_t line = offset >> 9; line <= last; ++line) {
+            __builtin_prefetch(&bits._words[std::min(
+                line << 3, bits._words.size() - 1
+            )]);
+        }
+    }
+
     // size_bytes()
     //   Returns the total size of the SNARF instance.
-    size_t size_bytes() {
+    size_t size_bytes() const {
         size_t size = 0;
 
         // Add model size.
@@ -266,37 +1492,209 @@ struct SNARF {
 
         // Add member variable sizes.
         size += sizeof(this->_num_keys);
+        size += sizeof(this->_num_appended);
+        size += sizeof(Key) * this->_pending.size();
         size += sizeof(this->_scaling_factor);
         size += sizeof(this->_block_size);
         size += sizeof(this->_bitset_size);
         size += sizeof(this->_total_blocks);
+        size += sizeof(this->_layout);
 
-        // Add size of key counts.
-        for (
-            auto it = this->_keys_per_block.begin();
-            it != this->_keys_per_block.end();
-            ++it
-        ) {
-            size += sizeof(*it);
+        // Add size of the block directory.
+        size += sizeof(uint64_t) * this->_superblock_offsets.size();
+        size += sizeof(uint32_t) * this->_block_offsets.size();
+
+        // Add size of the block arena and lines.
+        size += this->_blocks.size_bytes();
+        size += this->_lines.size_bytes();
+
+        return size;
+    }
+
+    // save(path)
+    //   Writes the structure to a SNARF file at `path`. The file holds the
+    //   parameters, the model, the encoded blocks and the block directory, each
+    //   in a cache-aligned section that map() can use in place.
+    void save(const std::string& path) const {
+        SNARFFileWriter writer(path);
+        this->_model._save(writer);
+        writer.add_bit_array(this->_blocks);
+        writer.add_bit_array(this->_lines);
+        writer.add_section(this->_superblock_offsets);
+        writer.add_section(this->_block_offsets);
+        writer.finish(_file_header());
+    }
+
+    // _file_header()
+    //   Returns the SNARF file header describing this structure's parameters.
+    SNARFFileHeader _file_header() const {
+        SNARFFileHeader header = {};
+        header.key_size = sizeof(Key);
+        header.key_kind = key_kind<Key>();
+        header.model_id = Model::FILE_MODEL_ID;
+        header.codec_id = Codec::FILE_CODEC_ID;
+        header.layout = this->_layout;
+        header.num_keys = this->_num_keys;
+        header.num_appended = this->_num_appended;
+        header.scaling_factor = this->_scaling_factor;
+        header.block_size = this->_block_size;
+        header.bitset_size = this->_bitset_size;
+        header.total_blocks = this->_total_blocks;
+        return header;
+    }
+
+    // map(path, verify)
+    //   Opens a SNARF file written by save() by memory-mapping it. Nothing is
+    //   copied or decoded: the model and blocks are used directly from the
+    //   mapping, so only the pages a query touches are ever read. Section
+    //   checksums are verified only if `verify` is set, since that reads the
+    //   whole file. The parameters, the block directory and the line headers
+    //   are always checked, so that no query of a corrupt file reads past
+    //   the mapping.
+    static SNARF map(const std::string& path, bool verify = false) {
+        SNARFFileReader reader(path, verify);
+        reader.check_key<Key>(
+            Model::FILE_MODEL_ID, Codec::FILE_CODEC_ID
+        );
+
+        const SNARFFileHeader& header = *reader._header;
+        SNARF snarf;
+        snarf._num_keys = header.num_keys;
+        snarf._num_appended = header.num_appended;
+        snarf._scaling_factor = header.scaling_factor;
+        snarf._block_size = header.block_size;
+        snarf._bitset_size = header.bitset_size;
+        snarf._total_blocks = header.total_blocks;
+        snarf._layout = BlockLayout(header.layout);
+
+        snarf._model._map(reader);
+        reader.next_bit_array(snarf._blocks);
+        reader.next_bit_array(snarf._lines);
+        reader.next_section(snarf._superblock_offsets);
+        reader.next_section(snarf._block_offsets);
+        snarf._file = reader._file;
+
+        // Check the geometry so that queries stay within the mapped arrays,
+        // and that no location overflows.
+        bool valid = snarf._num_keys > 0 && snarf._block_size > 0
+            && snarf._bitset_size < 64
+            && snarf._scaling_factor == (size_t(1) << snarf._bitset_size)
+            && snarf._block_size <= SIZE_MAX / snarf._scaling_factor
+            && snarf._total_blocks >= (snarf._num_keys - 1)
+                / snarf._block_size + 1    // more after append()
+            && snarf._total_blocks <= SIZE_MAX
+                / (snarf._block_size * snarf._scaling_factor);
+        if (snarf._layout == BLOCK_LAYOUT_ARENA) {
+            valid = valid
+                && snarf._block_offsets.size() == snarf._total_blocks + 1
+                && snarf._superblock_offsets.size()
+                    == snarf._total_blocks / SUPERBLOCK_SIZE + 1;
+        } else {
+            valid = valid && (
+                snarf._layout == BLOCK_LAYOUT_LINE_64
+                || snarf._layout == BLOCK_LAYOUT_LINE_128
+            ) && snarf._lines.size() / snarf._line_bits()
+                    == snarf._total_blocks
+                && snarf._lines.size() % snarf._line_bits() == 0;
+        }
+        if (!valid) {
+            throw std::runtime_error(
+                "ERROR: SNARF file parameters are invalid."
+            );
         }
 
-        // Add size of each bitset.
-        for (
-            auto it = this->_bitsets.begin(); it != this->_bitsets.end(); ++it
-        ) {
-            size += it->size_bytes();
+        snarf._set_codec();
+        if (!snarf._check_blocks()) {
+            throw std::runtime_error("ERROR: SNARF file blocks are invalid.");
         }
+        return snarf;
+    }
 
-        return size;
+    // _check_blocks()
+    //   Checks that every block lies within its array and is long enough
+    //   for the keys it claims to hold: the directory must never point
+    //   backwards or past the arena, and every line's block must fit its
+    //   line or, if it overflows, the overflow arena.
+    bool _check_blocks() const {
+        size_t arena_bits = this->_blocks.size();
+        if (this->_layout == BLOCK_LAYOUT_ARENA) {
+            // Bounding the superblock offsets keeps block offsets from
+            // overflowing.
+            for (size_t i = 1; i < this->_superblock_offsets.size(); ++i) {
+                if (
+                    this->_superblock_offsets[i]
+                        < this->_superblock_offsets[i - 1]
+                ) {
+                    return false;
+                }
+            }
+            if (this->_superblock_offsets.back() > arena_bits) {
+                return false;
+            }
+            size_t offset = _block_offset(0);
+            for (size_t i = 0; i < this->_total_blocks; ++i) {
+                size_t end = _block_offset(i + 1);
+                if (
+                    end <= offset || end > arena_bits
+                    || !_check_block(offset, end)
+                ) {
+                    return false;
+                }
+                offset = end;
+            }
+            return true;
+        }
+
+        for (size_t i = 0; i < this->_total_blocks; ++i) {
+            size_t line = i * _line_bits();
+            uint64_t header = this->_lines.read_bits(line, 64);
+            const BitArray* bits = &this->_lines;
+            size_t offset = line + LINE_HEADER_BITS;
+            size_t num_keys = header >> 1;
+            size_t available = _line_bits() - LINE_HEADER_BITS;
+            if (header & 1) {
+                size_t overflow_offset = header >> 1;
+                if (
+                    overflow_offset >= arena_bits
+                    || arena_bits - overflow_offset <= 64
+                ) {
+                    return false;
+                }
+                bits = &this->_blocks;
+                offset = overflow_offset + 64;
+                num_keys = this->_blocks.read_bits(overflow_offset, 64);
+                available = arena_bits - offset;
+            }
+            if (
+                num_keys > available
+                || this->_codec.block_extent(*bits, offset, num_keys)
+                    > available
+            ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // _check_block(offset, end)
+    //   Checks that the arena block spanning [offset, end) holds the bits a
+    //   query reads for the key count derived from its length.
+    bool _check_block(size_t offset, size_t end) const {
+        size_t num_keys = _block_num_keys(offset, end);
+        return num_keys <= end - offset
+            && this->_codec.block_extent(this->_blocks, offset, num_keys)
+                <= end - offset;
     }
 
     // print_snarf()
     //   Prints the SNARF model parameters in human-readable format for
     //   debugging purposes.
-    void print_snarf() {
+    void print_snarf() const {
         std::cout << "--------------------\n";
         std::cout << "SNARF MODEL PARAMETERS\n";
         std::cout << "Total number of input keys: " << this->_num_keys << "\n";
+        std::cout << "Number of appended keys: " << this->_num_appended
+            << "\n";
         std::cout << "Scaling factor: " << this->_scaling_factor << "\n";
         std::cout << "Number of elements in a block: " << this->_block_size
             << "\n";
@@ -304,6 +1702,8 @@ struct SNARF {
             << "\n";
         std::cout << "Total number of blocks: " << this->_total_blocks
             << "\n";
+        std::cout << "Block layout (line bytes, 0 for arena): "
+            << this->_layout << "\n";
         std::cout << "\n--------------------\n";
     }
 };
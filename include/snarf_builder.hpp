@@ -0,0 +1,337 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "snarf.hpp"
+
+// Number of keys read from a key file at a time.
+#define KEY_STREAM_BUFFER_SIZE (1 << 16)
+// Default number of encoded bits buffered before they are written out.
+#define BUILDER_FLUSH_BITS (1 << 23)
+
+
+// KeyFileStream
+//   Streams keys from a binary file of raw, sorted `Key` values through a
+//   fixed-size buffer. Like every key stream used by `SNARFBuilder`, it reports
+//   the total number of keys up front and can be rewound for another pass. A
+//   file that is not a whole number of keys, or that cannot be read or
+//   rewound, throws.
+template <typename Key>
+struct KeyFileStream {
+    // The open key file.
+    FILE* _file;
+    // The total number of keys in the file.
+    size_t _size;
+    // Buffered keys, and the read position and fill level of the buffer.
+    std::vector<Key> _buffer;
+    size_t _position;
+    size_t _filled;
+
+    // KeyFileStream(path)
+    //   Opens the key file at `path`.
+    KeyFileStream(const std::string& path) :
+        _buffer(KEY_STREAM_BUFFER_SIZE), _position(0), _filled(0)
+    {
+        this->_file = fopen(path.c_str(), "rb");
+        if (this->_file == nullptr) {
+            throw std::runtime_error("ERROR: Cannot open key file.");
+        }
+        off_t bytes = -1;
+        if (fseeko(this->_file, 0, SEEK_END) == 0) {
+            bytes = ftello(this->_file);
+        }
+        if (bytes < 0 || bytes % sizeof(Key) != 0) {
+            fclose(this->_file);
+            throw std::runtime_error(
+                bytes < 0 ? "ERROR: Cannot read key file."
+                    : "ERROR: Key file ends with a partial key."
+            );
+        }
+        this->_size = bytes / sizeof(Key);
+        rewind();
+    }
+
+    ~KeyFileStream() {
+        fclose(this->_file);
+    }
+
+    KeyFileStream(const KeyFileStream&) = delete;
+    KeyFileStream& operator=(const KeyFileStream&) = delete;
+
+    // size()
+    //   Returns the total number of keys.
+    size_t size() const {
+        return this->_size;
+    }
+
+    // rewind()
+    //   Restarts the stream from the first key.
+    void rewind() {
+        if (fseeko(this->_file, 0, SEEK_SET) != 0) {
+            throw std::runtime_error("ERROR: Cannot read key file.");
+        }
+        clearerr(this->_file);
+        this->_position = 0;
+        this->_filled = 0;
+    }
+
+    // next(key)
+    //   Reads the next key into `key`. Returns false at the end of the stream.
+    bool next(Key& key) {
+        if (this->_position == this->_filled) {
+            this->_filled = fread(
+                this->_buffer.data(), sizeof(Key), this->_buffer.size(),
+                this->_file
+            );
+            this->_position = 0;
+            if (ferror(this->_file)) {
+                throw std::runtime_error("ERROR: Cannot read key file.");
+            }
+            if (this->_filled == 0) {
+                return false;
+            }
+        }
+        key = this->_buffer[this->_position++];
+        return true;
+    }
+};
+
+
+// KeyRangeStream
+//   Streams keys from a sorted range [first, last) of forward iterators, for
+//   key sources that are not plain files.
+template <typename Iterator>
+struct KeyRangeStream {
+    Iterator _first;
+    Iterator _last;
+    Iterator _current;
+    size_t _size;
+
+    // KeyRangeStream(first, last)
+    //   Streams the keys in [first, last).
+    KeyRangeStream(Iterator first, Iterator last) :
+        _first(first), _last(last), _current(first),
+        _size(std::distance(first, last)) {}
+
+    size_t size() const {
+        return this->_size;
+    }
+
+    void rewind() {
+        this->_current = this->_first;
+    }
+
+    template <typename Key>
+    bool next(Key& key) {
+        if (this->_current == this->_last) {
+            return false;
+        }
+        key = *this->_current++;
+        return true;
+    }
+};
+
+
+// make_key_stream(first, last)
+//   Helper that deduces the iterator type of a `KeyRangeStream`.
+template <typename Iterator>
+KeyRangeStream<Iterator> make_key_stream(Iterator first, Iterator last) {
+    return KeyRangeStream<Iterator>(first, last);
+}
+
+
+// SNARFBuilder
+//   Builds a SNARF file from a sorted key stream in bounded memory, for key
+//   sets that do not fit in RAM. The first pass samples the spline model, and
+//   the second predicts each key's location and encodes blocks as soon as they
+//   are complete, streaming them straight to the file. Only the model, the
+//   block directory, one block of locations and a fixed write buffer are held
+//   in memory. The result is opened with `SNARF<Key>::map()`, and matches what
+//   `SNARF<Key>::save()` writes for the same keys and parameters.
+template <typename Key, typename Codec = GolombCodec>
+struct SNARFBuilder {
+    // The filter being built.
+    typedef SNARF<Key, LinearSplineModel<Key>, Codec> Filter;
+
+    // Parameters as passed to the `SNARF` constructor (linear spline model and
+    // arena layout, with the same `Codec`).
+    double _bits_per_key;
+    size_t _block_size;
+    size_t _R;
+    // Number of encoded bits buffered before whole words are written out.
+    size_t _flush_bits;
+
+    // SNARFBuilder(bits_per_key, block_size, R, flush_bits)
+    //   Creates a builder with the same parameters as the `SNARF` constructor.
+    //   `flush_bits` bounds the write buffer (plus at most one block).
+    SNARFBuilder(
+        double bits_per_key, size_t block_size, size_t R,
+        size_t flush_bits = BUILDER_FLUSH_BITS
+    ) :
+        _bits_per_key(bits_per_key), _block_size(block_size), _R(R),
+        _flush_bits(flush_bits) {}
+
+    // build(keys, path)
+    //   Builds the filter for the sorted key stream `keys` and writes it to a
+    //   SNARF file at `path`. Reads the stream twice.
+    template <typename KeyStream>
+    void build(KeyStream& keys, const std::string& path) {
+        Filter snarf;
+        snarf._num_keys = keys.size();
+        snarf._block_size = this->_block_size;
+        snarf._layout = BLOCK_LAYOUT_ARENA;
+        if (this->_R > snarf._num_keys || snarf._num_keys == 0) {
+            throw std::runtime_error(
+                "ERROR: `R` value larger than training data size."
+            );
+        }
+        snarf._set_parameters(this->_bits_per_key);
+
+        _sample_model(keys, snarf);
+
+        SNARFFileWriter writer(path);
+        snarf._model._save(writer);
+        _write_blocks(keys, snarf, writer);
+        writer.add_bit_array(snarf._lines);
+        writer.add_section(snarf._superblock_offsets);
+        writer.add_section(snarf._block_offsets);
+        writer.finish(snarf._file_header());
+    }
+
+    // _sample_model(keys, snarf)
+    //   First pass: picks the same every-R-th keys as `BaseModel` and fits the
+    //   linear spline over them, without materializing the eCDF of every key.
+    template <typename KeyStream>
+    void _sample_model(KeyStream& keys, Filter& snarf) {
+        size_t num_keys = snarf._num_keys;
+        size_t key_array_size = ceil(num_keys * 1.0 / this->_R);
+        auto& key_array = snarf._model._key_array;
+        key_array.resize(key_array_size);
+
+        keys.rewind();
+        Key key = Key();
+        Key previous = Key();
+        size_t sampled = 0;
+        for (size_t i = 0; i < num_keys; ++i) {
+            if (!keys.next(key)) {
+                throw std::runtime_error("ERROR: Key stream ended early.");
+            }
+            if (i > 0 && key < previous) {
+                throw std::runtime_error("ERROR: Key stream is not sorted.");
+            }
+            previous = key;
+
+            // The final key always closes the key array.
+            size_t next_index = sampled + 1 == key_array_size
+                ? num_keys - 1
+                : size_t(((sampled + 1) * num_keys * 1.0) / key_array_size)
+                    - 1;
+            if (i == next_index) {
+                key_array[sampled++] = std::make_pair(
+                    key, (i + 1) * 1.0 / num_keys
+                );
+            }
+        }
+
+        snarf._model._build_linear_models();
+    }
+
+    // _write_blocks(keys, snarf, writer)
+    //   Second pass: encodes the blocks in order into a bounded buffer that is
+    //   flushed to the file as it fills, recording the block directory. The
+    //   stream must yield the same sorted keys as in the first pass.
+    template <typename KeyStream>
+    void _write_blocks(
+        KeyStream& keys, Filter& snarf, SNARFFileWriter& writer
+    ) {
+        size_t block_range = snarf._block_size * snarf._scaling_factor;
+        snarf._superblock_offsets.resize(
+            snarf._total_blocks / SUPERBLOCK_SIZE + 1
+        );
+        snarf._block_offsets.resize(snarf._total_blocks + 1);
+
+        BitArray buffer(this->_flush_bits);
+        size_t flushed_words = 0;   // words already written to the file
+        size_t offset = 0;          // absolute bit offset of the next block
+        size_t block_index = 0;     // the block being collected
+        std::vector<size_t> batch;  // locations of the current block
+
+        writer.begin_section();
+
+        keys.rewind();
+        Key key = Key();
+        Key previous = Key();
+        size_t num_keys = 0;
+        while (block_index < snarf._total_blocks) {
+            // Past the last key, a location beyond every block closes them all.
+            bool has_key = keys.next(key);
+            if (has_key) {
+                if (num_keys > 0 && key < previous) {
+                    throw std::runtime_error(
+                        "ERROR: Key stream is not sorted."
+                    );
+                }
+                previous = key;
+                ++num_keys;
+            }
+            if (!has_key && num_keys != snarf._num_keys) {
+                throw std::runtime_error(
+                    "ERROR: Key stream changed between passes."
+                );
+            }
+            size_t location = has_key
+                ? snarf._predict_location(key)
+                : snarf._total_blocks * block_range;
+
+            // Emit every block that ends before this location.
+            while (
+                block_index < snarf._total_blocks &&
+                location >= (block_index + 1) * block_range
+            ) {
+                snarf._set_block_offset(block_index, offset);
+
+                size_t local = offset - flushed_words * 64;
+                size_t bits = snarf._block_bits(batch.size());
+                if (local + bits > buffer.size()) {
+                    buffer._initialize_bit_array(local + bits);
+                }
+                snarf._codec.encode(
+                    batch.data(), batch.data() + batch.size(),
+                    block_index * block_range, buffer, local
+                );
+                offset += bits;
+                batch.clear();
+                ++block_index;
+
+                // Flush every complete word once the buffer is full enough.
+                if (local + bits >= this->_flush_bits) {
+                    size_t num_words = (local + bits) / 64;
+                    writer.write_chunk(buffer._words.data(), num_words * 8);
+                    buffer._drop_words(num_words);
+                    flushed_words += num_words;
+                }
+            }
+
+            if (has_key) {
+                batch.push_back(location);
+            }
+        }
+        snarf._set_block_offset(snarf._total_blocks, offset);
+
+        // Write the remaining words, including the trailing padding word.
+        size_t total_words = (offset + 63) / 64 + 1;
+        writer.write_chunk(
+            buffer._words.data(), (total_words - flushed_words) * 8
+        );
+        writer.end_section(offset);
+    }
+};
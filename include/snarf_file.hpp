@@ -0,0 +1,427 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bit_array.hpp"
+#include "storage.hpp"
+
+// Identifies a SNARF file. Stored as the first 8 bytes, including the NUL.
+#define SNARF_FILE_MAGIC "SNARFPP"
+// Bumped whenever the on-disk layout changes.
+#define SNARF_FILE_VERSION 7
+// Written as a native integer to detect files from a different byte order.
+#define SNARF_FILE_BYTE_ORDER 0x01020304
+// Alignment of every section within the file.
+#define SNARF_FILE_ALIGNMENT 64
+// Initial state of `checksum64`.
+#define CHECKSUM_SEED 0xcbf29ce484222325ULL
+
+
+// checksum64(data, num_bytes, hash)
+//   FNV-1a style hash over 64-bit words (and the trailing bytes), used to
+//   detect corrupted or truncated files. Passing the result of a previous call
+//   as `hash` continues it, so data can be hashed in chunks as long as every
+//   chunk but the last is a multiple of 8 bytes.
+inline uint64_t checksum64(
+    const void* data, size_t num_bytes, uint64_t hash = CHECKSUM_SEED
+) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    size_t i = 0;
+    for (; i + 8 <= num_bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    for (; i < num_bytes; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+
+// key_kind<Key>()
+//   Returns a tag describing the representation of `Key`, so that a file is
+//   never opened with a key type it was not written with.
+template <typename Key>
+uint32_t key_kind() {
+    if (std::is_floating_point<Key>::value) {
+        return 2;
+    }
+    return std::is_signed<Key>::value ? 1 : 0;
+}
+
+
+// SNARFFileHeader
+//   Fixed-size header at the start of a SNARF file. It is followed by the
+//   sections, each aligned to `SNARF_FILE_ALIGNMENT` bytes, and then by a table
+//   of `num_sections` `SNARFFileSection` entries. Keeping the table at the end
+//   lets sections be streamed out before their sizes are known.
+struct SNARFFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t key_size;
+    uint32_t key_kind;
+    uint32_t model_id;
+    uint32_t layout;
+    uint32_t codec_id;
+    // Zero. Keeps the 64-bit fields below aligned.
+    uint32_t reserved;
+    uint64_t num_sections;
+    uint64_t section_table_offset;
+    uint64_t num_keys;
+    uint64_t scaling_factor;
+    uint64_t block_size;
+    uint64_t bitset_size;
+    uint64_t total_blocks;
+    uint64_t num_appended;
+    // Checksum of the header and section table, computed with this field set
+    // to zero.
+    uint64_t header_checksum;
+};
+
+
+// SNARFFileSection
+//   Describes one persisted array: where it starts, how many bytes it spans,
+//   its logical length (elements, or bits for a bit array) and a checksum of
+//   its bytes.
+struct SNARFFileSection {
+    uint64_t offset;
+    uint64_t num_bytes;
+    uint64_t length;
+    uint64_t checksum;
+};
+
+
+// MappedFile
+//   Read-only memory mapping of a whole file, unmapped on destruction.
+struct MappedFile {
+    // Start of the mapping.
+    const char* _data;
+    // Size of the mapping in bytes.
+    size_t _size;
+
+    // MappedFile(path)
+    //   Maps the file at `path`. Readahead is disabled, since queries touch a
+    //   few scattered pages and should only fault in those.
+    MappedFile(const std::string& path) : _data(nullptr), _size(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("ERROR: Cannot open SNARF file.");
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            throw std::runtime_error("ERROR: Cannot read SNARF file.");
+        }
+        this->_size = info.st_size;
+
+        void* data = mmap(nullptr, this->_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("ERROR: Cannot map SNARF file.");
+        }
+        madvise(data, this->_size, MADV_RANDOM);
+        this->_data = static_cast<const char*>(data);
+    }
+
+    ~MappedFile() {
+        munmap(const_cast<char*>(this->_data), this->_size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+
+// SNARFFileWriter
+//   Writes a SNARF file section by section. Sections are either added whole
+//   from an array, or streamed out in chunks between begin_section() and
+//   end_section(). finish() appends the section table and fills in the header.
+struct SNARFFileWriter {
+    // The file being written.
+    std::ofstream _out;
+    // Descriptor of every section written so far, in order.
+    std::vector<SNARFFileSection> _sections;
+    // The current write position.
+    size_t _position;
+    // Bytes streamed into the open section that are not yet hashed, because
+    // a checksum chunk must be a multiple of 8 bytes.
+    std::vector<char> _unhashed;
+
+    // SNARFFileWriter(path)
+    //   Creates the file and reserves space for the header.
+    SNARFFileWriter(const std::string& path) :
+        _out(path.c_str(), std::ios::binary | std::ios::trunc),
+        _position(0)
+    {
+        if (!this->_out) {
+            throw std::runtime_error("ERROR: Cannot create SNARF file.");
+        }
+        SNARFFileHeader placeholder = {};
+        _write(&placeholder, sizeof(SNARFFileHeader));
+    }
+
+    // add_section(storage, length)
+    //   Writes an array as the next section. `length` defaults to the number
+    //   of elements.
+    template <typename T, typename Allocator>
+    void add_section(const Storage<T, Allocator>& storage, size_t length) {
+        begin_section();
+        write_chunk(storage.data(), storage.size() * sizeof(T));
+        end_section(length);
+    }
+
+    template <typename T, typename Allocator>
+    void add_section(const Storage<T, Allocator>& storage) {
+        add_section(storage, storage.size());
+    }
+
+    // add_bit_array(bits)
+    //   Writes the words of a bit array as the next section, with the number
+    //   of bits as its length.
+    void add_bit_array(const BitArray& bits) {
+        add_section(bits._words, bits.size());
+    }
+
+    // begin_section()
+    //   Starts a new section at the next aligned offset.
+    void begin_section() {
+        static const char padding[SNARF_FILE_ALIGNMENT] = {};
+        _write(padding, _align(this->_position) - this->_position);
+
+        SNARFFileSection section = {};
+        section.offset = this->_position;
+        section.checksum = CHECKSUM_SEED;
+        this->_sections.push_back(section);
+        this->_unhashed.clear();
+    }
+
+    // write_chunk(data, num_bytes)
+    //   Appends bytes to the open section.
+    void write_chunk(const void* data, size_t num_bytes) {
+        SNARFFileSection& section = this->_sections.back();
+        const char* bytes = static_cast<const char*>(data);
+        _write(bytes, num_bytes);
+        section.num_bytes += num_bytes;
+
+        // Hash whole words, carrying any remainder over to the next chunk.
+        this->_unhashed.insert(this->_unhashed.end(), bytes, bytes + num_bytes);
+        size_t whole = this->_unhashed.size() / 8 * 8;
+        section.checksum = checksum64(
+            this->_unhashed.data(), whole, section.checksum
+        );
+        this->_unhashed.erase(
+            this->_unhashed.begin(), this->_unhashed.begin() + whole
+        );
+    }
+
+    // end_section(length)
+    //   Closes the open section, recording its logical length.
+    void end_section(size_t length) {
+        SNARFFileSection& section = this->_sections.back();
+        section.checksum = checksum64(
+            this->_unhashed.data(), this->_unhashed.size(), section.checksum
+        );
+        section.length = length;
+        this->_unhashed.clear();
+    }
+
+    // finish(header)
+    //   Appends the section table, then fills in the header and writes it at
+    //   the start of the file.
+    void finish(SNARFFileHeader header) {
+        memcpy(header.magic, SNARF_FILE_MAGIC, 8);
+        header.version = SNARF_FILE_VERSION;
+        header.byte_order = SNARF_FILE_BYTE_ORDER;
+        header.num_sections = this->_sections.size();
+        header.section_table_offset = _align(this->_position);
+        header.header_checksum = 0;
+
+        static const char padding[SNARF_FILE_ALIGNMENT] = {};
+        size_t table_bytes = sizeof(SNARFFileSection) * this->_sections.size();
+        _write(padding, header.section_table_offset - this->_position);
+        _write(this->_sections.data(), table_bytes);
+
+        // Checksum the header together with the section table.
+        header.header_checksum = checksum64(
+            this->_sections.data(), table_bytes,
+            checksum64(&header, sizeof(SNARFFileHeader))
+        );
+        this->_out.seekp(0);
+        this->_out.write(
+            reinterpret_cast<const char*>(&header), sizeof(SNARFFileHeader)
+        );
+        this->_out.flush();
+
+        if (!this->_out) {
+            throw std::runtime_error("ERROR: Cannot write SNARF file.");
+        }
+    }
+
+    // _write(data, num_bytes)
+    //   Writes raw bytes at the current position.
+    void _write(const void* data, size_t num_bytes) {
+        this->_out.write(static_cast<const char*>(data), num_bytes);
+        this->_position += num_bytes;
+        if (!this->_out) {
+            throw std::runtime_error("ERROR: Cannot write SNARF file.");
+        }
+    }
+
+    // _align(offset)
+    //   Rounds `offset` up to the section alignment.
+    static size_t _align(size_t offset) {
+        return (offset + SNARF_FILE_ALIGNMENT - 1)
+            / SNARF_FILE_ALIGNMENT * SNARF_FILE_ALIGNMENT;
+    }
+};
+
+
+// SNARFFileReader
+//   Validates a mapped SNARF file and hands out its sections, in order, as
+//   read-only views into the mapping.
+struct SNARFFileReader {
+    // The mapping that every view points into.
+    std::shared_ptr<const MappedFile> _file;
+    // The validated header.
+    const SNARFFileHeader* _header;
+    // The section table.
+    const SNARFFileSection* _sections;
+    // The index of the next section to hand out.
+    size_t _next;
+    // Whether to verify each section's checksum when it is handed out.
+    bool _verify;
+
+    // SNARFFileReader(path, verify)
+    //   Maps the file and checks its header. Section checksums are only
+    //   verified if `verify` is set, since doing so reads the whole file.
+    SNARFFileReader(const std::string& path, bool verify) :
+        _file(new MappedFile(path)),
+        _next(0),
+        _verify(verify)
+    {
+        if (this->_file->_size < sizeof(SNARFFileHeader)) {
+            throw std::runtime_error("ERROR: SNARF file is truncated.");
+        }
+
+        this->_header = reinterpret_cast<const SNARFFileHeader*>(
+            this->_file->_data
+        );
+        if (memcmp(this->_header->magic, SNARF_FILE_MAGIC, 8) != 0) {
+            throw std::runtime_error("ERROR: Not a SNARF file.");
+        }
+        if (this->_header->version != SNARF_FILE_VERSION) {
+            throw std::runtime_error("ERROR: Unsupported SNARF file version.");
+        }
+        if (this->_header->byte_order != SNARF_FILE_BYTE_ORDER) {
+            throw std::runtime_error("ERROR: SNARF file byte order mismatch.");
+        }
+
+        size_t table_offset = this->_header->section_table_offset;
+        size_t table_bytes = sizeof(SNARFFileSection)
+            * this->_header->num_sections;
+        if (
+            table_offset % SNARF_FILE_ALIGNMENT != 0 ||
+            table_offset > this->_file->_size ||
+            table_bytes > this->_file->_size - table_offset
+        ) {
+            throw std::runtime_error("ERROR: SNARF file is truncated.");
+        }
+        this->_sections = reinterpret_cast<const SNARFFileSection*>(
+            this->_file->_data + table_offset
+        );
+
+        // Recompute the header checksum with the stored value zeroed.
+        SNARFFileHeader copy = *this->_header;
+        copy.header_checksum = 0;
+        uint64_t checksum = checksum64(
+            this->_sections, table_bytes,
+            checksum64(&copy, sizeof(SNARFFileHeader))
+        );
+        if (checksum != this->_header->header_checksum) {
+            throw std::runtime_error("ERROR: SNARF file header is corrupted.");
+        }
+    }
+
+    // check_key<Key>(model_id, codec_id)
+    //   Throws unless the file was written for the same key type, model and
+    //   block codec.
+    template <typename Key>
+    void check_key(uint32_t model_id, uint32_t codec_id) {
+        if (
+            this->_header->key_size != sizeof(Key) ||
+            this->_header->key_kind != key_kind<Key>()
+        ) {
+            throw std::runtime_error("ERROR: SNARF file key type mismatch.");
+        }
+        if (this->_header->model_id != model_id) {
+            throw std::runtime_error("ERROR: SNARF file model mismatch.");
+        }
+        if (this->_header->codec_id != codec_id) {
+            throw std::runtime_error("ERROR: SNARF file codec mismatch.");
+        }
+    }
+
+    // next_bit_array(bits)
+    //   Points a bit array at the next section, written by add_bit_array().
+    void next_bit_array(BitArray& bits) {
+        bits._size = next_section(bits._words);
+        if (bits._words.size() != (bits._size + 63) / 64 + 1) {
+            throw std::runtime_error("ERROR: SNARF file section is invalid.");
+        }
+    }
+
+    // next_section(storage)
+    //   Points `storage` at the next section and returns its logical length.
+    template <typename T, typename Allocator>
+    size_t next_section(Storage<T, Allocator>& storage) {
+        if (this->_next >= this->_header->num_sections) {
+            throw std::runtime_error("ERROR: SNARF file is missing sections.");
+        }
+
+        const SNARFFileSection& section = this->_sections[this->_next++];
+        if (
+            section.offset % SNARF_FILE_ALIGNMENT != 0 ||
+            section.num_bytes % sizeof(T) != 0 ||
+            section.offset > this->_file->_size ||
+            section.num_bytes > this->_file->_size - section.offset
+        ) {
+            throw std::runtime_error("ERROR: SNARF file section is invalid.");
+        }
+
+        const char* data = this->_file->_data + section.offset;
+        if (
+            this->_verify &&
+            checksum64(data, section.num_bytes) != section.checksum
+        ) {
+            throw std::runtime_error("ERROR: SNARF file section is corrupted.");
+        }
+
+        storage.view(
+            reinterpret_cast<const T*>(data), section.num_bytes / sizeof(T)
+        );
+        return section.length;
+    }
+};
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+#define CACHE_LINE_SIZE 64
+
+
+// CacheAlignedAllocator
+//   Minimal allocator that aligns every allocation to a cache line, so that
+//   the first element of an array starts on a line boundary.
+template <typename T>
+struct CacheAlignedAllocator {
+    typedef T value_type;
+
+    CacheAlignedAllocator() {}
+
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, CACHE_LINE_SIZE, n * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* memory, size_t) {
+        free(memory);
+    }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const CacheAlignedAllocator<U>&) const {
+        return false;
+    }
+};
+
+
+// Storage
+//   A contiguous array used for every piece of state that SNARF persists. It
+//   either owns its elements (backed by a `std::vector`) or is a read-only view
+//   of elements that live elsewhere, such as in a memory-mapped file. Reads go
+//   through the same pointer in both cases, so the query path does not care
+//   which one it is looking at. Only the const accessors read a view; the
+//   others throw for one rather than write to a read-only mapping.
+template <typename T, typename Allocator = std::allocator<T> >
+struct Storage {
+    // Elements owned by this array. Empty for a view.
+    std::vector<T, Allocator> _owned;
+    // Pointer to the first element, owned or viewed.
+    T* _data;
+    // The number of elements.
+    size_t _size;
+    // Whether the elements are owned elsewhere.
+    bool _is_view;
+
+    // Storage()
+    //   Constructs an empty, owning array.
+    Storage() : _data(nullptr), _size(0), _is_view(false) {}
+
+    // Storage(other)
+    //   Copies the elements of an owning array, or the pointer of a view.
+    Storage(const Storage& other) : _owned(other._owned) {
+        _rebind(other);
+    }
+
+    // Storage(other)
+    //   Takes over the elements of an owning array, or the pointer of a view.
+    Storage(Storage&& other) : _owned(std::move(other._owned)) {
+        _rebind(other);
+        other._sync();
+    }
+
+    Storage& operator=(const Storage& other) {
+        if (this != &other) {
+            this->_owned = other._owned;
+            _rebind(other);
+        }
+        return *this;
+    }
+
+    Storage& operator=(Storage&& other) {
+        if (this != &other) {
+            this->_owned = std::move(other._owned);
+            _rebind(other);
+            other._sync();
+        }
+        return *this;
+    }
+
+    // _rebind(other)
+    //   Points this array at its own elements, or at the elements of `other`
+    //   when `other` is a view.
+    void _rebind(const Storage& other) {
+        if (other._is_view) {
+            this->_data = other._data;
+            this->_size = other._size;
+            this->_is_view = true;
+        } else {
+            _sync();
+        }
+    }
+
+    // _sync()
+    //   Points this array at its owned elements.
+    void _sync() {
+        this->_data = this->_owned.data();
+        this->_size = this->_owned.size();
+        this->_is_view = false;
+    }
+
+    // resize(size, value)
+    //   Resizes an owning array, filling new elements with `value`.
+    void resize(size_t size, const T& value = T()) {
+        if (this->_is_view) {
+            throw std::runtime_error("ERROR: Cannot modify a read-only view.");
+        }
+        this->_owned.resize(size, value);
+        _sync();
+    }
+
+    // view(data, size)
+    //   Turns this array into a read-only view of `size` elements at `data`.
+    //   The caller keeps the elements alive for as long as the view is used.
+    void view(const T* data, size_t size) {
+        std::vector<T, Allocator>().swap(this->_owned);
+        this->_data = const_cast<T*>(data);
+        this->_size = size;
+        this->_is_view = true;
+    }
+
+    size_t size() const { return this->_size; }
+    bool empty() const { return this->_size == 0; }
+
+    // _writable()
+    //   Returns the owned elements for writing. Throws for a view.
+    T* _writable() {
+        if (this->_is_view) {
+            throw std::runtime_error("ERROR: Cannot modify a read-only view.");
+        }
+        return this->_data;
+    }
+
+    T* data() { return _writable(); }
+    const T* data() const { return this->_data; }
+
+    T& operator[](size_t i) { return _writable()[i]; }
+    const T& operator[](size_t i) const { return this->_data[i]; }
+
+    T& back() { return _writable()[this->_size - 1]; }
+    const T& back() const { return this->_data[this->_size - 1]; }
+
+    T* begin() { return _writable(); }
+    const T* begin() const { return this->_data; }
+    T* end() { return _writable() + this->_size; }
+    const T* end() const { return this->_data + this->_size; }
+};
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "storage.hpp"
+
+
+// ThreadPool
+//   A fixed set of worker threads that run batches of independent tasks with
+//   work stealing. run(num_tasks, task) deals the task indexes out as one
+//   contiguous slice per thread, the calling thread included. Each thread
+//   takes tasks from the front of its own slice and, once it is empty,
+//   steals from the back of the others', so threads that finish early take
+//   over the work of slow ones. Batches from different callers run one at a
+//   time, and a batch started by a task of the pool runs on the thread of
+//   that task. Tasks must not throw: an exception escaping a task
+//   terminates the program.
+struct ThreadPool {
+    // TaskSlice
+    //   The tasks a thread has left, [next, end), packed into one word so that
+    //   the owner and thieves both claim a task with one compare-and-swap.
+    //   Padded to a cache line, so threads don't contend on their neighbours'.
+    struct TaskSlice {
+        std::atomic<uint64_t> range;
+        char padding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    };
+
+    // One slice per thread; the first belongs to the thread calling run().
+    std::vector<TaskSlice, CacheAlignedAllocator<TaskSlice> > _slices;
+    // The worker threads, which own the other slices.
+    std::vector<std::thread> _workers;
+    // The task of the current batch.
+    std::function<void(size_t)> _task;
+    // Guards the fields below, which workers wait on.
+    std::mutex _mutex;
+    std::condition_variable _start;
+    std::condition_variable _done;
+    // Counts batches, so workers wake up once for each.
+    uint64_t _generation;
+    // The number of workers still in the current batch.
+    size_t _running;
+    bool _stopping;
+    // Held by run() for the whole batch.
+    std::mutex _run_mutex;
+
+    // ThreadPool(num_threads)
+    //   Starts a pool of `num_threads` threads, counting the one that calls
+    //   run(), so `num_threads - 1` workers are started.
+    explicit ThreadPool(
+        size_t num_threads = std::thread::hardware_concurrency()
+    ) :
+        _slices(num_threads > 0 ? num_threads : 1),
+        _generation(0),
+        _running(0),
+        _stopping(false)
+    {
+        for (size_t i = 1; i < this->_slices.size(); ++i) {
+            this->_workers.emplace_back(&ThreadPool::_work, this, i);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // ~ThreadPool()
+    //   Stops and joins the workers.
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_stopping = true;
+        }
+        this->_start.notify_all();
+        for (std::thread& worker : this->_workers) {
+            worker.join();
+        }
+    }
+
+    // size()
+    //   Returns the number of threads that run tasks, the caller included.
+    size_t size() const {
+        return this->_slices.size();
+    }
+
+    // run(num_tasks, task)
+    //   Calls `task(i)` exactly once for every i in [0, num_tasks), spread
+    //   over the pool, and returns once all calls have returned. Called from
+    //   a task of this pool, whose threads are all busy with the batch that
+    //   task is part of, it calls the tasks in order on the calling thread
+    //   instead. Tasks must not throw.
+    template <typename Task>
+    void run(size_t num_tasks, Task task) {
+        if (_current() == this) {
+            for (size_t i = 0; i < num_tasks; ++i) {
+                task(i);
+            }
+            return;
+        }
+        if (num_tasks > UINT32_MAX) {
+            throw std::runtime_error("ERROR: Too many tasks in one batch.");
+        }
+        std::lock_guard<std::mutex> run_lock(this->_run_mutex);
+
+        size_t num_threads = size();
+        for (size_t i = 0; i < num_threads; ++i) {
+            this->_slices[i].range.store(_pack(
+                num_tasks * i / num_threads, num_tasks * (i + 1) / num_threads
+            ));
+        }
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_task = task;
+            this->_running = this->_workers.size();
+            ++this->_generation;
+        }
+        this->_start.notify_all();
+
+        _drain(0);
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_done.wait(lock, [this] { return this->_running == 0; });
+        this->_task = nullptr;
+    }
+
+    // _work(index)
+    //   The loop of the worker owning slice `index`: waits for a batch, runs
+    //   its tasks, and reports back.
+    void _work(size_t index) {
+        uint64_t generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(this->_mutex);
+                this->_start.wait(lock, [&] {
+                    return this->_stopping || this->_generation != generation;
+                });
+                if (this->_stopping) {
+                    return;
+                }
+                generation = this->_generation;
+            }
+
+            _drain(index);
+
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            if (--this->_running == 0) {
+                this->_done.notify_one();
+            }
+        }
+    }
+
+    // _current()
+    //   The pool whose tasks the calling thread is running, if any.
+    static ThreadPool*& _current() {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    // _drain(index)
+    //   Runs the tasks of slice `index`, then steals from the other slices
+    //   until every slice is empty. An exception escaping a task terminates
+    //   the program here, as the batch could not be abandoned safely.
+    void _drain(size_t index) noexcept {
+        ThreadPool* outer = _current();
+        _current() = this;
+        size_t task;
+        while (_pop(this->_slices[index], task)) {
+            this->_task(task);
+        }
+        for (size_t i = 1; i < size(); ++i) {
+            TaskSlice& victim = this->_slices[(index + i) % size()];
+            while (_steal(victim, task)) {
+                this->_task(task);
+            }
+        }
+        _current() = outer;
+    }
+
+    // _pack(next, end)
+    //   Packs a slice's range of tasks into one word.
+    static uint64_t _pack(uint64_t next, uint64_t end) {
+        return (next << 32) | end;
+    }
+
+    // _pop(slice, task)
+    //   Claims the first task of a slice. Returns false if it is empty.
+    static bool _pop(TaskSlice& slice, size_t& task) {
+        uint64_t range = slice.range.load();
+        while ((range >> 32) < (range & UINT32_MAX)) {
+            uint64_t claimed = range + (1ULL << 32);
+            if (slice.range.compare_exchange_weak(range, claimed)) {
+                task = range >> 32;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // _steal(slice, task)
+    //   Claims the last task of another thread's slice. Returns false if it
+    //   is empty.
+    static bool _steal(TaskSlice& slice, size_t& task) {
+        uint64_t range = slice.range.load();
+        while ((range >> 32) < (range & UINT32_MAX)) {
+            if (slice.range.compare_exchange_weak(range, range - 1)) {
+                task = (range & UINT32_MAX) - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+};
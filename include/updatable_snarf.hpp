@@ -0,0 +1,241 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "snarf.hpp"
+
+// Default number of inserted keys buffered before they are merged into the
+// filter.
+#define UPDATE_BUFFER_SIZE 4096
+
+
+// UpdatableSNARF
+//   A SNARF that takes inserts. New keys go to a small buffer that queries
+//   check alongside the filter. Once it holds `buffer_size` keys, the
+//   buffer is frozen and a background thread merges it into the filter (see
+//   SNARF::merged()), while a new buffer takes further inserts. Queries read
+//   an immutable snapshot of the filter and buffers, which inserts and merges
+//   replace atomically, so they never wait for either. Inserts are
+//   serialized with each other.
+template <
+    typename Key,
+    typename Model = LinearSplineModel<Key>,
+    typename Codec = GolombCodec
+>
+struct UpdatableSNARF {
+    typedef SNARF<Key, Model, Codec> Filter;
+
+    // Snapshot
+    //   Everything a query checks: the filter, the frozen buffer being merged
+    //   into it, if any, and the buffer of later inserts. Never modified once
+    //   published.
+    //
+    //   The buffer is a list of sorted runs whose sizes are distinct powers
+    //   of two, largest first, like the bits of `buffered`. An insert adds a
+    //   run of one key and merges it with the runs of the same size, so the
+    //   runs are shared between snapshots and an insert moves O(log n) keys
+    //   amortized instead of copying the whole buffer.
+    struct Snapshot {
+        std::shared_ptr<const Filter> filter;
+        std::shared_ptr<const std::vector<Key> > frozen;
+        std::vector<std::shared_ptr<const std::vector<Key> > > runs;
+        // The number of keys in `runs`.
+        size_t buffered = 0;
+    };
+
+    // The current snapshot. Only accessed with std::atomic_load() and
+    // std::atomic_store(), as queries read it without a lock.
+    std::shared_ptr<const Snapshot> _snapshot;
+    // The number of buffered keys that starts a merge.
+    size_t _buffer_size;
+    // Serializes the updates of the snapshot, and guards `_stopping`.
+    std::mutex _mutex;
+    // Wakes the merger when a buffer is frozen or on destruction.
+    std::condition_variable _frozen;
+    // Signals that a merge has been published.
+    std::condition_variable _merged;
+    bool _stopping;
+    // The background thread that merges frozen buffers.
+    std::thread _merger;
+
+    // UpdatableSNARF(filter, buffer_size)
+    //   Takes inserts on top of `filter`, merging them in every `buffer_size`
+    //   keys.
+    explicit UpdatableSNARF(
+        Filter filter, size_t buffer_size = UPDATE_BUFFER_SIZE
+    ) :
+        _buffer_size(buffer_size > 0 ? buffer_size : 1),
+        _stopping(false)
+    {
+        std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+        snapshot->filter = std::make_shared<const Filter>(std::move(filter));
+        this->_snapshot = snapshot;
+        this->_merger = std::thread(&UpdatableSNARF::_merge_frozen, this);
+    }
+
+    UpdatableSNARF(const UpdatableSNARF&) = delete;
+    UpdatableSNARF& operator=(const UpdatableSNARF&) = delete;
+
+    // ~UpdatableSNARF()
+    //   Stops the merger, waiting for a merge in progress. Keys still
+    //   buffered are dropped with the structure.
+    ~UpdatableSNARF() {
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_stopping = true;
+        }
+        this->_frozen.notify_one();
+        this->_merger.join();
+    }
+
+    // insert(key)
+    //   Adds `key`. It is found by every query that starts after this
+    //   returns.
+    void insert(const Key& key) {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        std::shared_ptr<Snapshot> next = std::make_shared<Snapshot>(
+            *std::atomic_load(&this->_snapshot)
+        );
+        std::vector<Key> run(1, key);
+        while (!next->runs.empty() && next->runs.back()->size() <= run.size()) {
+            const std::vector<Key>& last = *next->runs.back();
+            std::vector<Key> merged(last.size() + run.size());
+            std::merge(
+                last.begin(), last.end(), run.begin(), run.end(),
+                merged.begin()
+            );
+            run.swap(merged);
+            next->runs.pop_back();
+        }
+        next->runs.push_back(
+            std::make_shared<const std::vector<Key> >(std::move(run))
+        );
+        next->buffered += 1;
+        _publish(next, next->buffered >= this->_buffer_size);
+    }
+
+    // flush()
+    //   Merges every key inserted so far into the filter, and waits until
+    //   it is done. Keys inserted meanwhile are merged as well.
+    void flush() {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (true) {
+            std::shared_ptr<const Snapshot> snapshot =
+                std::atomic_load(&this->_snapshot);
+            if (!snapshot->frozen) {
+                if (snapshot->runs.empty()) {
+                    return;
+                }
+                _publish(std::make_shared<Snapshot>(*snapshot), true);
+            }
+            this->_merged.wait(lock);
+        }
+    }
+
+    // filter()
+    //   Returns the current filter, without the keys still buffered.
+    std::shared_ptr<const Filter> filter() const {
+        return std::atomic_load(&this->_snapshot)->filter;
+    }
+
+    // range_query(lower, upper)
+    //   Checks if any key within [lower, upper] may have been inserted, in
+    //   the filter or in a buffer.
+    bool range_query(const Key& lower, const Key& upper) const {
+        std::shared_ptr<const Snapshot> snapshot =
+            std::atomic_load(&this->_snapshot);
+        if (snapshot->filter->range_query(lower, upper)
+            || (snapshot->frozen && _any_key_between(
+                *snapshot->frozen, lower, upper
+            ))) {
+            return true;
+        }
+        for (const auto& run : snapshot->runs) {
+            if (_any_key_between(*run, lower, upper)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // _any_key_between(keys, lower, upper)
+    //   Checks if any of the sorted `keys` is within [lower, upper].
+    static bool _any_key_between(
+        const std::vector<Key>& keys, const Key& lower, const Key& upper
+    ) {
+        auto key = std::lower_bound(keys.begin(), keys.end(), lower);
+        return key != keys.end() && !(upper < *key);
+    }
+
+    // _publish(next, freeze)
+    //   Makes `next` the current snapshot. With `freeze`, its runs are
+    //   sorted into one frozen buffer for the merger first, unless it is
+    //   already merging one. Expects `_mutex` to be held.
+    void _publish(std::shared_ptr<Snapshot> next, bool freeze) {
+        freeze = freeze && !next->frozen && !next->runs.empty();
+        if (freeze) {
+            std::vector<Key> frozen;
+            frozen.reserve(next->buffered);
+            for (const auto& run : next->runs) {
+                frozen.insert(frozen.end(), run->begin(), run->end());
+            }
+            std::sort(frozen.begin(), frozen.end());
+            next->frozen = std::make_shared<const std::vector<Key> >(
+                std::move(frozen)
+            );
+            next->runs.clear();
+            next->buffered = 0;
+        }
+        std::atomic_store(
+            &this->_snapshot, std::shared_ptr<const Snapshot>(next)
+        );
+        if (freeze) {
+            this->_frozen.notify_one();
+        }
+    }
+
+    // _merge_frozen()
+    //   The loop of the merger: waits for a frozen buffer, merges it into a
+    //   copy of the filter without holding the lock, and publishes the new
+    //   filter in place of the frozen buffer. A buffer that filled up in the
+    //   meantime is frozen right away.
+    void _merge_frozen() {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (true) {
+            this->_frozen.wait(lock, [this] {
+                return this->_stopping
+                    || std::atomic_load(&this->_snapshot)->frozen;
+            });
+            if (this->_stopping) {
+                return;
+            }
+
+            std::shared_ptr<const Snapshot> snapshot =
+                std::atomic_load(&this->_snapshot);
+            lock.unlock();
+            std::shared_ptr<const Filter> filter =
+                std::make_shared<const Filter>(
+                    snapshot->filter->merged(*snapshot->frozen)
+                );
+            lock.lock();
+
+            std::shared_ptr<Snapshot> next = std::make_shared<Snapshot>(
+                *std::atomic_load(&this->_snapshot)
+            );
+            next->filter = filter;
+            next->frozen.reset();
+            _publish(next, next->buffered >= this->_buffer_size);
+            this->_merged.notify_all();
+        }
+    }
+};
@@ -10,8 +10,17 @@ int main() {
     assert(TestBaseModel().run_base_model_tests() == 0);
     assert(TestBaseSplineModel().run_base_spline_model_tests() == 0);
     assert(TestLinearSplineModel().run_linear_spline_model_tests() == 0);
+    assert(TestRMIModel().run_rmi_model_tests() == 0);
+    assert(TestKernelSplineModel().run_kernel_spline_model_tests() == 0);
+    assert(TestMixedSplineModel().run_mixed_spline_model_tests() == 0);
+    assert(TestCompactSplineModel().run_compact_spline_model_tests() == 0);
     assert(TestBitArray().run_bit_array_tests() == 0);
+    assert(TestCodec().run_codec_tests() == 0);
+    assert(TestThreadPool().run_thread_pool_tests() == 0);
+    assert(TestRadixSort().run_radix_sort_tests() == 0);
     assert(TestSNARF().run_snarf_tests() == 0);
+    assert(TestUpdatableSNARF().run_updatable_snarf_tests() == 0);
+    assert(TestSNARFBuilder().run_snarf_builder_tests() == 0);
 
     std::cout << "All tests passed :)" << std::endl;
 }
@@ -101,6 +101,65 @@ void TestBaseModel::test_build_key_array_final_key_inclusion() {
 }
 
 
+void TestBaseModel::test_sample_key_array() {
+    std::mt19937_64 rng(83);
+    std::vector<int> input_keys(1000);
+    for (auto& key : input_keys) {
+        key = rng() % 300;     // with duplicates
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    // The key array spreads ceil(N / R) entries evenly over the eCDF of
+    // the input keys, ending at the final key.
+    size_t Rs[] = {1, 3, 7, 64, 999, 1000};
+    for (size_t R : Rs) {
+        MockModel<int> model(input_keys, R);
+        size_t size = (input_keys.size() + R - 1) / R;
+        assert(model._key_array.size() == size);
+        for (size_t i = 0; i < size; ++i) {
+            size_t index = (i + 1) * input_keys.size() / size - 1;
+            assert(model._key_array[i].first == input_keys[index]);
+            assert(
+                model._key_array[i].second
+                    == (index + 1) * 1.0 / input_keys.size()
+            );
+        }
+        assert(model._key_array.back().second == 1.0);
+    }
+}
+
+
+void TestBaseModel::test_build_error_bounded_key_array() {
+    // Evenly spaced keys lie on one line through the first and last key.
+    std::vector<int> linear_keys;
+    for (int i = 0; i < 1000; ++i) {
+        linear_keys.push_back(i * 10);
+    }
+    MockModel<int> linear_model(linear_keys, ErrorBound(0.001));
+    assert(linear_model._key_array.size() == 2);
+    assert(linear_model._key_array[0].first == 0);
+    assert(linear_model._key_array[1].first == 9990);
+    assert_double_equals(linear_model._key_array[1].second, 1.0);
+
+    // Repeated keys keep the eCDF of their last copy.
+    std::vector<int> keys = {1, 1, 1, 1, 2, 3, 50, 51, 52, 100};
+    MockModel<int> model(keys, ErrorBound(0.01));
+    assert(model._key_array[0].first == 1);
+    assert_double_equals(model._key_array[0].second, 0.4);
+    for (size_t i = 1; i < model._key_array.size(); ++i) {
+        assert(model._key_array[i - 1].first < model._key_array[i].first);
+    }
+    assert(model._key_array.back().first == 100);
+
+    try {
+        MockModel<int> invalid_model(keys, ErrorBound(0.0));
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+}
+
+
 int TestBaseModel::run_base_model_tests() {
     test_constructor_success_valid_inputs();
     test_constructor_failure_large_R();
@@ -110,6 +169,8 @@ int TestBaseModel::run_base_model_tests() {
     test_build_key_array_correct_sampling();
     test_build_key_array_varying_R();
     test_build_key_array_final_key_inclusion();
+    test_sample_key_array();
+    test_build_error_bounded_key_array();
 
     std::cout << "All BaseModel unit tests passed successfully.\n";
     return 0;
@@ -19,8 +19,150 @@ void TestBaseSplineModel::test_binary_search() {
 }
 
 
+void TestBaseSplineModel::test_eytzinger_search() {
+    std::vector<int> input_keys = {1, 3, 5};
+    MockBaseSplineModel<int> model(input_keys, 1);
+    model.set_search_layout(SEARCH_LAYOUT_EYTZINGER);
+    assert(model._eytzinger_keys.size() == 4);
+
+    assert(model.binary_search(0) == 0); // below range
+    assert(model.binary_search(1) == 0); // first element
+    assert(model.binary_search(2) == 1); // between first and second
+    assert(model.binary_search(3) == 1); // second element
+    assert(model.binary_search(5) == 2); // last element
+    assert(model.binary_search(6) == 2); // above range
+
+    // Agrees with the sorted search on trees of every shape, with duplicates.
+    std::mt19937_64 rng(19);
+    for (size_t size = 1; size < 300; size += 1 + size / 8) {
+        std::vector<uint64_t> keys(size);
+        for (auto& key : keys) {
+            key = rng() % 1000;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        MockBaseSplineModel<uint64_t> sorted(keys, 1);
+        MockBaseSplineModel<uint64_t> eytzinger(keys, 1);
+        eytzinger.set_search_layout(SEARCH_LAYOUT_EYTZINGER);
+        for (uint64_t key = 0; key < 1001; ++key) {
+            assert(eytzinger.binary_search(key) == sorted.binary_search(key));
+        }
+    }
+
+    // Switching back releases the Eytzinger copy.
+    model.set_search_layout(SEARCH_LAYOUT_SORTED);
+    assert(model._eytzinger_keys.empty());
+    assert(model.binary_search(2) == 1);
+}
+
+
+void TestBaseSplineModel::test_radix_search() {
+    std::vector<int> input_keys = {1, 3, 5};
+    MockBaseSplineModel<int> model(input_keys, 1);
+    model.set_search_layout(SEARCH_LAYOUT_RADIX, 2);
+    assert(model._radix_table.size() == 5);
+    assert(model._eytzinger_keys.empty());
+
+    assert(model.binary_search(-7) == 0); // below range
+    assert(model.binary_search(1) == 0); // first element
+    assert(model.binary_search(2) == 1); // between first and second
+    assert(model.binary_search(3) == 1); // second element
+    assert(model.binary_search(5) == 2); // last element
+    assert(model.binary_search(60) == 2); // above range
+
+    // Agrees with the sorted search on skewed keys, for any table size.
+    std::mt19937_64 rng(37);
+    std::vector<uint64_t> keys(5000);
+    for (auto& key : keys) {
+        key = (rng() % 100) * (rng() % 100) * (rng() % 100) * 1000003ULL;
+    }
+    std::sort(keys.begin(), keys.end());
+    MockBaseSplineModel<uint64_t> sorted(keys, 1);
+
+    size_t radix_bits[] = {1, 4, 12, 20};
+    for (size_t bits : radix_bits) {
+        MockBaseSplineModel<uint64_t> radix(keys, 1);
+        radix.set_search_layout(SEARCH_LAYOUT_RADIX, bits);
+        for (size_t i = 0; i < 20000; ++i) {
+            uint64_t key = rng() % (keys.back() + 1000);
+            assert(radix.binary_search(key) == sorted.binary_search(key));
+        }
+        for (uint64_t key : keys) {
+            assert(radix.binary_search(key) == sorted.binary_search(key));
+        }
+    }
+
+    // Floating-point keys, and a key array of one repeated key.
+    std::vector<double> doubles = {-2.5, -1.0, 0.0, 0.25, 3.0, 3.0, 8.0};
+    MockBaseSplineModel<double> sorted_doubles(doubles, 1);
+    MockBaseSplineModel<double> radix_doubles(doubles, 1);
+    radix_doubles.set_search_layout(SEARCH_LAYOUT_RADIX, 3);
+    for (double key = -4.0; key < 10.0; key += 0.125) {
+        assert(
+            radix_doubles.binary_search(key)
+                == sorted_doubles.binary_search(key)
+        );
+    }
+
+    MockBaseSplineModel<int> same({7, 7, 7}, 1);
+    same.set_search_layout(SEARCH_LAYOUT_RADIX, 4);
+    assert(same.binary_search(6) == 0);
+    assert(same.binary_search(8) == 2);
+
+    // The table size is bounded.
+    try {
+        model.set_search_layout(SEARCH_LAYOUT_RADIX, RADIX_TABLE_MAX_BITS + 1);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+}
+
+
+void TestBaseSplineModel::test_binary_search_batch() {
+    std::mt19937_64 rng(61);
+    for (size_t size = 1; size < 3000; size = size * 3 + 1) {
+        std::vector<uint64_t> keys(size);
+        for (auto& key : keys) {
+            key = rng() % 100000;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        // Random keys, then sorted keys, with some outside the key array and
+        // a batch size that leaves a partial group.
+        std::vector<uint64_t> queries(1003);
+        for (auto& key : queries) {
+            key = rng() % 101000;
+        }
+        std::vector<uint64_t> sorted_queries(queries);
+        std::sort(sorted_queries.begin(), sorted_queries.end());
+        std::vector<size_t> indexes(queries.size());
+
+        SearchLayout layouts[] = {
+            SEARCH_LAYOUT_SORTED, SEARCH_LAYOUT_EYTZINGER, SEARCH_LAYOUT_RADIX
+        };
+        for (SearchLayout layout : layouts) {
+            MockBaseSplineModel<uint64_t> model(keys, 1);
+            model.set_search_layout(layout, 6);
+            for (const auto* batch : {&queries, &sorted_queries}) {
+                model.binary_search_batch(
+                    batch->data(), batch->size(), indexes.data()
+                );
+                for (size_t i = 0; i < batch->size(); ++i) {
+                    assert(indexes[i] == model.binary_search((*batch)[i]));
+                }
+            }
+            model.binary_search_batch(queries.data(), 0, indexes.data());
+        }
+    }
+}
+
+
 int TestBaseSplineModel::run_base_spline_model_tests() {
     test_binary_search();
+    test_eytzinger_search();
+    test_radix_search();
+    test_binary_search_batch();
 
     std::cout << "All BaseSplineModel unit tests passed successfully.\n";
     return 0;
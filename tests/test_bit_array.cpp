@@ -8,17 +8,17 @@
 
 void TestBitArray::test_default_constructor() {
     BitArray ba = BitArray();  // empty bit array
-    assert(ba._bit_array.size() == 0);
+    assert(ba.size() == 0);
 }
 
 
 void TestBitArray::test_initialize_bit_array() {
     BitArray ba = BitArray();  // empty bit array
-    assert(ba._bit_array.size() == 0);
+    assert(ba.size() == 0);
 
     size_t size = 64;
     ba._initialize_bit_array(size);
-    assert(ba._bit_array.size() == size);
+    assert(ba.size() == size);
     // Verify that all bits are initialized to 0.
     for (size_t i = 0; i < size; ++i) {
         assert(ba.read_bit(i) == 0);
@@ -30,7 +30,7 @@ void TestBitArray::test_constructor() {
     size_t size = 64;
     BitArray ba(size);
      // Verify the size is correctly set.
-    assert(ba._bit_array.size() == size);
+    assert(ba.size() == size);
 
     // Verify that all bits are initialized to 0.
     for (size_t i = 0; i < size; ++i) {
@@ -56,6 +56,136 @@ void TestBitArray::test_read_bit() {
 }
 
 
+void TestBitArray::test_write_and_read_across_words() {
+    BitArray ba(200);
+
+    // A 13-bit field straddling the first word boundary.
+    ba.write_bits(58, 0x1ABC, 13);
+    assert(ba.read_bits(58, 13) == 0x1ABC);
+
+    // A full 64-bit field at an unaligned offset.
+    uint64_t value = 0xDEADBEEFCAFEF00DULL;
+    ba.write_bits(100, value, 64);
+    assert(ba.read_bits(100, 64) == value);
+
+    // Neighbouring fields are left untouched.
+    assert(ba.read_bits(58, 13) == 0x1ABC);
+    assert(ba.read_bits(71, 29) == 0);
+    assert(ba.read_bits(164, 36) == 0);
+}
+
+
+void TestBitArray::test_write_bits_overwrites() {
+    BitArray ba(128);
+
+    ba.write_bits(60, 0xFF, 8);
+    ba.write_bits(60, 0x5, 8);      // overwrite with a smaller value
+    assert(ba.read_bits(60, 8) == 0x5);
+
+    // Bits of `value` above `num_bits` are ignored.
+    ba.write_bits(0, 0xFFFF, 4);
+    assert(ba.read_bits(0, 8) == 0xF);
+}
+
+
+void TestBitArray::test_copy_bits() {
+    BitArray source(300);
+    std::mt19937_64 rng(7);
+    for (size_t offset = 0; offset + 64 <= 300; offset += 64) {
+        source.write_bits(offset, rng(), 64);
+    }
+
+    // Ranges shorter than, equal to and longer than a word, between offsets
+    // that are not aligned alike.
+    size_t lengths[] = {0, 5, 64, 150};
+    for (size_t num_bits : lengths) {
+        BitArray ba(300);
+        ba.write_bits(0, ~0ULL, 64);
+        ba.write_bits(236, ~0ULL, 64);
+        ba.copy_bits(source, 13, 70, num_bits);
+        for (size_t i = 0; i < num_bits; ++i) {
+            assert(ba.read_bit(70 + i) == source.read_bit(13 + i));
+        }
+
+        // The bits around the range are left untouched.
+        assert(ba.read_bits(0, 64) == ~0ULL);
+        for (size_t i = 64; i < 236; ++i) {
+            if (i < 70 || i >= 70 + num_bits) {
+                assert(!ba.read_bit(i));
+            }
+        }
+        assert(ba.read_bits(236, 64) == ~0ULL);
+    }
+}
+
+
+void TestBitArray::test_next_one() {
+    BitArray ba(300);
+    ba.write_bits(3, 1, 1);
+    ba.write_bits(70, 1, 1);
+    ba.write_bits(255, 1, 1);
+
+    assert(ba.next_one(0) == 3);
+    assert(ba.next_one(3) == 3);
+    assert(ba.next_one(4) == 70);       // skips the rest of the first word
+    assert(ba.next_one(71) == 255);     // skips whole words of zeros
+    assert(ba.next_one(256) == ba.size());
+}
+
+
+void TestBitArray::test_select_zero() {
+    BitArray ba(200);
+    ba.write_bits(0, 0xFF, 8);          // bits 0..7 set
+    ba.write_bits(64, ~0ULL, 64);       // the whole second word set
+
+    assert(ba.select_zero(0, 0) == 8);
+    assert(ba.select_zero(0, 55) == 63);
+    assert(ba.select_zero(0, 56) == 128);   // skips the full word
+    assert(ba.select_zero(10, 0) == 10);
+    assert(ba.select_zero(0, 127) == 199);
+    assert(ba.select_zero(0, 128) == ba.size());    // past the end
+
+    // Cross-check against a bit-by-bit scan.
+    BitArray pattern(500);
+    for (size_t i = 0; i < 500; i += 1 + i % 7) {
+        pattern.write_bits(i, 1, 1);
+    }
+    size_t rank = 0;
+    for (size_t i = 0; i < 500; ++i) {
+        if (!pattern.read_bit(i)) {
+            assert(pattern.select_zero(0, rank++) == i);
+        }
+    }
+}
+
+
+void TestBitArray::test_select_one() {
+    BitArray ba(300);
+    ba.write_bits(3, 1, 1);
+    ba.write_bits(64, ~0ULL, 64);       // the whole second word set
+    ba.write_bits(250, 1, 1);
+
+    assert(ba.select_one(0, 0) == 3);
+    assert(ba.select_one(0, 1) == 64);
+    assert(ba.select_one(4, 0) == 64);
+    assert(ba.select_one(0, 64) == 127);
+    assert(ba.select_one(0, 65) == 250);    // skips the empty word
+    assert(ba.select_one(0, 66) == ba.size());      // past the end
+
+    // Cross-check against a bit-by-bit scan.
+    BitArray pattern(500);
+    for (size_t i = 0; i < 500; i += 1 + i % 5) {
+        pattern.write_bits(i, 1, 1);
+    }
+    size_t rank = 0;
+    for (size_t i = 0; i < 500; ++i) {
+        if (pattern.read_bit(i)) {
+            assert(pattern.select_one(0, rank++) == i);
+        }
+    }
+}
+
+
 void TestBitArray::test_size_bytes() {
     BitArray ba_1(64); // 64 bits should use 8 bytes
     assert(ba_1.size_bytes() == 8); // verify the size in bytes is correct
@@ -74,6 +204,12 @@ int TestBitArray::run_bit_array_tests() {
     test_constructor();
     test_write_and_read_bits();
     test_read_bit();
+    test_write_and_read_across_words();
+    test_write_bits_overwrites();
+    test_copy_bits();
+    test_next_one();
+    test_select_zero();
+    test_select_one();
     test_size_bytes();
 
     std::cout << "All BitArray unit tests passed successfully.\n";
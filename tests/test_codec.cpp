@@ -0,0 +1,124 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include "../include/base_test_utils.hpp"
+
+
+// check_codec(codec, locations, lower_bound)
+//   Encodes the sorted `locations` at an unaligned offset and checks every
+//   part of the codec interface against them.
+template <typename Codec>
+static void check_codec(
+    const Codec& codec, const std::vector<size_t>& locations,
+    size_t lower_bound
+) {
+    size_t num_keys = locations.size();
+    size_t offset = 37;
+    size_t end = offset + codec.block_bits(num_keys);
+    BitArray bits(end + 11);
+    codec.encode(
+        locations.data(), locations.data() + num_keys, lower_bound, bits,
+        offset
+    );
+
+    assert(codec.block_num_keys(bits, offset, end) == num_keys);
+    std::vector<size_t> decoded(num_keys);
+    codec.decode(bits, offset, num_keys, decoded.data());
+    for (size_t i = 0; i < num_keys; ++i) {
+        assert(
+            codec.location(bits, offset, num_keys, i)
+                == locations[i] - lower_bound
+        );
+        assert(decoded[i] == locations[i] - lower_bound);
+    }
+
+    // Compare range queries against a scan of the locations.
+    std::mt19937_64 rng(num_keys);
+    for (size_t i = 0; i < 500; ++i) {
+        size_t lower = rng() % codec._block_range;
+        size_t upper = std::min(
+            lower + rng() % 64, codec._block_range - 1
+        );
+        bool expected = false;
+        for (size_t location : locations) {
+            size_t value = location - lower_bound;
+            expected = expected || (value >= lower && value <= upper);
+        }
+        assert(
+            codec.range_query(bits, offset, num_keys, lower, upper) == expected
+        );
+    }
+}
+
+
+// random_block(num_keys, block_range, lower_bound, rng)
+//   Returns `num_keys` sorted random locations within one block.
+static std::vector<size_t> random_block(
+    size_t num_keys, size_t block_range, size_t lower_bound,
+    std::mt19937_64& rng
+) {
+    std::vector<size_t> locations(num_keys);
+    for (auto& location : locations) {
+        location = lower_bound + rng() % block_range;
+    }
+    std::sort(locations.begin(), locations.end());
+    return locations;
+}
+
+
+void TestCodec::test_golomb_codec() {
+    std::mt19937_64 rng(3);
+    GolombCodec codec(7, 100 << 7);
+    assert(codec.block_bits(0) == 100);
+    assert(codec.block_bits(100) == 900);
+
+    size_t sizes[] = {0, 1, 50, 100, 300};
+    for (size_t num_keys : sizes) {
+        check_codec(codec, random_block(num_keys, 100 << 7, 12800, rng), 12800);
+    }
+}
+
+
+void TestCodec::test_elias_fano_codec() {
+    std::mt19937_64 rng(5);
+    EliasFanoCodec codec(7, 100 << 7);
+
+    size_t sizes[] = {0, 1, 2, 13, 100, 1000, 20000};
+    for (size_t num_keys : sizes) {
+        check_codec(codec, random_block(num_keys, 100 << 7, 0, rng), 0);
+    }
+
+    // Duplicate locations and the extremes of the block.
+    std::vector<size_t> edges = {0, 0, 5, 5, 5, (100 << 7) - 1};
+    check_codec(codec, edges, 0);
+}
+
+
+void TestCodec::test_elias_fano_width() {
+    EliasFanoCodec codec(7, 100 << 7);
+    GolombCodec golomb(7, 100 << 7);
+
+    // At the nominal density it matches Golomb, plus the width field.
+    assert(codec._low_width(100) == 7);
+    assert(codec.block_bits(100) == golomb.block_bits(100) + EF_WIDTH_BITS);
+
+    // Sparse blocks use wider low parts and fewer unary '0's, dense blocks
+    // narrower ones, and both are smaller than with a fixed width.
+    assert(codec._low_width(10) == 10);
+    assert(codec._low_width(1000) == 3);
+    assert(codec.block_bits(0) < 10);
+    assert(codec.block_bits(10) < golomb.block_bits(10));
+    assert(codec.block_bits(1000) < golomb.block_bits(1000));
+}
+
+
+int TestCodec::run_codec_tests() {
+    test_golomb_codec();
+    test_elias_fano_codec();
+    test_elias_fano_width();
+
+    std::cout << "All codec unit tests passed successfully.\n";
+    return 0;
+}
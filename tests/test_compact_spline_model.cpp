@@ -0,0 +1,187 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include "../include/base_test_utils.hpp"
+
+
+// skewed_keys(num_keys, seed)
+//   Returns sorted lognormally distributed keys, with duplicates.
+static std::vector<uint64_t> skewed_keys(size_t num_keys, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::lognormal_distribution<double> distribution(0.0, 2.0);
+    std::vector<uint64_t> keys(num_keys);
+    for (auto& key : keys) {
+        key = uint64_t(distribution(rng) * 1e9);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+
+void TestCompactSplineModel::test_constructor() {
+    std::vector<uint64_t> keys = skewed_keys(10000, 43);
+    CompactSplineModel<uint64_t> model(keys, 7);
+    LinearSplineModel<uint64_t> linear(keys, 7);
+
+    // The knots decode back to the sampled keys and exact ranks.
+    size_t size = linear._key_array.size();
+    assert(model._sizes[0] == size);
+    assert(model._sizes[1] == keys.size());
+    assert(model._key_array.empty());
+    for (size_t i = 0; i < size; ++i) {
+        assert(model._key(i) == linear._key_array[i].first);
+        assert(
+            model._rank(i)
+                == uint64_t(llround(linear._key_array[i].second * keys.size()))
+        );
+    }
+
+    // Every frame is packed at the widths of its last offsets.
+    assert(
+        model._frames.size()
+            == (size + SPLINE_FRAME_SIZE - 1) / SPLINE_FRAME_SIZE
+    );
+    for (size_t f = 0; f < model._frames.size(); ++f) {
+        size_t last = std::min((f + 1) * SPLINE_FRAME_SIZE, size) - 1;
+        assert(model._frame_keys[f] == model._key(f * SPLINE_FRAME_SIZE));
+        assert(
+            model._frames[f].key_width
+                == model._bit_width(model._key(last) - model._frame_keys[f])
+        );
+        assert(
+            model._frames[f].rank_width == model._bit_width(
+                model._rank(last) - model._frames[f].first_rank
+            )
+        );
+    }
+
+    try {
+        CompactSplineModel<uint64_t> invalid_model(keys, keys.size() + 1);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+}
+
+
+void TestCompactSplineModel::test_predict() {
+    std::vector<uint64_t> keys = skewed_keys(20000, 47);
+    CompactSplineModel<uint64_t> model(keys, 16);
+    LinearSplineModel<uint64_t> linear(keys, 16);
+
+    // Queries between, at and beyond the knots agree with the linear spline.
+    std::mt19937_64 rng(53);
+    double previous = 0.0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        double cdf = model.predict(keys[i]);
+        assert(std::abs(cdf - linear.predict(keys[i])) < 1e-9);
+        assert(cdf >= previous);
+        previous = cdf;
+    }
+    std::vector<uint64_t> queries(10000);
+    for (auto& key : queries) {
+        key = rng() % (keys.back() + keys.back() / 10);
+    }
+    std::vector<double> cdfs(queries.size());
+    model.predict_batch(queries.data(), queries.size(), cdfs.data());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        double cdf = model.predict(queries[i]);
+        assert(std::abs(cdf - linear.predict(queries[i])) < 1e-9);
+        assert(cdfs[i] == cdf);
+    }
+    assert(model.predict(0) == 0.0);
+    assert(model.predict(keys.back()) == 1.0);
+    assert(model.predict(UINT64_MAX) == 1.0);
+
+    // Signed keys keep their order across zero. Below a negative first knot
+    // the prediction is 0.
+    std::vector<int64_t> signed_keys;
+    for (int64_t i = -5000; i < 5000; ++i) {
+        signed_keys.push_back(i * 1000 + (i % 7));
+    }
+    CompactSplineModel<int64_t> signed_model(signed_keys, 10);
+    LinearSplineModel<int64_t> signed_linear(signed_keys, 10);
+    int64_t first_knot = signed_linear._key_array[0].first;
+    previous = 0.0;
+    for (int64_t key = -6000000; key < 6000000; key += 999) {
+        double cdf = signed_model.predict(key);
+        if (key <= first_knot) {
+            assert(cdf == 0.0);
+        } else {
+            assert(std::abs(cdf - signed_linear.predict(key)) < 1e-9);
+        }
+        assert(cdf >= previous);
+        previous = cdf;
+    }
+}
+
+
+void TestCompactSplineModel::test_error_bound() {
+    std::vector<uint64_t> keys = skewed_keys(20000, 59);
+    double bound = 0.0005;
+    CompactSplineModel<uint64_t> model(keys, ErrorBound(bound));
+    LinearSplineModel<uint64_t> linear(keys, ErrorBound(bound));
+    assert(model._sizes[0] == linear._key_array.size());
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i + 1 == keys.size() || keys[i + 1] != keys[i]) {
+            double ecdf = (i + 1) * 1.0 / keys.size();
+            assert(std::abs(model.predict(keys[i]) - ecdf) <= bound + 1e-9);
+        }
+    }
+
+    // The packed knots take a fraction of the linear spline's space.
+    assert(model.size_bytes() * 2 < linear.size_bytes());
+}
+
+
+void TestCompactSplineModel::test_size_bytes() {
+    std::vector<int> keys;
+    for (int i = 1; i <= 100; ++i) {
+        keys.push_back(i * 10);
+    }
+    CompactSplineModel<int> model(keys, 10);
+
+    // The sizes (16 bytes), one frame of 10 knots (4 bytes for the first key
+    // and 24 for the packing), its key offsets of 900 at most in 10 bits and
+    // its rank offsets of 90 at most in 7 bits.
+    assert(model._sizes[0] == 10);
+    assert(model._frames[0].key_width == 10);
+    assert(model._frames[0].rank_width == 7);
+    assert(model.size_bytes() == 16 + 4 + 24 + (10 * 17 + 7) / 8);
+}
+
+
+void TestCompactSplineModel::test_single_knot_frame() {
+    // 33 knots: a full frame whose offsets end on a word boundary, and a
+    // last frame of one knot packed in zero bits at the very end.
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 0; i < 33; ++i) {
+        keys.push_back(3 * i + 1);
+    }
+    CompactSplineModel<uint64_t> model(keys, 1);
+    assert(model._frames.size() == 2);
+    assert(model._frames[1].key_width == 0 && model._frames[1].rank_width == 0);
+    assert(model._frames[1].offset == model._deltas.size());
+    assert(model._deltas.size() % 64 == 0);
+
+    assert(model._key(32) == 97 && model._rank(32) == 33);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        assert(std::abs(model.predict(keys[i]) - (i + 1) / 33.0) < 1e-12);
+    }
+    assert(model.predict(1000) == 1.0);
+}
+
+
+int TestCompactSplineModel::run_compact_spline_model_tests() {
+    test_constructor();
+    test_predict();
+    test_error_bound();
+    test_size_bytes();
+    test_single_knot_frame();
+
+    std::cout << "All CompactSplineModel unit tests passed successfully.\n";
+    return 0;
+}
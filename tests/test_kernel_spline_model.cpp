@@ -0,0 +1,229 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include "../include/base_test_utils.hpp"
+
+
+// check_kernel<Kernel>(coefficients)
+//   Checks that the kernel with the given coefficients runs from (0, 0) to
+//   (1, 1) without decreasing.
+template <typename Kernel>
+static void check_kernel(const double* coefficients) {
+    assert(Kernel::evaluate(coefficients, 0.0) == 0.0);
+    assert_double_equals(Kernel::evaluate(coefficients, 1.0), 1.0);
+
+    double previous = 0.0;
+    for (int i = 1; i <= 1000; ++i) {
+        double value = Kernel::evaluate(coefficients, i / 1000.0);
+        assert(value >= previous);
+        previous = value;
+    }
+}
+
+
+// check_spline<Model>(keys)
+//   Checks that a kernel spline built on every 50th key passes through its
+//   key array, never decreases, and predicts the same in batches.
+template <typename Model>
+static void check_spline(const std::vector<uint64_t>& keys) {
+    Model model(keys, 50);
+    for (const auto& pair : model._key_array) {
+        assert_double_equals(model.predict(pair.first), pair.second);
+    }
+
+    std::vector<uint64_t> queries;
+    double previous = 0.0;
+    for (uint64_t key = 0; key <= keys.back() + 1000; key += 37) {
+        double cdf = model.predict(key);
+        assert(cdf >= previous && cdf <= 1.0);
+        previous = cdf;
+        queries.push_back(key);
+    }
+
+    std::reverse(queries.begin(), queries.end());
+    std::vector<double> cdfs(queries.size());
+    model.predict_batch(queries.data(), queries.size(), cdfs.data());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        assert(cdfs[i] == model.predict(queries[i]));
+    }
+}
+
+
+// max_error<Model>(model, keys)
+//   Returns the largest difference between a key's predicted CDF and its
+//   eCDF, over the last copy of every distinct key.
+template <typename Model>
+static double max_error(Model& model, const std::vector<uint64_t>& keys) {
+    double error = 0.0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i + 1 < keys.size() && keys[i + 1] == keys[i]) {
+            continue;
+        }
+        double ecdf = (i + 1) * 1.0 / keys.size();
+        error = std::max(error, std::abs(model.predict(keys[i]) - ecdf));
+    }
+    return error;
+}
+
+
+void TestKernelSplineModel::test_kernels() {
+    double identity[2];
+    QuadraticKernel::fit(KernelPointList(), identity);
+    assert_double_equals(QuadraticKernel::evaluate(identity, 0.3), 0.3);
+    CubicKernel::fit(KernelPointList(), identity);
+    assert_double_equals(CubicKernel::evaluate(identity, 0.3), 0.3);
+    LogarithmicKernel::fit(KernelPointList(), identity);
+    assert_double_equals(LogarithmicKernel::evaluate(identity, 0.3), 0.3);
+    ExponentialKernel::fit(KernelPointList(), identity);
+    assert_double_equals(ExponentialKernel::evaluate(identity, 0.3), 0.3);
+
+    double quadratic[] = {-1.0, -0.5, 0.0, 0.5, 1.0};
+    for (double a : quadratic) {
+        check_kernel<QuadraticKernel>(&a);
+    }
+
+    double cubic[][2] = {{0.0, 0.0}, {3.0, 3.0}, {0.0, 3.0}, {3.0, 0.0}};
+    for (const auto& slopes : cubic) {
+        check_kernel<CubicKernel>(slopes);
+    }
+
+    double logarithmic[] = {1e-3, 1.0, 1e9};
+    for (double a : logarithmic) {
+        check_kernel<LogarithmicKernel>(&a);
+    }
+
+    double exponential[] = {
+        -EXP_KERNEL_MAX_RATE, -1.0, 1.0, EXP_KERNEL_MAX_RATE
+    };
+    for (double a : exponential) {
+        check_kernel<ExponentialKernel>(&a);
+    }
+}
+
+
+void TestKernelSplineModel::test_fit() {
+    double quadratic = 0.5;
+    double cubic[] = {0.5, 2.0};
+    double logarithmic = 100.0;
+    double exponential = 3.0;
+
+    KernelPointList quadratic_points, cubic_points;
+    KernelPointList logarithmic_points, exponential_points;
+    for (int i = 1; i < 100; ++i) {
+        double t = i / 100.0;
+        quadratic_points.push_back(std::make_pair(
+            t, QuadraticKernel::evaluate(&quadratic, t)
+        ));
+        cubic_points.push_back(std::make_pair(
+            t, CubicKernel::evaluate(cubic, t)
+        ));
+        logarithmic_points.push_back(std::make_pair(
+            t, LogarithmicKernel::evaluate(&logarithmic, t)
+        ));
+        exponential_points.push_back(std::make_pair(
+            t, ExponentialKernel::evaluate(&exponential, t)
+        ));
+    }
+
+    double fitted[2];
+    QuadraticKernel::fit(quadratic_points, fitted);
+    assert_double_equals(fitted[0], quadratic);
+    CubicKernel::fit(cubic_points, fitted);
+    assert_double_equals(fitted[0], cubic[0]);
+    assert_double_equals(fitted[1], cubic[1]);
+    LogarithmicKernel::fit(logarithmic_points, fitted);
+    assert(std::abs(fitted[0] / logarithmic - 1.0) < 0.01);
+    ExponentialKernel::fit(exponential_points, fitted);
+    assert_double_equals(fitted[0], exponential);
+
+    // Points beyond what the kernel can follow are clamped to its limits.
+    KernelPointList step = {{0.1, 0.9}, {0.2, 1.0}, {0.5, 1.0}, {0.9, 1.0}};
+    QuadraticKernel::fit(step, fitted);
+    assert_double_equals(fitted[0], -1.0);
+    CubicKernel::fit(step, fitted);
+    assert(fitted[0] <= CUBIC_MAX_SLOPE && fitted[1] >= 0.0);
+}
+
+
+void TestKernelSplineModel::test_predict() {
+    std::mt19937_64 rng(19);
+    std::exponential_distribution<double> distribution(1.0);
+    std::vector<uint64_t> keys(5000);
+    for (auto& key : keys) {
+        key = uint64_t(distribution(rng) * 1000000);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    check_spline<QuadraticSplineModel<uint64_t> >(keys);
+    check_spline<CubicSplineModel<uint64_t> >(keys);
+    check_spline<LogarithmicSplineModel<uint64_t> >(keys);
+    check_spline<ExponentialSplineModel<uint64_t> >(keys);
+}
+
+
+void TestKernelSplineModel::test_error_bound() {
+    // Keys that thin out quadratically, so the CDF is a square root.
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 0; i < 20000; ++i) {
+        keys.push_back(i * i);
+    }
+
+    double bound = 0.0005;
+    LinearSplineModel<uint64_t> linear(keys, ErrorBound(bound));
+    QuadraticSplineModel<uint64_t> quadratic(keys, ErrorBound(bound));
+    CubicSplineModel<uint64_t> cubic(keys, ErrorBound(bound));
+    LogarithmicSplineModel<uint64_t> logarithmic(keys, ErrorBound(bound));
+    ExponentialSplineModel<uint64_t> exponential(keys, ErrorBound(bound));
+
+    assert(max_error(quadratic, keys) <= bound + 1e-9);
+    assert(max_error(cubic, keys) <= bound + 1e-9);
+    assert(max_error(logarithmic, keys) <= bound + 1e-9);
+    assert(max_error(exponential, keys) <= bound + 1e-9);
+
+    size_t segments = linear._key_array.size();
+    assert(quadratic._key_array.size() * 2 < segments);
+    assert(cubic._key_array.size() * 2 < segments);
+    assert(logarithmic._key_array.size() * 2 < segments);
+    assert(exponential._key_array.size() < segments);
+
+    // The same keys as nanosecond timestamps, above 2^53, fit the same way
+    // since segments are fit and evaluated on distances between keys.
+    std::vector<uint64_t> timestamps(keys);
+    for (auto& key : timestamps) {
+        key += 1700000000000000000ULL;
+    }
+    QuadraticSplineModel<uint64_t> shifted(timestamps, ErrorBound(bound));
+    MixedSplineModel<uint64_t> mixed(keys, ErrorBound(bound));
+    MixedSplineModel<uint64_t> shifted_mixed(timestamps, ErrorBound(bound));
+    assert(shifted._key_array.size() == quadratic._key_array.size());
+    assert(shifted_mixed._key_array.size() == mixed._key_array.size());
+    assert(max_error(shifted, timestamps) <= bound + 1e-9);
+    assert(max_error(shifted_mixed, timestamps) <= bound + 1e-9);
+}
+
+
+void TestKernelSplineModel::test_size_bytes() {
+    std::vector<int> keys = {1, 2, 3, 4, 5, 6, 7, 8};
+
+    // Four <key, eCDF> pairs (12 bytes each) and one coefficient each.
+    QuadraticSplineModel<int> quadratic(keys, 2);
+    assert(quadratic.size_bytes() == 4 * 12 + 4 * 8);
+
+    // Cubic segments have two coefficients each.
+    CubicSplineModel<int> cubic(keys, 2);
+    assert(cubic.size_bytes() == 4 * 12 + 4 * 16);
+}
+
+
+int TestKernelSplineModel::run_kernel_spline_model_tests() {
+    test_kernels();
+    test_fit();
+    test_predict();
+    test_error_bound();
+    test_size_bytes();
+
+    std::cout << "All KernelSplineModel unit tests passed successfully.\n";
+    return 0;
+}
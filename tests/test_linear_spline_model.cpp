@@ -11,15 +11,15 @@ void TestLinearSplineModel::test_calculate_slope_and_bias() {
 
     // Test 1: Positive slope.
     auto result = model._calculate_slope_bias({1, 2}, {3, 4});
-    // Expected slope = 1, bias = 1
+    // Expected slope = 1, bias = 2 (the CDF at the first key).
     assert_double_equals(result.first, 1.0);
-    assert_double_equals(result.second, 1.0);
+    assert_double_equals(result.second, 2.0);
 
     // Test 2: Negative slope.
     result = model._calculate_slope_bias({2, 3}, {4, 1});
-    // Expected slope = -1, bias = 5.
+    // Expected slope = -1, bias = 3.
     assert_double_equals(result.first, -1.0);
-    assert_double_equals(result.second, 5.0);
+    assert_double_equals(result.second, 3.0);
 }
 
 
@@ -33,13 +33,18 @@ void TestLinearSplineModel::test_constructor() {
     // Verify the size of _linear_models_array is correct.
     assert(model._linear_models_array.size() == expected_key_array_size);
 
-    // Check spline points correctly constructed
+    // Check spline points correctly constructed, with each bias the CDF at
+    // the start of the segment.
     assert_double_equals(model._linear_models_array[0].first, 0.2);     // slope
     assert_double_equals(model._linear_models_array[0].second, 0.0);    // bias
     assert_double_equals(model._linear_models_array[1].first, 0.2);     // slope
-    assert_double_equals(model._linear_models_array[1].second, 0.0);    // bias
+    assert_double_equals(model._linear_models_array[1].second, 0.2);    // bias
     assert_double_equals(model._linear_models_array[2].first, 0.08);    // slope
-    assert_double_equals(model._linear_models_array[2].second, 0.36);   // bias
+    assert_double_equals(model._linear_models_array[2].second, 0.6);    // bias
+
+    // The final model stays flat past the last key.
+    assert_double_equals(model._linear_models_array[3].first, 0.0);     // slope
+    assert_double_equals(model._linear_models_array[3].second, 1.0);    // bias
 }
 
 
@@ -77,6 +82,19 @@ void TestLinearSplineModel::test_size_bytes() {
 
     // Assert that the actual size matches the expected size.
     assert(actual_size == expected_size);
+
+    // The Eytzinger layout adds a key and a 4-byte rank per key array entry,
+    // plus one unused slot.
+    model.set_search_layout(SEARCH_LAYOUT_EYTZINGER);
+    expected_size += (sizeof(double) + 4) * (model._key_array.size() + 1);
+    assert(model.size_bytes() == expected_size);
+
+    // The radix layout replaces it with a 4-byte entry per slot, one more
+    // entry, and the two doubles mapping keys to slots.
+    model.set_search_layout(SEARCH_LAYOUT_RADIX, 8);
+    expected_size -= (sizeof(double) + 4) * (model._key_array.size() + 1);
+    expected_size += 4 * ((1 << 8) + 1) + sizeof(double) * 2;
+    assert(model.size_bytes() == expected_size);
 }
 
 
@@ -100,11 +118,222 @@ void TestLinearSplineModel::test_paper_model() {
 }
 
 
+void TestLinearSplineModel::test_error_bound() {
+    std::mt19937_64 rng(17);
+    std::vector<uint64_t> keys(50000);
+    for (auto& key : keys) {
+        // Clusters of different densities and widths.
+        uint64_t cluster = rng() % 16;
+        key = cluster * 1000000000 + rng() % ((cluster + 1) * 100000);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    double max_error = 0.001;
+    LinearSplineModel<uint64_t> model(keys, ErrorBound(max_error));
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (i + 1 < keys.size() && keys[i + 1] == keys[i]) {
+            continue;
+        }
+        double ecdf = (i + 1) * 1.0 / keys.size();
+        assert(std::abs(model.predict(keys[i]) - ecdf) <= max_error + 1e-9);
+    }
+
+    // Sampling every R-th key into as many segments misses the bound.
+    size_t R = keys.size() / model._key_array.size();
+    LinearSplineModel<uint64_t> sampled(keys, R);
+    double sampled_error = 0.0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        double ecdf = (i + 1) * 1.0 / keys.size();
+        sampled_error = std::max(
+            sampled_error, std::abs(sampled.predict(keys[i]) - ecdf)
+        );
+    }
+    assert(sampled_error > max_error);
+}
+
+
+void TestLinearSplineModel::test_large_keys() {
+    // Nanosecond timestamps 7ns apart, far above 2^53 where doubles only
+    // resolve 256ns.
+    uint64_t base = 1700000000000000000ULL;
+    std::vector<uint64_t> keys(10000);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = base + i * 7;
+    }
+    // Past the first segment, which starts at the origin, every key is
+    // predicted exactly.
+    LinearSplineModel<uint64_t> model(keys, 100);
+    for (size_t i = 100; i < keys.size(); ++i) {
+        double ecdf = (i + 1) * 1.0 / keys.size();
+        assert(std::abs(model.predict(keys[i]) - ecdf) < 1e-9);
+    }
+    assert(model.predict(base) < 0.01);
+    assert(model.predict(UINT64_MAX) == 1.0);
+
+    // Signed keys spanning most of the keyspace, whose distances overflow
+    // `int64_t`. Below a negative first key the prediction is 0.
+    std::vector<int64_t> signed_keys;
+    for (int64_t i = -4000; i < 4000; ++i) {
+        signed_keys.push_back(i * 1000000000000000LL + i % 3);
+    }
+    LinearSplineModel<int64_t> signed_model(signed_keys, 10);
+    assert(signed_model.predict(INT64_MIN) == 0.0);
+    assert(signed_model.predict(signed_keys[0]) == 0.0);
+    double previous = 0.0;
+    for (size_t i = 0; i < signed_keys.size(); ++i) {
+        double cdf = signed_model.predict(signed_keys[i]);
+        assert(cdf >= previous);
+        if (i >= 10) {
+            double ecdf = (i + 1) * 1.0 / signed_keys.size();
+            assert(std::abs(cdf - ecdf) < 1e-9);
+        }
+        previous = cdf;
+    }
+    assert(signed_model.predict(INT64_MAX) == 1.0);
+}
+
+
+void TestLinearSplineModel::test_predict_batch() {
+    std::mt19937_64 rng(67);
+    std::vector<uint64_t> keys(20000);
+    for (auto& key : keys) {
+        key = rng() % 1000000000;
+    }
+    std::sort(keys.begin(), keys.end());
+    LinearSplineModel<uint64_t> model(keys, 8);
+
+    std::vector<uint64_t> queries(5001);
+    for (auto& key : queries) {
+        key = rng() % 1100000000;
+    }
+    std::vector<double> cdfs(queries.size());
+    model.predict_batch(queries.data(), queries.size(), cdfs.data());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        assert(cdfs[i] == model.predict(queries[i]));
+    }
+
+    // Sorted keys, searched by walking the key array.
+    cdfs.resize(keys.size());
+    model.predict_batch(keys.data(), keys.size(), cdfs.data());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        assert(cdfs[i] == model.predict(keys[i]));
+    }
+}
+
+
+void TestLinearSplineModel::test_append() {
+    std::mt19937_64 rng(137);
+    std::vector<uint64_t> keys(12000);
+    for (auto& key : keys) {
+        key = rng() % 1000000000;
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<uint64_t> input_keys(keys.begin(), keys.begin() + 10000);
+    std::vector<uint64_t> appended(keys.begin() + 10000, keys.end());
+    for (auto& key : appended) {
+        key += 1000000000;
+    }
+
+    // Queries up to the last key, past which the final flat model is
+    // replaced.
+    std::vector<uint64_t> queries(2000);
+    for (auto& key : queries) {
+        key = rng() % (input_keys.back() + 1);
+    }
+
+    LinearSplineModel<uint64_t> model(input_keys, 10);
+    std::vector<double> cdfs(queries.size());
+    model.predict_batch(queries.data(), queries.size(), cdfs.data());
+
+    // Appended keys are ranked from 10001 on, out of the 10000 keys the
+    // existing CDFs are relative to. Every 10th of them is sampled.
+    size_t old_size = model._key_array.size();
+    model.append(appended, 10001, input_keys.size(), 10);
+    assert(model._key_array.size() == old_size + 200);
+    assert(model._linear_models_array.size() == model._key_array.size() + 1);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        assert(model.predict(queries[i]) == cdfs[i]);
+    }
+
+    // The sampled keys and the last one are predicted exactly, and the rest
+    // in order.
+    for (size_t i = 9; i < appended.size(); i += 10) {
+        double ecdf = (10001 + i) * 1.0 / input_keys.size();
+        assert(std::abs(model.predict(appended[i]) - ecdf) < 1e-12);
+    }
+    assert(model.predict(appended.back()) == 1.2);
+    assert(model.predict(UINT64_MAX) == 1.2);
+    double previous = model.predict(input_keys.back());
+    for (size_t i = 0; i < appended.size(); ++i) {
+        double cdf = model.predict(appended[i]);
+        assert(cdf > 1.0 && cdf >= previous);
+        previous = cdf;
+    }
+    std::vector<double> appended_cdfs(appended.size());
+    model.predict_batch(appended.data(), appended.size(), appended_cdfs.data());
+    for (size_t i = 0; i < appended.size(); ++i) {
+        assert(appended_cdfs[i] == model.predict(appended[i]));
+    }
+
+    // Fewer than R keys past the last sampled key end on an entry that the
+    // next append replaces, with those keys passed again, so the entries
+    // match a single append of all keys.
+    LinearSplineModel<uint64_t> split(input_keys, 10);
+    std::vector<uint64_t> head(appended.begin(), appended.begin() + 1995);
+    std::vector<uint64_t> tail(appended.begin() + 1990, appended.end());
+    split.append(head, 10001, input_keys.size(), 10);
+    assert(split._key_array.size() == old_size + 200);
+    split.append(tail, 10001 + 1990, input_keys.size(), 10, true);
+    assert(split._key_array.size() == model._key_array.size());
+    for (size_t i = 0; i < model._key_array.size(); ++i) {
+        assert(split._key_array[i] == model._key_array[i]);
+        assert(split._linear_models_array[i] == model._linear_models_array[i]);
+    }
+
+    // Keys must be strictly increasing and come after the model's keys, and
+    // the search layout must be the sorted one.
+    LinearSplineModel<uint64_t> rejecting(input_keys, 10);
+    std::vector<std::vector<uint64_t> > invalid = {
+        {input_keys.back()}, {appended[0], appended[0]}
+    };
+    const char* errors[] = {
+        "ERROR: Appended keys must be greater than the model's keys.",
+        "ERROR: Appended keys must be strictly increasing."
+    };
+    for (size_t i = 0; i < invalid.size(); ++i) {
+        try {
+            rejecting.append(invalid[i], 1, 1, 10);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(std::string(e.what()) == errors[i]);
+        }
+    }
+    SearchLayout layouts[] = {SEARCH_LAYOUT_EYTZINGER, SEARCH_LAYOUT_RADIX};
+    for (SearchLayout layout : layouts) {
+        rejecting.set_search_layout(layout, 6);
+        try {
+            rejecting.append(appended, 10001, input_keys.size(), 10);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(
+                std::string(e.what())
+                    == "ERROR: Appending requires the sorted search layout."
+            );
+        }
+    }
+    assert(rejecting._key_array.size() == old_size);
+}
+
+
 int TestLinearSplineModel::run_linear_spline_model_tests() {
     test_calculate_slope_and_bias();
     test_constructor();
     test_predict();
     test_paper_model();
+    test_error_bound();
+    test_large_keys();
+    test_predict_batch();
+    test_append();
 
     std::cout << "All LinearSplineModel unit tests passed successfully.\n";
     return 0;
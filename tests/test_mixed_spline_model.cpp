@@ -0,0 +1,163 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include "../include/base_test_utils.hpp"
+
+
+// mixed_keys(num_regions, keys_per_region)
+//   Returns sorted keys from regions that alternate between evenly spaced and
+//   lognormally skewed keys.
+static std::vector<uint64_t> mixed_keys(
+    size_t num_regions, size_t keys_per_region
+) {
+    std::mt19937_64 rng(23);
+    std::lognormal_distribution<double> distribution(0.0, 1.0);
+    std::vector<uint64_t> keys;
+    for (size_t region = 0; region < num_regions; ++region) {
+        uint64_t base = region << 32;
+        for (size_t i = 0; i < keys_per_region; ++i) {
+            keys.push_back(base + (
+                region % 2 ? i * 1000
+                    : uint64_t(distribution(rng) * 1e8) % (uint64_t(1) << 31)
+            ));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+
+void TestMixedSplineModel::test_constructor() {
+    std::vector<uint64_t> keys = mixed_keys(16, 2000);
+    MixedSplineModel<uint64_t> model(keys, ErrorBound(0.0001));
+
+    size_t size = model._key_array.size();
+    assert(size > SEGMENT_KINDS_PER_WORD);
+    assert(
+        model._kernel_kinds.size()
+            == (size + SEGMENT_KINDS_PER_WORD - 1) / SEGMENT_KINDS_PER_WORD
+    );
+
+    // Every segment's coefficients follow those of the segments before it.
+    size_t offset = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (i % SEGMENT_KINDS_PER_WORD == 0) {
+            assert(
+                model._kernel_offsets[i / SEGMENT_KINDS_PER_WORD] == offset
+            );
+        }
+        SegmentKernel kind = model._kernel_kind(i);
+        assert(
+            kind == SEGMENT_KERNEL_LINEAR || kind == SEGMENT_KERNEL_QUADRATIC
+                || kind == SEGMENT_KERNEL_CUBIC
+        );
+        offset += GenericBitOps::popcount(kind);
+    }
+    assert(model._kernel_offsets[model._kernel_kinds.size()] == offset);
+    assert(model._coefficients.size() == offset + 2);
+
+    try {
+        MixedSplineModel<uint64_t> invalid_model(keys, ErrorBound(-1.0));
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+}
+
+
+void TestMixedSplineModel::test_kernel_selection() {
+    // Evenly spaced keys need a single linear segment after the first.
+    std::vector<uint64_t> linear_keys;
+    for (uint64_t i = 1; i <= 10000; ++i) {
+        linear_keys.push_back(i * 100);
+    }
+    MixedSplineModel<uint64_t> linear(linear_keys, ErrorBound(0.0001));
+    assert(linear._key_array.size() == 2);
+    assert(linear._kernel_kind(1) == SEGMENT_KERNEL_LINEAR);
+    assert(linear._coefficients.size() == 2);
+
+    std::vector<uint64_t> keys = mixed_keys(32, 5000);
+    double bound = 0.0001;
+    MixedSplineModel<uint64_t> mixed(keys, ErrorBound(bound));
+    LinearSplineModel<uint64_t> linear_model(keys, ErrorBound(bound));
+    QuadraticSplineModel<uint64_t> quadratic(keys, ErrorBound(bound));
+    CubicSplineModel<uint64_t> cubic(keys, ErrorBound(bound));
+
+    size_t counts[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < mixed._key_array.size(); ++i) {
+        ++counts[mixed._kernel_kind(i)];
+    }
+    assert(counts[SEGMENT_KERNEL_LINEAR] > 0);
+    assert(counts[SEGMENT_KERNEL_CUBIC] > 0);
+
+    assert(mixed.size_bytes() < linear_model.size_bytes());
+    assert(mixed.size_bytes() < quadratic.size_bytes());
+    assert(mixed.size_bytes() < cubic.size_bytes());
+}
+
+
+void TestMixedSplineModel::test_predict() {
+    std::vector<uint64_t> keys = mixed_keys(8, 5000);
+    double bound = 0.0002;
+    MixedSplineModel<uint64_t> model(keys, ErrorBound(bound));
+
+    // Each segment evaluates its own kernel between its ends.
+    size_t offset = 0;
+    for (size_t i = 1; i < model._key_array.size(); ++i) {
+        SegmentKernel kind = model._kernel_kind(i);
+        std::pair<double, double> start = model._segment_start(i);
+        double end = double(model._key_array[i].first);
+        uint64_t middle = uint64_t((start.first + end) / 2);
+        double t = (double(middle) - start.first) / (end - start.first);
+
+        const double* coefficients = &model._coefficients[offset];
+        double expected = kind == SEGMENT_KERNEL_LINEAR ? t
+            : (kind == SEGMENT_KERNEL_QUADRATIC
+                ? QuadraticKernel::evaluate(coefficients, t)
+                : CubicKernel::evaluate(coefficients, t));
+        expected = start.second
+            + (model._key_array[i].second - start.second) * expected;
+        assert(std::abs(model.predict(middle) - expected) < 1e-9);
+        offset += GenericBitOps::popcount(kind);
+    }
+
+    std::vector<double> cdfs(keys.size());
+    model.predict_batch(keys.data(), keys.size(), cdfs.data());
+    double previous = 0.0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        double cdf = model.predict(keys[i]);
+        assert(cdf >= previous && cdfs[i] == cdf);
+        previous = cdf;
+        if (i + 1 == keys.size() || keys[i + 1] != keys[i]) {
+            double ecdf = (i + 1) * 1.0 / keys.size();
+            assert(std::abs(cdf - ecdf) <= bound + 1e-9);
+        }
+    }
+}
+
+
+void TestMixedSplineModel::test_size_bytes() {
+    std::vector<int> keys;
+    for (int i = 1; i <= 100; ++i) {
+        keys.push_back(i * 10);
+    }
+    MixedSplineModel<int> model(keys, ErrorBound(0.01));
+
+    // Two <key, eCDF> pairs (12 bytes each), one word of kinds, two offsets
+    // and the two padding coefficients of two linear segments.
+    assert(model._key_array.size() == 2);
+    assert(model.size_bytes() == 2 * 12 + 8 + 2 * 4 + 2 * 8);
+}
+
+
+int TestMixedSplineModel::run_mixed_spline_model_tests() {
+    test_constructor();
+    test_kernel_selection();
+    test_predict();
+    test_size_bytes();
+
+    std::cout << "All MixedSplineModel unit tests passed successfully.\n";
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include "../include/base_test_utils.hpp"
+
+
+// check_radix_sort<Key>(num_keys, mask, seed)
+//   Radix sorts random keys, keeping the bits of `mask`, and checks the
+//   result against std::sort.
+template <typename Key>
+static void check_radix_sort(size_t num_keys, uint64_t mask, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<Key> keys(num_keys);
+    for (auto& key : keys) {
+        key = Key(rng() & mask);
+    }
+    std::vector<Key> expected = keys;
+    std::sort(expected.begin(), expected.end());
+
+    RadixSort<Key>::sort(keys);
+    assert(keys == expected);
+}
+
+
+void TestRadixSort::test_sort() {
+    // Full-width keys take every pass; an odd number of passes for 8- and
+    // 24-bit keys leaves them in the scratch buffer.
+    check_radix_sort<uint64_t>(100000, ~0ULL, 1);
+    check_radix_sort<uint32_t>(100000, ~0ULL, 2);
+    check_radix_sort<uint16_t>(100000, ~0ULL, 3);
+    check_radix_sort<uint8_t>(100000, ~0ULL, 4);
+    check_radix_sort<uint64_t>(100000, 0xFFFFFF, 5);
+
+    // Signed keys, negative ones included.
+    check_radix_sort<int64_t>(100000, ~0ULL, 6);
+    check_radix_sort<int32_t>(100000, ~0ULL, 7);
+    check_radix_sort<int8_t>(100000, ~0ULL, 8);
+
+    // Keys that only differ in a few middle bits, with most passes skipped,
+    // and keys that are all equal.
+    check_radix_sort<uint64_t>(100000, 0x0000FF0000F00000ULL, 9);
+    check_radix_sort<uint64_t>(100000, 0, 10);
+
+    // Fewer keys than the radix sort is used for.
+    check_radix_sort<uint64_t>(0, ~0ULL, 11);
+    check_radix_sort<uint64_t>(1, ~0ULL, 12);
+    check_radix_sort<uint64_t>(RADIX_SORT_MIN_KEYS - 1, ~0ULL, 13);
+    check_radix_sort<uint64_t>(RADIX_SORT_MIN_KEYS, ~0ULL, 14);
+
+    // Keys that are sorted, or sorted in reverse, already.
+    std::vector<int64_t> keys(50000);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = int64_t(keys.size() / 2) - int64_t(i);
+    }
+    std::vector<int64_t> expected = keys;
+    std::sort(expected.begin(), expected.end());
+    RadixSort<int64_t>::sort(keys);
+    assert(keys == expected);
+    RadixSort<int64_t>::sort(keys);
+    assert(keys == expected);
+}
+
+
+void TestRadixSort::test_sort_parallel() {
+    std::mt19937_64 rng(17);
+    std::vector<uint64_t> keys(5 * PARALLEL_SORT_KEYS + 123);
+    for (auto& key : keys) {
+        // Clusters, with duplicates.
+        key = (rng() % 64) << 40 | (rng() % 100000);
+    }
+    std::vector<uint64_t> expected = keys;
+    std::sort(expected.begin(), expected.end());
+
+    size_t sizes[] = {1, 2, 5};
+    for (size_t num_threads : sizes) {
+        ThreadPool pool(num_threads);
+        std::vector<uint64_t> sorted = keys;
+        RadixSort<uint64_t>::sort(sorted, &pool);
+        assert(sorted == expected);
+    }
+}
+
+
+void TestRadixSort::test_sort_keys() {
+    std::mt19937_64 rng(19);
+    std::vector<int64_t> keys(20000);
+    for (auto& key : keys) {
+        key = int64_t(rng() % 5000) - 2500;
+    }
+    std::vector<int64_t> expected = keys;
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<int64_t> sorted = keys;
+    sort_keys(sorted);
+    assert(sorted == expected);
+
+    ThreadPool pool(3);
+    expected.erase(
+        std::unique(expected.begin(), expected.end()), expected.end()
+    );
+    sorted = keys;
+    sort_keys(sorted, true, &pool);
+    assert(sorted == expected);
+
+    // Floating-point keys are sorted with std::sort.
+    std::vector<double> doubles = {0.5, -1.0, 0.25, 0.5, 3.0, -1.0};
+    sort_keys(doubles, true);
+    assert((doubles == std::vector<double>{-1.0, 0.25, 0.5, 3.0}));
+}
+
+
+int TestRadixSort::run_radix_sort_tests() {
+    test_sort();
+    test_sort_parallel();
+    test_sort_keys();
+
+    std::cout << "All radix sort unit tests passed successfully.\n";
+    return 0;
+}
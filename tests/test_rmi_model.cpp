@@ -0,0 +1,111 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include "../include/base_test_utils.hpp"
+
+
+void TestRMIModel::test_constructor() {
+    std::vector<int> keys = {1, 2, 3, 4, 8, 9, 10, 20};
+
+    RMIModel<int> model(keys, 2, 3);
+    assert(model._root.size() == 1);
+    assert(model._leaves.size() == 3);
+    assert(model._key_array.empty());
+
+    // By default there is one leaf per sampled key.
+    RMIModel<int> default_model(keys, 2);
+    assert(default_model._leaves.size() == 4);
+
+    // Leaf ranges cover [0, 1] in order without overlapping.
+    double lower = 0.0;
+    for (const auto& leaf : model._leaves) {
+        assert_double_equals(leaf.lower, lower);
+        assert(leaf.upper >= leaf.lower);
+        lower = leaf.upper;
+    }
+    assert_double_equals(lower, 1.0);
+
+    // Equal keys give a flat root, and leaves without NaNs.
+    std::vector<int> equal_keys = {5, 5, 5};
+    RMIModel<int> flat_model(equal_keys, 1);
+    assert(flat_model._root[0].first == 0.0);
+    for (const auto& leaf : flat_model._leaves) {
+        assert(std::isfinite(leaf.slope) && std::isfinite(leaf.bias));
+        assert(std::isfinite(leaf.lower) && std::isfinite(leaf.upper));
+    }
+    assert_double_equals(flat_model.predict(5), 1.0);
+    assert(flat_model.predict(4) <= flat_model.predict(6));
+}
+
+
+void TestRMIModel::test_predict() {
+    // Uniform keys are fit exactly from the first sampled key on, whatever
+    // the number of leaves.
+    std::vector<int> keys;
+    for (int i = 1; i <= 100; ++i) {
+        keys.push_back(i * 10);
+    }
+
+    size_t leaves[] = {1, 4, 25};
+    for (size_t num_leaves : leaves) {
+        RMIModel<int> model(keys, 4, num_leaves);
+        for (int i = 4; i <= 100; ++i) {
+            assert_double_equals(model.predict(i * 10), i / 100.0);
+        }
+
+        // Keys outside the range are clamped.
+        assert_double_equals(model.predict(-50), 0.0);
+        assert_double_equals(model.predict(5000), 1.0);
+    }
+}
+
+
+void TestRMIModel::test_monotone() {
+    std::mt19937_64 rng(31);
+    std::vector<uint64_t> keys(20000);
+    for (auto& key : keys) {
+        // A few dense clusters far apart.
+        key = (rng() % 8) * 1000000000000ULL + rng() % 1000000;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    RMIModel<uint64_t> model(keys, 8, 1000);
+    std::vector<uint64_t> queries(keys);
+    for (size_t i = 0; i < 20000; ++i) {
+        queries.push_back(rng() % 8000000000000ULL);
+    }
+    std::sort(queries.begin(), queries.end());
+
+    std::vector<double> cdfs(queries.size());
+    model.predict_batch(queries.data(), queries.size(), cdfs.data());
+    double previous = 0.0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        double cdf = model.predict(queries[i]);
+        assert(cdf >= previous && cdf <= 1.0);
+        assert(cdfs[i] == cdf);
+        previous = cdf;
+    }
+}
+
+
+void TestRMIModel::test_size_bytes() {
+    std::vector<double> keys = {0.1, 0.2, 0.3, 0.4};
+    RMIModel<double> model(keys, 2, 5);
+
+    // A root <slope, bias> pair and four doubles per leaf.
+    size_t expected_size = sizeof(double) * 2 + sizeof(double) * 4 * 5;
+    assert(model.size_bytes() == expected_size);
+}
+
+
+int TestRMIModel::run_rmi_model_tests() {
+    test_constructor();
+    test_predict();
+    test_monotone();
+    test_size_bytes();
+
+    std::cout << "All RMIModel unit tests passed successfully.\n";
+    return 0;
+}
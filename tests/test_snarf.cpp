@@ -59,17 +59,1148 @@ void TestSNARF::test_size_bytes() {
     std::vector<int> input_keys = {1, 2, 3, 4, 5};
     SNARF<int> snarf(input_keys, 10, 2, 2);
 
-    size_t expected_size = 160;  // to check this value by hand calculation
+    // Model (100) + member variables (52) + directory of one superblock offset
+    // (8) and four block offsets (16) + arena of 46 bits rounded up (6).
+    size_t expected_size = 182;
     assert(snarf.size_bytes() == expected_size);
 }
 
 
+void TestSNARF::test_predict_location() {
+    assert(!std::is_polymorphic<LinearSplineModel<int> >::value);
+    assert(!std::is_polymorphic<RMIModel<int> >::value);
+
+    std::vector<int> input_keys = {10, 20, 30, 40, 50};
+    SNARF<int> snarf(input_keys, 10, 2, 1);
+    size_t num_locations = snarf._num_keys * snarf._scaling_factor;
+    for (int key = 0; key <= 60; ++key) {
+        size_t expected = std::min(
+            size_t(floor(snarf._model.predict(key) * num_locations)),
+            num_locations - 1
+        );
+        assert(snarf._predict_location(key) == expected);
+    }
+    assert(snarf._predict_location(50) == num_locations - 1);
+}
+
+
+void TestSNARF::test_range_query_no_false_negatives() {
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> input_keys(5000);
+    for (auto& key : input_keys) {
+        key = rng() % 10000000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    SNARF<uint64_t> snarf(input_keys, 10, 256, 16);
+
+    size_t false_positives = 0;
+    size_t negatives = 0;
+    for (size_t i = 0; i < 20000; ++i) {
+        uint64_t lower = rng() % 10000000;
+        uint64_t upper = lower + rng() % 5000;
+
+        auto it = std::lower_bound(input_keys.begin(), input_keys.end(), lower);
+        bool expected = it != input_keys.end() && *it <= upper;
+        bool actual = snarf.range_query(lower, upper);
+
+        assert(!expected || actual);    // no false negatives
+        if (!expected) {
+            ++negatives;
+            false_positives += actual;
+        }
+    }
+
+    // The filter should still reject most empty ranges.
+    assert(false_positives < negatives / 2);
+}
+
+
+void TestSNARF::test_block_directory() {
+    std::vector<int> input_keys;
+    for (int i = 0; i < 10000; ++i) {
+        input_keys.push_back(i * 7);
+    }
+
+    // Small blocks so the directory spans many superblocks.
+    SNARF<int> snarf(input_keys, 10, 8, 4);
+    assert(snarf._total_blocks > 4 * SUPERBLOCK_SIZE);
+
+    // Every key is accounted for by exactly one block.
+    size_t total_keys = 0;
+    for (size_t i = 0; i < snarf._total_blocks; ++i) {
+        total_keys += snarf._block_num_keys(
+            snarf._block_offset(i), snarf._block_offset(i + 1)
+        );
+    }
+    assert(total_keys == input_keys.size());
+    assert(snarf._block_offset(snarf._total_blocks) == snarf._blocks.size());
+
+    for (int key : input_keys) {
+        assert(snarf.range_query(key, key));
+    }
+}
+
+
+void TestSNARF::test_line_layouts() {
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> input_keys(20000);
+    for (size_t i = 0; i < input_keys.size(); ++i) {
+        // Clustered keys with a coarse model, so some lines overflow.
+        input_keys[i] = (rng() % 64) * 1000000 + rng() % 1000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    BlockLayout layouts[] = {BLOCK_LAYOUT_LINE_64, BLOCK_LAYOUT_LINE_128};
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t> snarf(input_keys, 12, 0, 2000, layout);
+
+        // Keys per line follow from the line size and bits per key.
+        assert(snarf._block_size == snarf._keys_per_line());
+        assert(snarf._lines.size() == snarf._total_blocks * layout * 8);
+        assert(snarf._blocks.size() > 0);   // some blocks overflowed
+
+        for (uint64_t key : input_keys) {
+            assert(snarf.range_query(key, key));
+        }
+
+        size_t false_positives = 0;
+        for (size_t i = 0; i < 10000; ++i) {
+            uint64_t lower = (rng() % 64) * 1000000 + 2000 + rng() % 10000;
+            false_positives += snarf.range_query(lower, lower + 10);
+        }
+        assert(false_positives < 1000);
+    }
+}
+
+
+// overwrite_section(path, section, byte, num_bytes)
+//   Sets `num_bytes` bytes of a SNARF file's section to 0xFF, from byte
+//   `byte` of the section on.
+static void overwrite_section(
+    const std::string& path, size_t section, size_t byte, size_t num_bytes
+) {
+    size_t offset;
+    {
+        SNARFFileReader reader(path, false);
+        offset = reader._sections[section].offset;
+    }
+    std::fstream file(path.c_str(), std::ios::in | std::ios::out
+        | std::ios::binary);
+    file.seekp(offset + byte);
+    for (size_t i = 0; i < num_bytes; ++i) {
+        file.put(char(0xFF));
+    }
+}
+
+
+void TestSNARF::test_save_and_map() {
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> input_keys(20000);
+    for (auto& key : input_keys) {
+        key = rng() % 100000000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    std::string path = "/tmp/snarfpp_test_save_and_map.snarf";
+    BlockLayout layouts[] = {BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64};
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t> snarf(input_keys, 10, 64, 32, layout);
+        snarf.set_search_layout(
+            layout == BLOCK_LAYOUT_ARENA ? SEARCH_LAYOUT_EYTZINGER
+                : SEARCH_LAYOUT_RADIX
+        );
+        snarf.save(path);
+
+        SNARF<uint64_t> mapped = SNARF<uint64_t>::map(path, true);
+        assert(mapped._file);
+        assert(mapped._blocks._words._is_view);
+        assert(mapped._model._key_array._is_view);
+        assert(
+            mapped._model._eytzinger_keys.size()
+                == snarf._model._eytzinger_keys.size()
+        );
+        assert(
+            mapped._model._radix_table.size()
+                == snarf._model._radix_table.size()
+        );
+        assert(mapped.size_bytes() == snarf.size_bytes());
+
+        // Writing to the read-only mapping fails cleanly.
+        try {
+            mapped._blocks.write_bits(0, 1, 1);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(
+                std::string(e.what())
+                    == "ERROR: Cannot modify a read-only view."
+            );
+        }
+
+        // The mapped filter answers exactly like the one it was saved from.
+        for (size_t i = 0; i < 20000; ++i) {
+            uint64_t lower = rng() % 100000000;
+            uint64_t upper = lower + rng() % 10000;
+            assert(
+                mapped.range_query(lower, upper)
+                    == snarf.range_query(lower, upper)
+            );
+        }
+    }
+
+    // A file written for another key type is rejected.
+    try {
+        SNARF<int>::map(path);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+
+    // Corrupting a payload byte is caught when verifying checksums.
+    size_t offset;
+    {
+        SNARFFileReader reader(path, false);
+        offset = reader._sections[7].offset;   // the line storage
+    }
+    {
+        std::fstream file(path.c_str(), std::ios::in | std::ios::out
+            | std::ios::binary);
+        file.seekp(offset + 8);
+        file.put(0x5A);
+    }
+    SNARF<uint64_t>::map(path, false);  // not verified, still opens
+    try {
+        SNARF<uint64_t>::map(path, true);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+
+    // A corrupt block directory or line header is rejected even without
+    // verifying checksums, as queries would read past the mapping.
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t>(input_keys, 10, 64, 32, layout).save(path);
+        if (layout == BLOCK_LAYOUT_ARENA) {
+            overwrite_section(path, 9, 5 * sizeof(uint32_t), 4);
+        } else {
+            overwrite_section(path, 7, 3 * 64, 8);    // a line header
+        }
+        try {
+            SNARF<uint64_t>::map(path, false);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(
+                std::string(e.what()) == "ERROR: SNARF file blocks are invalid."
+            );
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+
+void TestSNARF::test_elias_fano_codec() {
+    typedef SNARF<uint64_t, LinearSplineModel<uint64_t>, EliasFanoCodec>
+        EliasFanoSNARF;
+
+    std::mt19937_64 rng(13);
+    std::vector<uint64_t> input_keys(20000);
+    for (auto& key : input_keys) {
+        // Clustered keys, so block densities vary widely.
+        key = (rng() % 64) * 1000000 + rng() % 5000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    std::string path = "/tmp/snarfpp_test_elias_fano_codec.snarf";
+    BlockLayout layouts[] = {
+        BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64, BLOCK_LAYOUT_LINE_128
+    };
+    for (BlockLayout layout : layouts) {
+        EliasFanoSNARF snarf(input_keys, 10, 100, 500, layout);
+        for (uint64_t key : input_keys) {
+            assert(snarf.range_query(key, key));
+        }
+
+        snarf.save(path);
+        EliasFanoSNARF mapped = EliasFanoSNARF::map(path, true);
+        for (size_t i = 0; i < 5000; ++i) {
+            uint64_t lower = rng() % 64000000;
+            uint64_t upper = lower + rng() % 10000;
+            assert(
+                mapped.range_query(lower, upper)
+                    == snarf.range_query(lower, upper)
+            );
+        }
+    }
+
+    // A file written with one codec does not map with the other.
+    try {
+        SNARF<uint64_t>::map(path);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+
+    std::remove(path.c_str());
+}
+
+
+void TestSNARF::test_error_bound() {
+    std::mt19937_64 rng(31);
+    std::vector<uint64_t> input_keys(50000);
+    for (auto& key : input_keys) {
+        key = (rng() % 32) * 1000000000 + rng() % 100000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    SNARF<uint64_t> sampled(input_keys, 10, 100, 16);
+    SNARF<uint64_t> bounded(input_keys, 10, 100, ErrorBound(0.0003));
+    for (uint64_t key : input_keys) {
+        assert(bounded.range_query(key, key));
+    }
+
+    // Clustered keys need far fewer segments for the same false positive
+    // rate.
+    assert(
+        bounded._model._key_array.size() * 10
+            < sampled._model._key_array.size()
+    );
+
+    size_t sampled_positives = 0;
+    size_t bounded_positives = 0;
+    size_t negatives = 0;
+    for (size_t i = 0; i < 20000; ++i) {
+        uint64_t lower = (rng() % 32) * 1000000000 + rng() % 100000;
+        uint64_t upper = lower + rng() % 10;
+
+        auto it = std::lower_bound(
+            input_keys.begin(), input_keys.end(), lower
+        );
+        if (it != input_keys.end() && *it <= upper) {
+            continue;
+        }
+        ++negatives;
+        sampled_positives += sampled.range_query(lower, upper);
+        bounded_positives += bounded.range_query(lower, upper);
+    }
+    assert(bounded_positives * 2 < sampled_positives * 3);
+}
+
+
+// check_kernel_snarf<Model>(input_keys, path)
+//   Checks a filter built on a kernel, mixed or compact spline model against
+//   the input keys and across a save and map.
+template <typename Model>
+static void check_kernel_snarf(
+    const std::vector<uint64_t>& input_keys, const std::string& path
+) {
+    typedef SNARF<uint64_t, Model> KernelSNARF;
+
+    KernelSNARF snarf(input_keys, 10, 100, ErrorBound(0.001));
+    for (uint64_t key : input_keys) {
+        assert(snarf.range_query(key, key));
+    }
+
+    snarf.save(path);
+    KernelSNARF mapped = KernelSNARF::map(path, true);
+    assert(mapped.size_bytes() == snarf.size_bytes());
+    std::mt19937_64 rng(37);
+    for (size_t i = 0; i < 5000; ++i) {
+        uint64_t lower = rng() % (input_keys.back() + 1);
+        uint64_t upper = lower + rng() % 1000;
+        assert(
+            mapped.range_query(lower, upper) == snarf.range_query(lower, upper)
+        );
+    }
+
+    // A file written with one model does not map with another.
+    try {
+        SNARF<uint64_t>::map(path);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+}
+
+
+void TestSNARF::test_kernel_models() {
+    std::mt19937_64 rng(41);
+    std::lognormal_distribution<double> distribution(0.0, 1.0);
+    std::vector<uint64_t> input_keys(20000);
+    for (auto& key : input_keys) {
+        key = uint64_t(distribution(rng) * 1000000);
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    std::string path = "/tmp/snarfpp_test_kernel_models.snarf";
+    check_kernel_snarf<QuadraticSplineModel<uint64_t> >(input_keys, path);
+    check_kernel_snarf<CubicSplineModel<uint64_t> >(input_keys, path);
+    check_kernel_snarf<LogarithmicSplineModel<uint64_t> >(input_keys, path);
+    check_kernel_snarf<ExponentialSplineModel<uint64_t> >(input_keys, path);
+    check_kernel_snarf<MixedSplineModel<uint64_t> >(input_keys, path);
+    check_kernel_snarf<CompactSplineModel<uint64_t> >(input_keys, path);
+    std::remove(path.c_str());
+}
+
+
+void TestSNARF::test_rmi_model() {
+    typedef SNARF<uint64_t, RMIModel<uint64_t> > RMISNARF;
+
+    std::mt19937_64 rng(29);
+    std::vector<uint64_t> input_keys(50000);
+    for (auto& key : input_keys) {
+        key = (rng() % 32) * 1000000000 + rng() % 100000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    RMISNARF snarf(input_keys, 10, 100, 16);
+    for (uint64_t key : input_keys) {
+        assert(snarf.range_query(key, key));
+    }
+
+    std::string path = "/tmp/snarfpp_test_rmi_model.snarf";
+    snarf.save(path);
+    RMISNARF mapped = RMISNARF::map(path, true);
+    assert(mapped.size_bytes() == snarf.size_bytes());
+    for (size_t i = 0; i < 5000; ++i) {
+        uint64_t lower = rng() % 32000000000;
+        uint64_t upper = lower + rng() % 100000;
+        assert(
+            mapped.range_query(lower, upper) == snarf.range_query(lower, upper)
+        );
+    }
+
+    // A file written with one model does not map with another.
+    try {
+        SNARF<uint64_t>::map(path);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+
+    std::remove(path.c_str());
+}
+
+
+// clustered_range_queries(seed, num_clusters, gap, width, num_ranges,
+//                         input_keys, lowers, uppers)
+//   Fills `input_keys` with 20000 sorted keys in `num_clusters` clusters of
+//   `width`, `gap` apart, so that wide ranges cross empty blocks. The queries
+//   are every key, then `num_ranges` random narrow, wide and reversed ranges.
+static void clustered_range_queries(
+    uint64_t seed, uint64_t num_clusters, uint64_t gap, uint64_t width,
+    size_t num_ranges, std::vector<uint64_t>& input_keys,
+    std::vector<uint64_t>& lowers, std::vector<uint64_t>& uppers
+) {
+    std::mt19937_64 rng(seed);
+    input_keys.resize(20000);
+    for (auto& key : input_keys) {
+        key = (rng() % num_clusters) * gap + rng() % width;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    lowers = input_keys;
+    uppers = input_keys;
+    for (size_t i = 0; i < num_ranges; ++i) {
+        uint64_t lower = rng() % ((num_clusters + 1) * gap);
+        uint64_t range = i % 3 == 0 ? rng() % (4 * gap) : rng() % 1000;
+        lowers.push_back(lower);
+        uppers.push_back(i % 50 == 0 ? lower / 2 : lower + range);
+    }
+}
+
+
+// check_range_query_method<Filter>(snarf, query, lowers, uppers)
+//   Checks that a method answering many range queries at once, such as
+//   range_query_batch() or range_query_interleaved(), agrees with
+//   range_query() on each.
+template <typename Filter>
+static void check_range_query_method(
+    const Filter& snarf,
+    void (Filter::*query)(
+        const uint64_t*, const uint64_t*, size_t, BitArray&
+    ) const,
+    const std::vector<uint64_t>& lowers, const std::vector<uint64_t>& uppers
+) {
+    BitArray results;
+    (snarf.*query)(lowers.data(), uppers.data(), lowers.size(), results);
+    assert(results.size() == lowers.size());
+    for (size_t i = 0; i < lowers.size(); ++i) {
+        assert(results.read_bit(i) == snarf.range_query(lowers[i], uppers[i]));
+    }
+}
+
+
+void TestSNARF::test_range_query_batch() {
+    typedef SNARF<uint64_t, LinearSplineModel<uint64_t>, EliasFanoCodec>
+        EliasFanoSNARF;
+
+    std::vector<uint64_t> input_keys, lowers, uppers;
+    clustered_range_queries(
+        71, 16, 100000000, 1000000, 20000, input_keys, lowers, uppers
+    );
+
+    BlockLayout layouts[] = {
+        BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64, BLOCK_LAYOUT_LINE_128
+    };
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t> golomb(input_keys, 10, 100, 50, layout);
+        check_range_query_method(
+            golomb, &SNARF<uint64_t>::range_query_batch, lowers, uppers
+        );
+
+        EliasFanoSNARF elias_fano(input_keys, 10, 100, 50, layout);
+        check_range_query_method(
+            elias_fano, &EliasFanoSNARF::range_query_batch, lowers, uppers
+        );
+    }
+
+    // An empty batch.
+    SNARF<uint64_t> snarf(input_keys, 10, 100, 50);
+    BitArray results(8);
+    snarf.range_query_batch(lowers.data(), uppers.data(), 0, results);
+    assert(results.size() == 0);
+}
+
+
+void TestSNARF::test_range_query_interleaved() {
+    typedef SNARF<uint64_t, LinearSplineModel<uint64_t>, EliasFanoCodec>
+        EliasFanoSNARF;
+
+    // Narrow clusters, so that a coarse model overflows some lines, and a
+    // number of ranges that is not a multiple of the prediction batch.
+    std::vector<uint64_t> input_keys, lowers, uppers;
+    clustered_range_queries(
+        73, 64, 10000000, 1000, 10001, input_keys, lowers, uppers
+    );
+
+    BlockLayout layouts[] = {
+        BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64, BLOCK_LAYOUT_LINE_128
+    };
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t> golomb(input_keys, 12, 100, 2000, layout);
+        check_range_query_method(
+            golomb, &SNARF<uint64_t>::range_query_interleaved, lowers, uppers
+        );
+
+        EliasFanoSNARF elias_fano(input_keys, 12, 100, 50, layout);
+        check_range_query_method(
+            elias_fano, &EliasFanoSNARF::range_query_interleaved, lowers,
+            uppers
+        );
+    }
+
+    // Fewer queries than are kept in flight, and none.
+    SNARF<uint64_t> snarf(input_keys, 10, 100, 50);
+    std::vector<uint64_t> few(input_keys.begin(), input_keys.begin() + 3);
+    check_range_query_method(
+        snarf, &SNARF<uint64_t>::range_query_interleaved, few, few
+    );
+    BitArray results(8);
+    snarf.range_query_interleaved(lowers.data(), uppers.data(), 0, results);
+    assert(results.size() == 0);
+}
+
+
+void TestSNARF::test_range_query_parallel() {
+    std::mt19937_64 rng(79);
+    std::vector<uint64_t> input_keys(20000);
+    for (auto& key : input_keys) {
+        key = rng() % 1000000000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    // Enough queries for several chunks per thread, with a partial last one.
+    std::vector<uint64_t> lowers(50001);
+    std::vector<uint64_t> uppers(lowers.size());
+    for (size_t i = 0; i < lowers.size(); ++i) {
+        lowers[i] = i % 2 == 0 ? input_keys[i % input_keys.size()]
+            : rng() % 1100000000;
+        uppers[i] = lowers[i] + (i % 5 == 0 ? rng() % 10000000 : 0);
+    }
+
+    BlockLayout layouts[] = {BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64};
+    for (BlockLayout layout : layouts) {
+        const SNARF<uint64_t> snarf(input_keys, 10, 100, 50, layout);
+        std::vector<char> expected(lowers.size());
+        for (size_t i = 0; i < lowers.size(); ++i) {
+            expected[i] = snarf.range_query(lowers[i], uppers[i]);
+        }
+
+        size_t sizes[] = {1, 4};
+        for (size_t num_threads : sizes) {
+            ThreadPool pool(num_threads);
+            BitArray results;
+            snarf.range_query_parallel(
+                lowers.data(), uppers.data(), lowers.size(), results, pool
+            );
+            assert(results.size() == lowers.size());
+            for (size_t i = 0; i < lowers.size(); ++i) {
+                assert(results.read_bit(i) == bool(expected[i]));
+            }
+        }
+
+        // Reader threads sharing the filter, each with its own queries.
+        std::vector<std::thread> readers;
+        std::atomic<size_t> mismatches(0);
+        for (size_t t = 0; t < 4; ++t) {
+            readers.emplace_back([&, t] {
+                for (size_t i = t; i < lowers.size(); i += 4) {
+                    bool result = snarf.range_query(lowers[i], uppers[i]);
+                    if (result != bool(expected[i])) {
+                        ++mismatches;
+                    }
+                }
+            });
+        }
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        assert(mismatches == 0);
+    }
+
+    // An empty batch.
+    SNARF<uint64_t> snarf(input_keys, 10, 100, 50);
+    ThreadPool pool(2);
+    BitArray results(8);
+    snarf.range_query_parallel(lowers.data(), uppers.data(), 0, results, pool);
+    assert(results.size() == 0);
+}
+
+
+// check_same_bit_array(a, b)
+//   Checks that two bit arrays hold the same bits.
+static void check_same_bit_array(const BitArray& a, const BitArray& b) {
+    assert(a.size() == b.size());
+    for (size_t i = 0; i < a._words.size(); ++i) {
+        assert(a._words[i] == b._words[i]);
+    }
+}
+
+
+// check_parallel_build<Filter>(input_keys, fit, layout)
+//   Builds a filter, fit to every R-th key or to an error bound, on one
+//   thread and on thread pools of several sizes, and checks that the
+//   block starts, blocks and directory are identical.
+template <typename Filter, typename Fit>
+static void check_parallel_build(
+    const std::vector<uint64_t>& input_keys, Fit fit, BlockLayout layout
+) {
+    Filter serial(input_keys, 10, 20, fit, layout);
+    std::vector<size_t> block_starts;
+    serial._find_block_starts(input_keys, block_starts);
+
+    size_t sizes[] = {1, 3};
+    for (size_t num_threads : sizes) {
+        ThreadPool pool(num_threads);
+        Filter parallel(input_keys, 10, 20, fit, layout, &pool);
+        std::vector<size_t> parallel_block_starts;
+        parallel._find_block_starts(input_keys, parallel_block_starts, &pool);
+        assert(parallel_block_starts == block_starts);
+
+        check_same_bit_array(parallel._blocks, serial._blocks);
+        check_same_bit_array(parallel._lines, serial._lines);
+        assert(
+            parallel._superblock_offsets.size()
+                == serial._superblock_offsets.size()
+        );
+        for (size_t i = 0; i < serial._superblock_offsets.size(); ++i) {
+            assert(
+                parallel._superblock_offsets[i]
+                    == serial._superblock_offsets[i]
+            );
+        }
+        assert(parallel._block_offsets.size() == serial._block_offsets.size());
+        for (size_t i = 0; i < serial._block_offsets.size(); ++i) {
+            assert(parallel._block_offsets[i] == serial._block_offsets[i]);
+        }
+    }
+}
+
+
+void TestSNARF::test_parallel_build() {
+    std::mt19937_64 rng(89);
+    std::vector<uint64_t> input_keys(300000);
+    for (auto& key : input_keys) {
+        // Clusters, so some lines overflow.
+        key = (rng() % 256) * 10000000 + rng() % 100000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    // Many chunks of keys and of blocks.
+    BlockLayout layouts[] = {
+        BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64, BLOCK_LAYOUT_LINE_128
+    };
+    for (BlockLayout layout : layouts) {
+        check_parallel_build<SNARF<uint64_t> >(input_keys, size_t(64), layout);
+        check_parallel_build<
+            SNARF<uint64_t, LinearSplineModel<uint64_t>, EliasFanoCodec>
+        >(input_keys, ErrorBound(0.0005), layout);
+    }
+}
+
+
+// check_fused_build<Filter>(snarf, input_keys)
+//   Checks that every block of `snarf` starts at the first key predicted in
+//   it and decodes to the predicted locations of its keys.
+template <typename Filter>
+static void check_fused_build(
+    const Filter& snarf, const std::vector<uint64_t>& input_keys
+) {
+    size_t block_range = snarf._block_size * snarf._scaling_factor;
+    std::vector<size_t> expected(input_keys.size());
+    for (size_t i = 0; i < input_keys.size(); ++i) {
+        expected[i] = snarf._predict_location(input_keys[i]);
+    }
+
+    std::vector<size_t> block_starts;
+    snarf._find_block_starts(input_keys, block_starts);
+    assert(block_starts.size() == snarf._total_blocks + 1);
+    size_t index = 0;
+    std::vector<size_t> locations;
+    for (size_t block = 0; block < snarf._total_blocks; ++block) {
+        while (
+            index < expected.size() && expected[index] < block * block_range
+        ) {
+            ++index;
+        }
+        assert(block_starts[block] == index);
+
+        size_t offset, num_keys;
+        const BitArray& bits = snarf._locate_block(block, offset, num_keys);
+        assert(num_keys == block_starts[block + 1] - block_starts[block]);
+        locations.resize(num_keys);
+        snarf._codec.decode(bits, offset, num_keys, locations.data());
+        for (size_t i = 0; i < num_keys; ++i) {
+            assert(
+                locations[i] + block * block_range == expected[index + i]
+            );
+        }
+    }
+    assert(block_starts.back() == input_keys.size());
+}
+
+
+void TestSNARF::test_fused_build() {
+    std::mt19937_64 rng(97);
+    std::lognormal_distribution<double> distribution(0.0, 1.5);
+    std::vector<uint64_t> input_keys(50000);
+    for (auto& key : input_keys) {
+        // Skewed, with duplicates and empty blocks.
+        key = uint64_t(distribution(rng) * 1e6) / 7 * 7;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    BlockLayout layouts[] = {BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64};
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t> linear(input_keys, 10, 50, 100, layout);
+        check_fused_build(linear, input_keys);
+
+        SNARF<uint64_t, RMIModel<uint64_t>, EliasFanoCodec> rmi(
+            input_keys, 10, 50, 100, layout
+        );
+        check_fused_build(rmi, input_keys);
+
+        SNARF<uint64_t, CubicSplineModel<uint64_t> > cubic(
+            input_keys, 10, 50, ErrorBound(0.001), layout
+        );
+        check_fused_build(cubic, input_keys);
+
+        SNARF<uint64_t, CompactSplineModel<uint64_t> > compact(
+            input_keys, 10, 50, 20, layout
+        );
+        check_fused_build(compact, input_keys);
+    }
+}
+
+
+void TestSNARF::test_unsorted_input() {
+    std::mt19937_64 rng(101);
+    std::vector<int64_t> input_keys(100000);
+    for (auto& key : input_keys) {
+        // Signed, with duplicates.
+        key = int64_t(rng() % 50000000) - 25000000;
+    }
+    std::vector<int64_t> sorted_keys = input_keys;
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    std::vector<int64_t> unique_keys = sorted_keys;
+    unique_keys.erase(
+        std::unique(unique_keys.begin(), unique_keys.end()), unique_keys.end()
+    );
+    assert(unique_keys.size() < sorted_keys.size());
+
+    // The keys are sorted in place, and the filters are those built from the
+    // sorted keys.
+    SNARF<int64_t> expected(sorted_keys, 10, 100, 64);
+    std::vector<int64_t> keys = input_keys;
+    SNARF<int64_t> snarf(keys, KEYS_UNSORTED, 10, 100, size_t(64));
+    assert(keys == sorted_keys);
+    assert(snarf._num_keys == sorted_keys.size());
+    check_same_bit_array(snarf._blocks, expected._blocks);
+
+    SNARF<int64_t, LinearSplineModel<int64_t>, EliasFanoCodec> unique_expected(
+        unique_keys, 10, 100, ErrorBound(0.001), BLOCK_LAYOUT_LINE_64
+    );
+    ThreadPool pool(3);
+    keys = input_keys;
+    SNARF<int64_t, LinearSplineModel<int64_t>, EliasFanoCodec> unique(
+        keys, KEYS_UNSORTED_UNIQUE, 10, 100, ErrorBound(0.001),
+        BLOCK_LAYOUT_LINE_64, &pool
+    );
+    assert(keys == unique_keys);
+    assert(unique._num_keys == unique_keys.size());
+    check_same_bit_array(unique._lines, unique_expected._lines);
+    check_same_bit_array(unique._blocks, unique_expected._blocks);
+
+    // Sorted keys are left as they are.
+    keys = sorted_keys;
+    SNARF<int64_t> sorted(keys, KEYS_SORTED, 10, 100, size_t(64));
+    assert(keys == sorted_keys);
+    check_same_bit_array(sorted._blocks, expected._blocks);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        int64_t key = input_keys[i];
+        assert(snarf.range_query(key, key));
+        assert(unique.range_query(key, key));
+    }
+}
+
+
+// check_merged<Filter>(snarf, merged, keys)
+//   Checks that every block of `merged` holds the locations of the same
+//   block of `snarf` and those of the sorted `keys` predicted in it, and
+//   that the blocks without new keys are encoded as before.
+template <typename Filter>
+static void check_merged(
+    const Filter& snarf, const Filter& merged, const std::vector<uint64_t>& keys
+) {
+    size_t block_range = snarf._block_size * snarf._scaling_factor;
+    std::vector<size_t> added(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        added[i] = snarf._predict_location(keys[i]);
+    }
+
+    size_t next = 0;
+    for (size_t block = 0; block < snarf._total_blocks; ++block) {
+        size_t offset, num_keys;
+        const BitArray& bits = snarf._locate_block(block, offset, num_keys);
+        std::vector<size_t> expected(num_keys);
+        snarf._codec.decode(bits, offset, num_keys, expected.data());
+        size_t first = next;
+        while (next < added.size() && added[next] < (block + 1) * block_range) {
+            expected.push_back(added[next++] - block * block_range);
+        }
+        std::sort(expected.begin(), expected.end());
+
+        size_t merged_offset, merged_num_keys;
+        const BitArray& merged_bits = merged._locate_block(
+            block, merged_offset, merged_num_keys
+        );
+        assert(merged_num_keys == expected.size());
+        std::vector<size_t> locations(merged_num_keys);
+        merged._codec.decode(
+            merged_bits, merged_offset, merged_num_keys, locations.data()
+        );
+        assert(locations == expected);
+
+        if (next == first) {
+            size_t length = snarf._block_bits(num_keys);
+            for (size_t i = 0; i < length; ++i) {
+                assert(
+                    merged_bits.read_bit(merged_offset + i)
+                        == bits.read_bit(offset + i)
+                );
+            }
+        }
+    }
+}
+
+
+void TestSNARF::test_merged() {
+    std::mt19937_64 rng(103);
+    std::vector<uint64_t> input_keys(40000);
+    for (auto& key : input_keys) {
+        key = rng() % 1000000000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    // Keys spread thinly, a dense cluster that overflows lines, and keys past
+    // the last input key.
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < 500; ++i) {
+        keys.push_back(rng() % 1000000000);
+    }
+    for (size_t i = 0; i < 300; ++i) {
+        keys.push_back(500000000 + rng() % 1000);
+    }
+    for (size_t i = 0; i < 20; ++i) {
+        keys.push_back(input_keys.back() + 1 + rng() % 1000);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::string path = "/tmp/snarfpp_test_merged.snarf";
+    std::string merged_path = "/tmp/snarfpp_test_merged_2.snarf";
+    BlockLayout layouts[] = {
+        BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64, BLOCK_LAYOUT_LINE_128
+    };
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t> snarf(input_keys, 10, 100, 64, layout);
+        SNARF<uint64_t> merged = snarf.merged(keys);
+        check_merged(snarf, merged, keys);
+        for (uint64_t key : input_keys) {
+            assert(merged.range_query(key, key));
+        }
+        for (uint64_t key : keys) {
+            assert(merged.range_query(key, key));
+        }
+
+        // Merging in more keys, or none.
+        std::vector<uint64_t> more = {1, 499999999, 500000500};
+        check_merged(merged, merged.merged(more), more);
+        SNARF<uint64_t> same = snarf.merged({});
+        check_same_bit_array(same._blocks, snarf._blocks);
+        check_same_bit_array(same._lines, snarf._lines);
+
+        // A mapped filter merges into an owned one, which can be saved. Its
+        // model still points into the first file.
+        snarf.save(path);
+        SNARF<uint64_t> mapped = SNARF<uint64_t>::map(path);
+        SNARF<uint64_t> mapped_merged = mapped.merged(keys);
+        check_same_bit_array(mapped_merged._blocks, merged._blocks);
+        check_same_bit_array(mapped_merged._lines, merged._lines);
+        mapped_merged.save(merged_path);
+        SNARF<uint64_t> reloaded = SNARF<uint64_t>::map(merged_path, true);
+        check_same_bit_array(reloaded._blocks, merged._blocks);
+    }
+    std::remove(path.c_str());
+    std::remove(merged_path.c_str());
+
+    SNARF<uint64_t, LinearSplineModel<uint64_t>, EliasFanoCodec> elias_fano(
+        input_keys, 10, 100, ErrorBound(0.001)
+    );
+    check_merged(elias_fano, elias_fano.merged(keys), keys);
+}
+
+
+// check_prefix_bits(a, b, num_bits)
+//   Checks that the bit arrays `a` and `b` agree on their first `num_bits`
+//   bits.
+static void check_prefix_bits(
+    const BitArray& a, const BitArray& b, size_t num_bits
+) {
+    assert(num_bits <= a.size() && num_bits <= b.size());
+    for (size_t i = 0; i < num_bits; ++i) {
+        assert(a.read_bit(i) == b.read_bit(i));
+    }
+}
+
+
+void TestSNARF::test_append() {
+    // Timestamps with random gaps, the first part built into a filter and
+    // the rest appended in batches of every size from one key to several
+    // blocks. A burst of keys 1 apart overflows lines.
+    std::mt19937_64 rng(131);
+    std::vector<uint64_t> keys(60000);
+    uint64_t timestamp = 1700000000000000000ULL;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        timestamp += i >= 45000 && i < 45300 ? 1 : 1 + rng() % 20000;
+        keys[i] = timestamp;
+    }
+    std::vector<uint64_t> input_keys(keys.begin(), keys.begin() + 30050);
+    size_t batch_sizes[] = {1, 2, 7, 100, 30, 5000, 9810, 15000};
+
+    std::string path = "/tmp/snarfpp_test_append.snarf";
+    BlockLayout layouts[] = {BLOCK_LAYOUT_ARENA, BLOCK_LAYOUT_LINE_64};
+    for (BlockLayout layout : layouts) {
+        SNARF<uint64_t> snarf(input_keys, 10, 100, 64, layout);
+        SNARF<uint64_t> original = snarf;
+        size_t model_size = snarf._model._key_array.size();
+
+        size_t next = input_keys.size();
+        for (size_t batch_size : batch_sizes) {
+            std::vector<uint64_t> batch(
+                keys.begin() + next, keys.begin() + next + batch_size
+            );
+            snarf.append(batch, 64);
+            next += batch_size;
+
+            // The keys take the ranks after the keys before them, however
+            // small the batch, and the model samples every 64th appended key
+            // and the last one.
+            size_t appended = next - input_keys.size();
+            assert(snarf._num_appended == appended);
+            assert(snarf._total_blocks == next / snarf._block_size + 1);
+            assert(snarf._pending.size() == appended % 64);
+            assert(
+                snarf._model._key_array.size() == model_size + appended / 64
+                    + (appended % 64 != 0 ? 1 : 0)
+            );
+            for (uint64_t key : batch) {
+                assert(snarf.range_query(key, key));
+            }
+        }
+        assert(next == keys.size());
+
+        // The blocks before the last one of the original filter and the
+        // predictions of the keys they hold are left as they were.
+        size_t kept_blocks = original._total_blocks - 1;
+        if (layout == BLOCK_LAYOUT_ARENA) {
+            check_prefix_bits(
+                original._blocks, snarf._blocks,
+                original._block_offset(kept_blocks)
+            );
+            for (size_t i = 0; i <= kept_blocks; ++i) {
+                assert(snarf._block_offset(i) == original._block_offset(i));
+            }
+        } else {
+            check_prefix_bits(
+                original._lines, snarf._lines,
+                kept_blocks * snarf._line_bits()
+            );
+        }
+        for (uint64_t key : input_keys) {
+            assert(
+                snarf._predict_location(key) == original._predict_location(key)
+            );
+        }
+
+        // No false negatives, and about the false positive rate and size of
+        // a filter built from all keys, halfway between the appended keys.
+        for (uint64_t key : keys) {
+            assert(snarf.range_query(key, key));
+        }
+        SNARF<uint64_t> rebuilt(keys, 10, 100, 64, layout);
+        size_t false_positives = 0;
+        size_t rebuilt_false_positives = 0;
+        for (size_t i = input_keys.size(); i + 1 < keys.size(); ++i) {
+            uint64_t key = keys[i] + (keys[i + 1] - keys[i]) / 2;
+            if (key != keys[i]) {
+                false_positives += snarf.range_query(key, key);
+                rebuilt_false_positives += rebuilt.range_query(key, key);
+            }
+        }
+        assert(false_positives <= rebuilt_false_positives * 5 / 4 + 10);
+        assert(snarf.size_bytes() <= rebuilt.size_bytes() * 21 / 20);
+
+        // The appended filter saves and maps like any other, and a mapped
+        // filter cannot be appended to.
+        snarf.save(path);
+        SNARF<uint64_t> mapped = SNARF<uint64_t>::map(path, true);
+        assert(mapped._total_blocks == snarf._total_blocks);
+        assert(mapped._num_appended == snarf._num_appended);
+        for (size_t i = 0; i < keys.size(); i += 3) {
+            assert(mapped.range_query(keys[i], keys[i]));
+        }
+        try {
+            mapped.append({keys.back() + 100}, 64);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(
+                std::string(e.what())
+                    == "ERROR: Cannot modify a read-only view."
+            );
+        }
+
+        // Keys can still be merged in after appending, but a filter with
+        // merged keys takes no appends.
+        std::vector<uint64_t> more = {keys[50000] + 1, keys.back() + 1};
+        SNARF<uint64_t> merged = snarf.merged(more);
+        try {
+            merged.append({keys.back() + 2}, 64);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(
+                std::string(e.what())
+                    == "ERROR: Cannot append to a filter with merged keys."
+            );
+        }
+        assert(merged.range_query(more[0], more[0]));
+        assert(merged.range_query(more[1], more[1]));
+        for (size_t i = 0; i < keys.size(); i += 3) {
+            assert(merged.range_query(keys[i], keys[i]));
+        }
+    }
+
+    // A key merged past the last key would move once the spline is
+    // extended, so the append is rejected and the key stays found.
+    std::vector<uint64_t> spaced(1000);
+    for (size_t i = 0; i < spaced.size(); ++i) {
+        spaced[i] = i * 10;
+    }
+    SNARF<uint64_t> spaced_snarf(spaced, 10, 32, 8);
+    spaced_snarf = spaced_snarf.merged({10005});
+    try {
+        spaced_snarf.append({20000}, 8);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(
+            std::string(e.what())
+                == "ERROR: Cannot append to a filter with merged keys."
+        );
+    }
+    assert(spaced_snarf.range_query(10005, 10005));
+    assert(spaced_snarf._num_appended == 0);
+    std::remove(path.c_str());
+
+    // Only strictly increasing keys greater than the filter's keys can be
+    // appended, with the sorted search layout. A rejected call leaves the
+    // filter as it was.
+    SNARF<uint64_t> snarf(input_keys, 10, 100, 64);
+    snarf.append({keys[30050], keys[30051]}, 64);
+    std::vector<std::vector<uint64_t> > invalid = {
+        {keys[30051]}, {keys[30052], keys[30052]}, {keys[30053], keys[30052]}
+    };
+    const char* errors[] = {
+        "ERROR: Appended keys must be greater than the model's keys.",
+        "ERROR: Appended keys must be strictly increasing.",
+        "ERROR: Appended keys must be strictly increasing."
+    };
+    for (size_t i = 0; i < invalid.size(); ++i) {
+        try {
+            snarf.append(invalid[i], 64);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(std::string(e.what()) == errors[i]);
+        }
+        assert(snarf._num_appended == 2 && snarf._pending.size() == 2);
+    }
+    snarf.set_search_layout(SEARCH_LAYOUT_EYTZINGER);
+    try {
+        snarf.append({keys[30052]}, 64);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(
+            std::string(e.what())
+                == "ERROR: Appending requires the sorted search layout."
+        );
+    }
+    assert(snarf._num_appended == 2);
+}
+
+
 int TestSNARF::run_snarf_tests() {
     test_constructor();
     test_constructor_failure_low_bits_per_key();
     test_range_query_with_no_matches();
     test_range_query_with_matches();
     test_size_bytes();
+    test_predict_location();
+    test_range_query_no_false_negatives();
+    test_block_directory();
+    test_line_layouts();
+    test_save_and_map();
+    test_elias_fano_codec();
+    test_error_bound();
+    test_kernel_models();
+    test_rmi_model();
+    test_range_query_batch();
+    test_range_query_interleaved();
+    test_range_query_parallel();
+    test_parallel_build();
+    test_fused_build();
+    test_unsorted_input();
+    test_merged();
+    test_append();
 
     std::cout << "All SNARF unit tests passed successfully.\n";
     return 0;
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include "../include/base_test_utils.hpp"
+
+
+void TestSNARFBuilder::test_build_from_range() {
+    std::mt19937_64 rng(17);
+    std::vector<uint64_t> input_keys(50000);
+    for (auto& key : input_keys) {
+        key = rng() % 1000000000;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    // A 4096-bit write buffer forces many flushes, some mid-superblock.
+    std::string path = "/tmp/snarfpp_test_build_from_range.snarf";
+    SNARFBuilder<uint64_t> builder(10, 100, 64, 4096);
+    auto stream = make_key_stream(input_keys.begin(), input_keys.end());
+    builder.build(stream, path);
+
+    SNARF<uint64_t> snarf(input_keys, 10, 100, 64);
+    const SNARF<uint64_t> built = SNARF<uint64_t>::map(path, true);
+    assert(built._total_blocks == snarf._total_blocks);
+    assert(built._blocks.size() == snarf._blocks.size());
+    assert(built.size_bytes() == snarf.size_bytes());
+    for (size_t i = 0; i < snarf._blocks._words.size(); ++i) {
+        assert(built._blocks._words[i] == snarf._blocks._words[i]);
+    }
+    for (size_t i = 0; i <= snarf._total_blocks; ++i) {
+        assert(built._block_offset(i) == snarf._block_offset(i));
+    }
+
+    for (size_t i = 0; i < 20000; ++i) {
+        uint64_t lower = rng() % 1000000000;
+        uint64_t upper = lower + rng() % 100000;
+        assert(
+            built.range_query(lower, upper) == snarf.range_query(lower, upper)
+        );
+    }
+
+    std::remove(path.c_str());
+}
+
+
+void TestSNARFBuilder::test_build_from_file() {
+    std::mt19937_64 rng(23);
+    std::vector<uint32_t> input_keys(200000);
+    for (auto& key : input_keys) {
+        key = rng() % 4000000000u;
+    }
+    std::sort(input_keys.begin(), input_keys.end());
+
+    std::string key_path = "/tmp/snarfpp_test_build_from_file.keys";
+    std::string path = "/tmp/snarfpp_test_build_from_file.snarf";
+    {
+        std::ofstream file(key_path.c_str(), std::ios::binary);
+        file.write(
+            reinterpret_cast<const char*>(input_keys.data()),
+            input_keys.size() * sizeof(uint32_t)
+        );
+    }
+
+    KeyFileStream<uint32_t> stream(key_path);
+    assert(stream.size() == input_keys.size());
+    SNARFBuilder<uint32_t>(12, 1000, 100).build(stream, path);
+
+    SNARF<uint32_t> built = SNARF<uint32_t>::map(path, true);
+    for (const auto& key : input_keys) {
+        assert(built.range_query(key, key));
+    }
+
+    std::remove(key_path.c_str());
+    std::remove(path.c_str());
+}
+
+
+// ChangingKeyStream
+//   A key stream whose second pass yields `second` instead of `first`, like
+//   a key file modified during a build.
+struct ChangingKeyStream {
+    std::vector<int> first;
+    std::vector<int> second;
+    size_t passes;
+    size_t position;
+
+    size_t size() const {
+        return this->first.size();
+    }
+
+    void rewind() {
+        ++this->passes;
+        this->position = 0;
+    }
+
+    bool next(int& key) {
+        const std::vector<int>& keys =
+            this->passes > 1 ? this->second : this->first;
+        if (this->position == keys.size()) {
+            return false;
+        }
+        key = keys[this->position++];
+        return true;
+    }
+};
+
+
+void TestSNARFBuilder::test_build_failure() {
+    std::string path = "/tmp/snarfpp_test_build_failure.snarf";
+
+    std::vector<int> unsorted = {1, 5, 3, 7};
+    auto stream = make_key_stream(unsorted.begin(), unsorted.end());
+    try {
+        SNARFBuilder<int>(10, 2, 2).build(stream, path);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+
+    std::vector<int> sorted = {1, 3, 5, 7};
+    auto sorted_stream = make_key_stream(sorted.begin(), sorted.end());
+    try {
+        SNARFBuilder<int>(10, 2, 5).build(sorted_stream, path);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(true);
+    }
+
+    // The second pass must yield the keys of the first.
+    std::vector<int> fewer = {1, 3, 5};
+    std::vector<int> more = {1, 3, 5, 7, 9};
+    std::vector<int> unsorted_later = {1, 5, 3, 7};
+    std::vector<int>* changes[] = {&fewer, &more, &unsorted_later};
+    for (std::vector<int>* change : changes) {
+        ChangingKeyStream changing = {sorted, *change, 0, 0};
+        try {
+            SNARFBuilder<int>(10, 2, 2).build(changing, path);
+            assert(false);
+        } catch (const std::runtime_error& e) {
+            assert(changing.passes == 2);
+        }
+    }
+
+    // A key file that ends with part of a key is rejected.
+    std::string key_path = "/tmp/snarfpp_test_build_failure.keys";
+    {
+        std::ofstream file(key_path.c_str(), std::ios::binary);
+        file.write(reinterpret_cast<const char*>(sorted.data()), 7);
+    }
+    try {
+        KeyFileStream<int> partial(key_path);
+        assert(false);
+    } catch (const std::runtime_error& e) {
+        assert(
+            std::string(e.what()) == "ERROR: Key file ends with a partial key."
+        );
+    }
+    std::remove(key_path.c_str());
+
+    std::remove(path.c_str());
+}
+
+
+int TestSNARFBuilder::run_snarf_builder_tests() {
+    test_build_from_range();
+    test_build_from_file();
+    test_build_failure();
+
+    std::cout << "All SNARF builder unit tests passed successfully.\n";
+    return 0;
+}
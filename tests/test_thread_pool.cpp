@@ -0,0 +1,118 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include <chrono>
+
+#include "../include/base_test_utils.hpp"
+
+
+void TestThreadPool::test_run() {
+    size_t sizes[] = {1, 2, 5};
+    for (size_t num_threads : sizes) {
+        ThreadPool pool(num_threads);
+        assert(pool.size() == num_threads);
+
+        // Batches smaller than, equal to and much larger than the pool.
+        size_t batches[] = {0, 1, num_threads, 1000, 3};
+        for (size_t num_tasks : batches) {
+            std::vector<std::atomic<size_t> > runs(num_tasks);
+            for (auto& count : runs) {
+                count = 0;
+            }
+            pool.run(num_tasks, [&](size_t task) {
+                ++runs[task];
+            });
+            for (auto& count : runs) {
+                assert(count == 1);
+            }
+        }
+    }
+
+    // A pool of no threads still runs tasks on the caller.
+    ThreadPool pool(0);
+    assert(pool.size() == 1);
+    size_t sum = 0;
+    pool.run(10, [&](size_t task) {
+        sum += task;
+    });
+    assert(sum == 45);
+}
+
+
+void TestThreadPool::test_work_stealing() {
+    // The calling thread's first task waits until every other task is done,
+    // which only happens if the rest of its slice is stolen.
+    ThreadPool pool(4);
+    size_t num_tasks = 64;
+    std::atomic<size_t> finished(0);
+    std::atomic<bool> stolen(false);
+    pool.run(num_tasks, [&](size_t task) {
+        if (task == 0) {
+            auto deadline = std::chrono::steady_clock::now()
+                + std::chrono::seconds(10);
+            while (
+                finished < num_tasks - 1
+                && std::chrono::steady_clock::now() < deadline
+            ) {
+                std::this_thread::yield();
+            }
+            stolen = finished == num_tasks - 1;
+        }
+        ++finished;
+    });
+    assert(stolen);
+    assert(finished == num_tasks);
+}
+
+
+void TestThreadPool::test_nested_run() {
+    size_t sizes[] = {1, 3};
+    for (size_t num_threads : sizes) {
+        ThreadPool pool(num_threads);
+        std::vector<std::atomic<size_t> > runs(8 * 50);
+        for (auto& count : runs) {
+            count = 0;
+        }
+        pool.run(8, [&](size_t outer) {
+            pool.run(50, [&](size_t inner) {
+                ++runs[outer * 50 + inner];
+            });
+        });
+        for (auto& count : runs) {
+            assert(count == 1);
+        }
+
+        // A pooled radix sort inside a task of the same pool.
+        std::vector<std::vector<uint64_t> > keys(4);
+        pool.run(keys.size(), [&](size_t task) {
+            std::mt19937_64 rng(task);
+            keys[task].resize(3 * PARALLEL_SORT_KEYS);
+            for (auto& key : keys[task]) {
+                key = rng();
+            }
+            RadixSort<uint64_t>::sort(keys[task], &pool);
+        });
+        for (const auto& sorted : keys) {
+            assert(std::is_sorted(sorted.begin(), sorted.end()));
+        }
+
+        // The pool still runs batches across its threads afterwards.
+        std::atomic<size_t> sum(0);
+        pool.run(100, [&](size_t task) {
+            sum += task;
+        });
+        assert(sum == 4950);
+    }
+}
+
+
+int TestThreadPool::run_thread_pool_tests() {
+    test_run();
+    test_work_stealing();
+    test_nested_run();
+
+    std::cout << "All ThreadPool unit tests passed successfully.\n";
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2024, Gabriel Chiong <gabrielchiong@g.harvard.edu>
+ * See LICENSE in the directory root for terms of use.
+ */
+
+#include <atomic>
+#include <chrono>
+
+#include "../include/base_test_utils.hpp"
+
+
+// random_keys(num_keys, seed)
+//   Returns sorted random keys below 10^9.
+static std::vector<uint64_t> random_keys(size_t num_keys, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> keys(num_keys);
+    for (auto& key : keys) {
+        key = rng() % 1000000000;
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+
+void TestUpdatableSNARF::test_insert() {
+    std::vector<uint64_t> input_keys = random_keys(50000, 107);
+    UpdatableSNARF<uint64_t> snarf(
+        SNARF<uint64_t>(input_keys, 10, 100, 64), 100
+    );
+    std::shared_ptr<const SNARF<uint64_t> > original = snarf.filter();
+
+    // Enough keys for several merges, each found as soon as it is inserted.
+    std::mt19937_64 rng(109);
+    std::vector<uint64_t> keys(1000);
+    for (auto& key : keys) {
+        key = 2000000000 + rng() % 1000000000;
+        snarf.insert(key);
+        assert(snarf.range_query(key, key));
+    }
+    for (uint64_t key : keys) {
+        assert(snarf.range_query(key, key));
+    }
+    for (size_t i = 0; i < input_keys.size(); i += 7) {
+        assert(snarf.range_query(input_keys[i], input_keys[i]));
+    }
+
+    // Once flushed, the filter alone holds every key, as if they had been
+    // merged into the original filter at once.
+    snarf.flush();
+    std::shared_ptr<const SNARF<uint64_t> > filter = snarf.filter();
+    assert(filter != original);
+    std::shared_ptr<const UpdatableSNARF<uint64_t>::Snapshot> snapshot =
+        std::atomic_load(&snarf._snapshot);
+    assert(!snapshot->frozen);
+    assert(snapshot->runs.empty());
+    for (uint64_t key : keys) {
+        assert(filter->range_query(key, key));
+    }
+    std::sort(keys.begin(), keys.end());
+    SNARF<uint64_t> expected = original->merged(keys);
+    for (size_t i = 0; i < expected._blocks._words.size(); ++i) {
+        assert(filter->_blocks._words[i] == expected._blocks._words[i]);
+    }
+
+    // A key stays in the buffer, where range queries find it, until the
+    // buffer fills up or is flushed.
+    snarf.insert(5000000000ULL);
+    assert(std::atomic_load(&snarf._snapshot)->buffered == 1);
+    assert(snarf.range_query(4999999990ULL, 5000000010ULL));
+
+    // The buffer keeps one sorted run per bit of its size.
+    for (uint64_t key = 5000000006ULL; key > 5000000000ULL; --key) {
+        snarf.insert(key);
+    }
+    snapshot = std::atomic_load(&snarf._snapshot);
+    assert(snapshot->buffered == 7);
+    assert(snapshot->runs.size() == 3);
+    for (size_t i = 0; i < 3; ++i) {
+        assert(snapshot->runs[i]->size() == size_t(4) >> i);
+        assert(std::is_sorted(
+            snapshot->runs[i]->begin(), snapshot->runs[i]->end()
+        ));
+    }
+    for (uint64_t key = 5000000000ULL; key <= 5000000006ULL; ++key) {
+        assert(snarf.range_query(key, key));
+    }
+    snarf.flush();
+    assert(std::atomic_load(&snarf._snapshot)->runs.empty());
+    assert(snarf.filter()->range_query(4999999990ULL, 5000000010ULL));
+    snarf.flush();
+}
+
+
+void TestUpdatableSNARF::test_concurrent_queries() {
+    std::vector<uint64_t> input_keys = random_keys(50000, 113);
+    UpdatableSNARF<uint64_t> snarf(
+        SNARF<uint64_t>(input_keys, 10, 100, 64, BLOCK_LAYOUT_LINE_64), 64
+    );
+
+    // The writer publishes how many keys it has inserted; the readers check
+    // that those keys are all found.
+    std::mt19937_64 rng(127);
+    std::vector<uint64_t> keys(3000);
+    for (auto& key : keys) {
+        key = rng() % 1000000000;
+    }
+    std::atomic<size_t> inserted(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < 3; ++t) {
+        readers.emplace_back([&, t]() {
+            std::mt19937_64 reader_rng(t);
+            while (inserted < keys.size() && !failed) {
+                size_t count = inserted;
+                for (size_t i = 0; i < 20 && count > 0; ++i) {
+                    uint64_t key = keys[reader_rng() % count];
+                    if (!snarf.range_query(key, key)) {
+                        failed = true;
+                    }
+                }
+                uint64_t key = input_keys[reader_rng() % input_keys.size()];
+                if (!snarf.range_query(key, key)) {
+                    failed = true;
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        snarf.insert(keys[i]);
+        inserted = i + 1;
+        if (i % 500 == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    assert(!failed);
+
+    snarf.flush();
+    for (uint64_t key : keys) {
+        assert(snarf.filter()->range_query(key, key));
+    }
+}
+
+
+int TestUpdatableSNARF::run_updatable_snarf_tests() {
+    test_insert();
+    test_concurrent_queries();
+
+    std::cout << "All UpdatableSNARF unit tests passed successfully.\n";
+    return 0;
+}